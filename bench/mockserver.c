@@ -0,0 +1,1064 @@
+/*
+A local stand-in for the Hotmart API and its HLS origin.
+
+It serves a synthetic course over plain HTTP, so that sparklec can be benchmarked end to end
+without a live account:
+	
+	sparklec_mockserver --port=8080 --products=1 --modules=4 --pages=8 --segments=20 &
+	sparklec --api-url=http://127.0.0.1:8080
+	
+Any username and password are accepted. Unless --segment points to a real MPEG-TS file, every
+segment is a minimal stream the remuxer accepts: a PAT and PMT, one H.264 IDR frame and one AAC
+frame, padded with null packets up to --segment-size. All segments carry the same timestamps,
+so the resulting files are not meant to be played.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <signal.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <bearssl.h>
+#include <jansson.h>
+
+#define MOCK_REQUEST_MAX_SIZE (1024 * 16)
+#define MOCK_BLOCK_SIZE 16
+#define TS_PACKET_SIZE 188
+#define TS_PAYLOAD_SIZE 184
+
+/* Packets taken by the tables and frames of a generated segment, before the null packets */
+#define TS_GENERATED_PACKETS 8
+
+#define TS_PID_PAT 0x0000
+#define TS_PID_PMT 0x1000
+#define TS_PID_VIDEO 0x0100
+#define TS_PID_AUDIO 0x0101
+#define TS_PID_NULL 0x1FFF
+
+/* 1.4 seconds on the 90 kHz clock */
+#define TS_FIRST_PTS 126000
+
+static const char HOTMART_API_CLUB_PATH[] = "/hot-club-api/rest/v3";
+static const char SUBDOMAIN_PREFIX[] = "produto-";
+
+struct MockOptions {
+	uint16_t port;
+	size_t products;
+	size_t modules;
+	size_t pages;
+	size_t segments;
+	size_t segment_size;
+	const char* segment_filename;
+	size_t attachments;
+	size_t attachment_size;
+	double segment_duration;
+	unsigned int latency;
+	int encrypt;
+};
+
+struct Buffer {
+	unsigned char* data;
+	size_t size;
+};
+
+struct Request {
+	char method[8];
+	char path[1024];
+	char host[256];
+	char club[256];
+	size_t content_length;
+	int close;
+};
+
+static struct MockOptions options = {
+	.port = 8080,
+	.products = 1,
+	.modules = 4,
+	.pages = 8,
+	.segments = 20,
+	.segment_size = 1024 * 1024,
+	.attachments = 1,
+	.attachment_size = 1024 * 1024 * 4,
+	.segment_duration = 6
+};
+
+static struct Buffer segment = {0};
+static struct Buffer attachment = {0};
+
+static const unsigned char KEY[MOCK_BLOCK_SIZE] = {
+	0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+	0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c
+};
+
+/* Every segment is encrypted with the same explicit IV, so one ciphertext serves all of them */
+static const unsigned char IV[MOCK_BLOCK_SIZE] = {
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01
+};
+
+/* 1280x720, Baseline profile, level 3.0 */
+static const unsigned char H264_SPS[] = {0x67, 0x42, 0xC0, 0x1E, 0xDA, 0x01, 0x40, 0x16, 0xE4};
+static const unsigned char H264_PPS[] = {0x68, 0xCE, 0x38, 0x80};
+
+static int parse_number(const char* const s, size_t* const value) {
+	
+	if (*s == '\0') {
+		return 0;
+	}
+	
+	char* end = NULL;
+	const unsigned long long number = strtoull(s, &end, 10);
+	
+	if (*end != '\0') {
+		return 0;
+	}
+	
+	*value = (size_t) number;
+	
+	return 1;
+	
+}
+
+static const char* option_value(const char* const argument, const char* const name) {
+	
+	const size_t size = strlen(name);
+	
+	if (strncmp(argument, name, size) != 0 || argument[size] != '=') {
+		return NULL;
+	}
+	
+	return &argument[size + 1];
+	
+}
+
+static int options_parse(const int argc, char* const argv[]) {
+	
+	const struct {
+		const char* name;
+		size_t* value;
+	} numbers[] = {
+		{"--products", &options.products},
+		{"--modules", &options.modules},
+		{"--pages", &options.pages},
+		{"--segments", &options.segments},
+		{"--segment-size", &options.segment_size},
+		{"--attachments", &options.attachments},
+		{"--attachment-size", &options.attachment_size}
+	};
+	
+	for (int index = 1; index < argc; index++) {
+		const char* const argument = argv[index];
+		const char* value = NULL;
+		size_t number = 0;
+		int matched = 0;
+		
+		for (size_t position = 0; position < sizeof(numbers) / sizeof(*numbers); position++) {
+			if ((value = option_value(argument, numbers[position].name)) != NULL) {
+				if (!parse_number(value, numbers[position].value)) {
+					return 0;
+				}
+				
+				matched = 1;
+				break;
+			}
+		}
+		
+		if (matched) {
+			continue;
+		}
+		
+		if (strcmp(argument, "--encrypt") == 0) {
+			options.encrypt = 1;
+		} else if ((value = option_value(argument, "--port")) != NULL) {
+			if (!parse_number(value, &number) || number == 0 || number > UINT16_MAX) {
+				return 0;
+			}
+			
+			options.port = (uint16_t) number;
+		} else if ((value = option_value(argument, "--latency")) != NULL) {
+			if (!parse_number(value, &number)) {
+				return 0;
+			}
+			
+			options.latency = (unsigned int) number;
+		} else if ((value = option_value(argument, "--segment")) != NULL) {
+			options.segment_filename = value;
+		} else {
+			return 0;
+		}
+	}
+	
+	return options.products > 0 && options.segments > 0;
+	
+}
+
+static void options_usage(const char* const program) {
+	
+	fprintf(stderr, "Uso: %s [opções]\r\n", program);
+	fprintf(stderr, "\r\n");
+	fprintf(stderr, "  --port=<n>             Porta a ser usada (padrão: 8080)\r\n");
+	fprintf(stderr, "  --products=<n>         Número de produtos (padrão: 1)\r\n");
+	fprintf(stderr, "  --modules=<n>          Módulos por produto (padrão: 4)\r\n");
+	fprintf(stderr, "  --pages=<n>            Páginas por módulo (padrão: 8)\r\n");
+	fprintf(stderr, "  --segments=<n>         Segmentos por aula (padrão: 20)\r\n");
+	fprintf(stderr, "  --segment-size=<n>     Tamanho de cada segmento, em bytes (padrão: 1048576)\r\n");
+	fprintf(stderr, "  --segment=<arquivo>    Serve este arquivo MPEG-TS como cada um dos segmentos\r\n");
+	fprintf(stderr, "  --attachments=<n>      Anexos por página (padrão: 1)\r\n");
+	fprintf(stderr, "  --attachment-size=<n>  Tamanho de cada anexo, em bytes (padrão: 4194304)\r\n");
+	fprintf(stderr, "  --latency=<ms>         Atraso adicionado a cada resposta (padrão: 0)\r\n");
+	fprintf(stderr, "  --encrypt              Criptografa os segmentos com AES-128\r\n");
+	
+}
+
+static uint32_t mpeg_crc32(const unsigned char* const data, const size_t size) {
+	
+	uint32_t crc = 0xFFFFFFFF;
+	
+	for (size_t index = 0; index < size; index++) {
+		crc ^= (uint32_t) data[index] << 24;
+		
+		for (int bit = 0; bit < 8; bit++) {
+			crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+		}
+	}
+	
+	return crc;
+	
+}
+
+static size_t ts_packetize(unsigned char* const out, const int pid, const unsigned char* data, size_t size) {
+	/*
+	Splits a section or PES packet into transport packets, stuffing the last one through its
+	adaptation field. Returns the number of bytes written.
+	*/
+	
+	static unsigned char continuity[TS_PID_NULL + 1];
+	size_t offset = 0;
+	int first = 1;
+	
+	while (size > 0) {
+		unsigned char* const packet = out + offset;
+		const size_t chunk = size < TS_PAYLOAD_SIZE ? size : TS_PAYLOAD_SIZE;
+		const size_t stuffing = TS_PAYLOAD_SIZE - chunk;
+		
+		packet[0] = 0x47;
+		packet[1] = (unsigned char) ((first ? 0x40 : 0x00) | (pid >> 8));
+		packet[2] = (unsigned char) pid;
+		packet[3] = (unsigned char) ((stuffing > 0 ? 0x30 : 0x10) | (continuity[pid]++ & 0x0F));
+		
+		if (stuffing > 0) {
+			packet[4] = (unsigned char) (stuffing - 1);
+			
+			if (stuffing > 1) {
+				packet[5] = 0x00;
+				memset(packet + 6, 0xFF, stuffing - 2);
+			}
+		}
+		
+		memcpy(packet + 4 + stuffing, data, chunk);
+		
+		data += chunk;
+		size -= chunk;
+		offset += TS_PACKET_SIZE;
+		first = 0;
+	}
+	
+	return offset;
+	
+}
+
+static size_t ts_section(unsigned char* const out, const int pid, const unsigned char* const table, const size_t size) {
+	
+	unsigned char section[1 + size + 4];
+	
+	/* The pointer field, then the table and its CRC */
+	section[0] = 0x00;
+	memcpy(section + 1, table, size);
+	
+	const uint32_t crc = mpeg_crc32(table, size);
+	
+	section[1 + size] = (unsigned char) (crc >> 24);
+	section[2 + size] = (unsigned char) (crc >> 16);
+	section[3 + size] = (unsigned char) (crc >> 8);
+	section[4 + size] = (unsigned char) crc;
+	
+	return ts_packetize(out, pid, section, sizeof(section));
+	
+}
+
+static size_t pes_header(unsigned char* const out, const int stream_id, const size_t payload_size) {
+	/*
+	A PES header carrying only a PTS. Video PES packets are left unbounded, as in broadcast streams.
+	*/
+	
+	const size_t length = stream_id == 0xE0 ? 0 : 8 + payload_size;
+	const uint64_t pts = TS_FIRST_PTS;
+	
+	const unsigned char header[] = {
+		0x00, 0x00, 0x01, (unsigned char) stream_id,
+		(unsigned char) (length >> 8), (unsigned char) length,
+		0x80, 0x80, 0x05,
+		(unsigned char) (0x21 | ((pts >> 29) & 0x0E)),
+		(unsigned char) (pts >> 22),
+		(unsigned char) (((pts >> 14) & 0xFE) | 0x01),
+		(unsigned char) (pts >> 7),
+		(unsigned char) (((pts << 1) & 0xFE) | 0x01)
+	};
+	
+	memcpy(out, header, sizeof(header));
+	
+	return sizeof(header);
+	
+}
+
+static void segment_generate(unsigned char* const data, const size_t size) {
+	
+	size_t offset = 0;
+	
+	const unsigned char pat[] = {
+		0x00, 0xB0, 0x0D, 0x00, 0x01, 0xC1, 0x00, 0x00,
+		0x00, 0x01, 0xE0 | (TS_PID_PMT >> 8), TS_PID_PMT & 0xFF
+	};
+	
+	offset += ts_section(data + offset, TS_PID_PAT, pat, sizeof(pat));
+	
+	const unsigned char pmt[] = {
+		0x02, 0xB0, 0x17, 0x00, 0x01, 0xC1, 0x00, 0x00,
+		0xE0 | (TS_PID_VIDEO >> 8), TS_PID_VIDEO & 0xFF, 0xF0, 0x00,
+		0x1B, 0xE0 | (TS_PID_VIDEO >> 8), TS_PID_VIDEO & 0xFF, 0xF0, 0x00,
+		0x0F, 0xE0 | (TS_PID_AUDIO >> 8), TS_PID_AUDIO & 0xFF, 0xF0, 0x00
+	};
+	
+	offset += ts_section(data + offset, TS_PID_PMT, pmt, sizeof(pmt));
+	
+	/* Access unit delimiter, parameter sets and an IDR slice whose contents do not matter */
+	unsigned char video[640];
+	size_t video_size = 0;
+	
+	static const unsigned char AUD[] = {0x00, 0x00, 0x00, 0x01, 0x09, 0xF0};
+	static const unsigned char START_CODE[] = {0x00, 0x00, 0x00, 0x01};
+	
+	video_size += pes_header(video, 0xE0, 0);
+	
+	memcpy(video + video_size, AUD, sizeof(AUD));
+	video_size += sizeof(AUD);
+	
+	memcpy(video + video_size, START_CODE, sizeof(START_CODE));
+	video_size += sizeof(START_CODE);
+	memcpy(video + video_size, H264_SPS, sizeof(H264_SPS));
+	video_size += sizeof(H264_SPS);
+	
+	memcpy(video + video_size, START_CODE, sizeof(START_CODE));
+	video_size += sizeof(START_CODE);
+	memcpy(video + video_size, H264_PPS, sizeof(H264_PPS));
+	video_size += sizeof(H264_PPS);
+	
+	memcpy(video + video_size, START_CODE, sizeof(START_CODE));
+	video_size += sizeof(START_CODE);
+	video[video_size++] = 0x65;
+	
+	while (video_size < sizeof(video)) {
+		video[video_size] = (unsigned char) (0x80 | video_size);
+		video_size++;
+	}
+	
+	offset += ts_packetize(data + offset, TS_PID_VIDEO, video, video_size);
+	
+	/* One ADTS frame: AAC LC, 44.1 kHz, stereo */
+	unsigned char audio[14 + 7 + 100];
+	const size_t frame_size = sizeof(audio) - 14;
+	
+	pes_header(audio, 0xC0, frame_size);
+	
+	unsigned char* const frame = audio + 14;
+	
+	frame[0] = 0xFF;
+	frame[1] = 0xF1;
+	frame[2] = (1 << 6) | (4 << 2);
+	frame[3] = (unsigned char) ((2 << 6) | (frame_size >> 11));
+	frame[4] = (unsigned char) (frame_size >> 3);
+	frame[5] = (unsigned char) (((frame_size & 0x07) << 5) | 0x1F);
+	frame[6] = 0xFC;
+	
+	memset(frame + 7, 0x21, frame_size - 7);
+	
+	offset += ts_packetize(data + offset, TS_PID_AUDIO, audio, sizeof(audio));
+	
+	/* Null packets: PID 0x1FFF, payload only */
+	for (; offset < size; offset += TS_PACKET_SIZE) {
+		unsigned char* const packet = data + offset;
+		
+		memset(packet, 0xFF, TS_PACKET_SIZE);
+		
+		packet[0] = 0x47;
+		packet[1] = TS_PID_NULL >> 8;
+		packet[2] = TS_PID_NULL & 0xFF;
+		packet[3] = 0x10;
+	}
+	
+}
+
+static int load_segment(void) {
+	
+	if (options.segment_filename != NULL) {
+		FILE* const stream = fopen(options.segment_filename, "rb");
+		
+		if (stream == NULL) {
+			return 0;
+		}
+		
+		fseek(stream, 0, SEEK_END);
+		const long size = ftell(stream);
+		fseek(stream, 0, SEEK_SET);
+		
+		/* Room for the PKCS#7 padding */
+		segment.size = size <= 0 ? 0 : (size_t) size;
+		segment.data = segment.size == 0 ? NULL : malloc(segment.size + MOCK_BLOCK_SIZE);
+		
+		const int ok = segment.data != NULL && fread(segment.data, 1, segment.size, stream) == segment.size;
+		fclose(stream);
+		
+		if (!ok) {
+			return 0;
+		}
+	} else {
+		segment.size = options.segment_size - options.segment_size % TS_PACKET_SIZE;
+		
+		if (segment.size < TS_PACKET_SIZE * TS_GENERATED_PACKETS) {
+			segment.size = TS_PACKET_SIZE * TS_GENERATED_PACKETS;
+		}
+		
+		segment.data = malloc(segment.size + MOCK_BLOCK_SIZE);
+		
+		if (segment.data == NULL) {
+			return 0;
+		}
+		
+		segment_generate(segment.data, segment.size);
+	}
+	
+	if (options.encrypt) {
+		const size_t padding = MOCK_BLOCK_SIZE - segment.size % MOCK_BLOCK_SIZE;
+		
+		memset(segment.data + segment.size, (int) padding, padding);
+		segment.size += padding;
+		
+		br_aes_ct_cbcenc_keys context;
+		br_aes_ct_cbcenc_init(&context, KEY, sizeof(KEY));
+		
+		unsigned char iv[MOCK_BLOCK_SIZE];
+		memcpy(iv, IV, sizeof(iv));
+		
+		br_aes_ct_cbcenc_run(&context, iv, segment.data, segment.size);
+	}
+	
+	return 1;
+	
+}
+
+static int load_attachment(void) {
+	
+	attachment.size = options.attachment_size;
+	attachment.data = malloc(attachment.size == 0 ? 1 : attachment.size);
+	
+	if (attachment.data == NULL) {
+		return 0;
+	}
+	
+	uint32_t state = 0x9E3779B9;
+	
+	for (size_t index = 0; index < attachment.size; index++) {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		
+		attachment.data[index] = (unsigned char) state;
+	}
+	
+	return 1;
+	
+}
+
+static int send_all(const int fd, const void* const data, const size_t size) {
+	
+	const unsigned char* ptr = data;
+	size_t remaining = size;
+	
+	while (remaining > 0) {
+		const ssize_t count = send(fd, ptr, remaining, MSG_NOSIGNAL);
+		
+		if (count < 0 && errno == EINTR) {
+			continue;
+		}
+		
+		if (count <= 0) {
+			return 0;
+		}
+		
+		ptr += count;
+		remaining -= (size_t) count;
+	}
+	
+	return 1;
+	
+}
+
+static int respond_header(
+	const int fd,
+	const int status,
+	const char* const content_type,
+	const size_t size
+) {
+	
+	if (options.latency > 0) {
+		usleep(options.latency * 1000);
+	}
+	
+	const char* const reason = status == 200 ? "OK" : status == 404 ? "Not Found" : "Bad Request";
+	
+	char header[256];
+	const int header_size = snprintf(
+		header,
+		sizeof(header),
+		"HTTP/1.1 %i %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n\r\n",
+		status,
+		reason,
+		content_type,
+		size
+	);
+	
+	return send_all(fd, header, (size_t) header_size);
+	
+}
+
+static int respond(
+	const int fd,
+	const int status,
+	const char* const content_type,
+	const void* const body,
+	const size_t size
+) {
+	return respond_header(fd, status, content_type, size) && send_all(fd, body, size);
+}
+
+static int respond_json(const int fd, json_t* const tree) {
+	
+	if (tree == NULL) {
+		return 0;
+	}
+	
+	char* const body = json_dumps(tree, JSON_COMPACT);
+	json_decref(tree);
+	
+	if (body == NULL) {
+		return 0;
+	}
+	
+	const int ok = respond(fd, 200, "application/json", body, strlen(body));
+	free(body);
+	
+	return ok;
+	
+}
+
+static int respond_text(const int fd, const char* const content_type, const char* const body) {
+	return respond(fd, 200, content_type, body, strlen(body));
+}
+
+static int respond_not_found(const int fd) {
+	return respond(fd, 404, "text/plain", "", 0);
+}
+
+static size_t get_product(const struct Request* const request) {
+	/*
+	Products are told apart by the Club header, which carries their subdomain.
+	*/
+	
+	const size_t size = strlen(SUBDOMAIN_PREFIX);
+	
+	if (strncmp(request->club, SUBDOMAIN_PREFIX, size) != 0) {
+		return 1;
+	}
+	
+	return (size_t) strtoull(request->club + size, NULL, 10);
+	
+}
+
+static int serve_check_token(const int fd) {
+	
+	json_t* const resources = json_array();
+	
+	for (size_t index = 1; index <= options.products; index++) {
+		char subdomain[64];
+		snprintf(subdomain, sizeof(subdomain), "%s%zu", SUBDOMAIN_PREFIX, index);
+		
+		json_array_append_new(resources, json_pack("{s:{s:s}}", "resource", "subdomain", subdomain));
+	}
+	
+	return respond_json(fd, json_pack("{s:o}", "resources", resources));
+	
+}
+
+static int serve_membership(const int fd, const struct Request* const request) {
+	
+	char name[64];
+	snprintf(name, sizeof(name), "Produto %zu", get_product(request));
+	
+	return respond_json(fd, json_pack("{s:s}", "name", name));
+	
+}
+
+static int serve_navigation(const int fd, const struct Request* const request) {
+	
+	const size_t product = get_product(request);
+	json_t* const modules = json_array();
+	
+	for (size_t module = 1; module <= options.modules; module++) {
+		json_t* const pages = json_array();
+		
+		for (size_t page = 1; page <= options.pages; page++) {
+			char hash[64];
+			snprintf(hash, sizeof(hash), "%zu-%zu-%zu", product, module, page);
+			
+			char name[64];
+			snprintf(name, sizeof(name), "Aula %zu.%zu", module, page);
+			
+			json_array_append_new(pages, json_pack("{s:s, s:s}", "hash", hash, "name", name));
+		}
+		
+		char id[64];
+		snprintf(id, sizeof(id), "%zu-%zu", product, module);
+		
+		char name[64];
+		snprintf(name, sizeof(name), "Módulo %zu", module);
+		
+		json_array_append_new(modules, json_pack("{s:s, s:s, s:b, s:o}", "id", id, "name", name, "locked", 0, "pages", pages));
+	}
+	
+	return respond_json(fd, json_pack("{s:o}", "modules", modules));
+	
+}
+
+static int serve_page(const int fd, const struct Request* const request, const char* const hash) {
+	
+	char url[512];
+	snprintf(url, sizeof(url), "http://%s/player/%s", request->host, hash);
+	
+	json_t* const attachments = json_array();
+	
+	for (size_t index = 1; index <= options.attachments; index++) {
+		char id[128];
+		snprintf(id, sizeof(id), "%s-%zu", hash, index);
+		
+		char filename[160];
+		snprintf(filename, sizeof(filename), "Material %s.pdf", id);
+		
+		json_array_append_new(attachments, json_pack("{s:s, s:s}", "fileName", filename, "fileMembershipId", id));
+	}
+	
+	return respond_json(fd, json_pack(
+		"{s:[{s:s}], s:o}",
+		"mediasSrc",
+			"mediaSrcUrl", url,
+		"attachments", attachments
+	));
+	
+}
+
+static int serve_attachment_link(const int fd, const struct Request* const request, const char* const id) {
+	
+	char url[512];
+	snprintf(url, sizeof(url), "http://%s/files/%s", request->host, id);
+	
+	return respond_json(fd, json_pack("{s:s}", "directDownloadUrl", url));
+	
+}
+
+static int serve_player(const int fd, const struct Request* const request, const char* const hash) {
+	
+	char body[1024];
+	snprintf(
+		body,
+		sizeof(body),
+		"<html><body><script>window.playerData = {\"mediaAssets\":[{\"url\":\"http://%s/hls/%s/master.m3u8\"}]};</script></body></html>",
+		request->host,
+		hash
+	);
+	
+	return respond_text(fd, "text/html", body);
+	
+}
+
+static int serve_master_playlist(const int fd) {
+	
+	return respond_text(
+		fd,
+		"application/vnd.apple.mpegurl",
+		"#EXTM3U\n"
+		"#EXT-X-STREAM-INF:BANDWIDTH=800000,RESOLUTION=640x360\n"
+		"media.m3u8\n"
+		"#EXT-X-STREAM-INF:BANDWIDTH=2500000,RESOLUTION=1280x720\n"
+		"media.m3u8\n"
+	);
+	
+}
+
+static int serve_media_playlist(const int fd) {
+	
+	const size_t size = 512 + options.segments * 64;
+	char* const body = malloc(size);
+	
+	if (body == NULL) {
+		return 0;
+	}
+	
+	size_t offset = (size_t) snprintf(
+		body,
+		size,
+		"#EXTM3U\n#EXT-X-VERSION:3\n#EXT-X-TARGETDURATION:%u\n#EXT-X-MEDIA-SEQUENCE:0\n",
+		(unsigned int) (options.segment_duration + 0.5)
+	);
+	
+	if (options.encrypt) {
+		offset += (size_t) snprintf(body + offset, size - offset, "#EXT-X-KEY:METHOD=AES-128,URI=\"key.bin\",IV=0x");
+		
+		for (size_t index = 0; index < sizeof(IV); index++) {
+			offset += (size_t) snprintf(body + offset, size - offset, "%02X", IV[index]);
+		}
+		
+		offset += (size_t) snprintf(body + offset, size - offset, "\n");
+	}
+	
+	for (size_t index = 0; index < options.segments; index++) {
+		offset += (size_t) snprintf(body + offset, size - offset, "#EXTINF:%.3f,\n%zu.ts\n", options.segment_duration, index);
+	}
+	
+	offset += (size_t) snprintf(body + offset, size - offset, "#EXT-X-ENDLIST\n");
+	
+	const int ok = respond(fd, 200, "application/vnd.apple.mpegurl", body, offset);
+	free(body);
+	
+	return ok;
+	
+}
+
+static int serve_hls(const int fd, const char* const path) {
+	/*
+	Serves /hls/<hash>/<file>; every lecture shares the same playlists, key and segments.
+	*/
+	
+	const char* const file = strrchr(path, '/');
+	
+	if (file == NULL) {
+		return respond_not_found(fd);
+	}
+	
+	if (strcmp(file, "/master.m3u8") == 0) {
+		return serve_master_playlist(fd);
+	}
+	
+	if (strcmp(file, "/media.m3u8") == 0) {
+		return serve_media_playlist(fd);
+	}
+	
+	if (strcmp(file, "/key.bin") == 0 && options.encrypt) {
+		return respond(fd, 200, "application/octet-stream", KEY, sizeof(KEY));
+	}
+	
+	const size_t size = strlen(file);
+	
+	if (size > 4 && strcmp(file + size - 3, ".ts") == 0) {
+		return respond(fd, 200, "video/mp2t", segment.data, segment.size);
+	}
+	
+	return respond_not_found(fd);
+	
+}
+
+static int route(const int fd, const struct Request* const request) {
+	
+	char path[sizeof(request->path)];
+	strcpy(path, request->path);
+	
+	char* const query = strchr(path, '?');
+	
+	if (query != NULL) {
+		*query = '\0';
+	}
+	
+	const size_t club_size = strlen(HOTMART_API_CLUB_PATH);
+	
+	if (strcmp(request->method, "POST") == 0 && strcmp(path, "/oauth/token") == 0) {
+		return respond_json(fd, json_pack(
+			"{s:s, s:s, s:i}",
+			"access_token", "mock-access-token",
+			"refresh_token", "mock-refresh-token",
+			"expires_in", 86400
+		));
+	}
+	
+	if (strcmp(request->method, "GET") != 0 && strcmp(request->method, "HEAD") != 0) {
+		return respond(fd, 400, "text/plain", "", 0);
+	}
+	
+	if (strcmp(path, "/security/oauth/check_token") == 0) {
+		return serve_check_token(fd);
+	}
+	
+	if (strncmp(path, HOTMART_API_CLUB_PATH, club_size) == 0) {
+		const char* const endpoint = path + club_size;
+		
+		if (strcmp(endpoint, "/membership") == 0) {
+			return serve_membership(fd, request);
+		}
+		
+		if (strcmp(endpoint, "/navigation") == 0) {
+			return serve_navigation(fd, request);
+		}
+		
+		if (strncmp(endpoint, "/page/", 6) == 0) {
+			return serve_page(fd, request, endpoint + 6);
+		}
+		
+		if (strncmp(endpoint, "/attachment/", 12) == 0) {
+			char* const end = strstr(endpoint + 12, "/download");
+			
+			if (end != NULL) {
+				*end = '\0';
+				return serve_attachment_link(fd, request, endpoint + 12);
+			}
+		}
+		
+		return respond_not_found(fd);
+	}
+	
+	if (strncmp(path, "/player/", 8) == 0) {
+		return serve_player(fd, request, path + 8);
+	}
+	
+	if (strncmp(path, "/hls/", 5) == 0) {
+		return serve_hls(fd, path);
+	}
+	
+	if (strncmp(path, "/files/", 7) == 0) {
+		/* sparklec --plan sizes attachments without downloading them */
+		if (strcmp(request->method, "HEAD") == 0) {
+			return respond_header(fd, 200, "application/pdf", attachment.size);
+		}
+		
+		return respond(fd, 200, "application/pdf", attachment.data, attachment.size);
+	}
+	
+	return respond_not_found(fd);
+	
+}
+
+static void copy_header_value(char* const dst, const size_t size, const char* const value, const size_t length) {
+	
+	const size_t count = length < size - 1 ? length : size - 1;
+	
+	memcpy(dst, value, count);
+	dst[count] = '\0';
+	
+}
+
+static int parse_request(char* const data, struct Request* const request) {
+	
+	memset(request, 0, sizeof(*request));
+	
+	char* line = data;
+	char* end = strstr(line, "\r\n");
+	
+	if (end == NULL) {
+		return 0;
+	}
+	
+	*end = '\0';
+	
+	if (sscanf(line, "%7s %1023s", request->method, request->path) != 2) {
+		return 0;
+	}
+	
+	for (line = end + 2; (end = strstr(line, "\r\n")) != NULL && end != line; line = end + 2) {
+		*end = '\0';
+		
+		char* const colon = strchr(line, ':');
+		
+		if (colon == NULL) {
+			continue;
+		}
+		
+		const char* value = colon + 1;
+		
+		while (*value == ' ') {
+			value++;
+		}
+		
+		const size_t name_size = (size_t) (colon - line);
+		const size_t value_size = strlen(value);
+		
+		if (name_size == 4 && strncasecmp(line, "Host", 4) == 0) {
+			copy_header_value(request->host, sizeof(request->host), value, value_size);
+		} else if (name_size == 4 && strncasecmp(line, "Club", 4) == 0) {
+			copy_header_value(request->club, sizeof(request->club), value, value_size);
+		} else if (name_size == 14 && strncasecmp(line, "Content-Length", 14) == 0) {
+			request->content_length = (size_t) strtoull(value, NULL, 10);
+		} else if (name_size == 10 && strncasecmp(line, "Connection", 10) == 0) {
+			request->close = strcasecmp(value, "close") == 0;
+		}
+	}
+	
+	return 1;
+	
+}
+
+static void* serve_connection(void* ptr) {
+	
+	const int fd = (int) (intptr_t) ptr;
+	
+	char* const buffer = malloc(MOCK_REQUEST_MAX_SIZE + 1);
+	size_t offset = 0;
+	
+	while (buffer != NULL) {
+		buffer[offset] = '\0';
+		char* const headers_end = strstr(buffer, "\r\n\r\n");
+		
+		if (headers_end == NULL) {
+			if (offset == MOCK_REQUEST_MAX_SIZE) {
+				break;
+			}
+			
+			const ssize_t count = recv(fd, buffer + offset, MOCK_REQUEST_MAX_SIZE - offset, 0);
+			
+			if (count < 0 && errno == EINTR) {
+				continue;
+			}
+			
+			if (count <= 0) {
+				break;
+			}
+			
+			offset += (size_t) count;
+			continue;
+		}
+		
+		const size_t headers_size = (size_t) (headers_end - buffer) + 4;
+		struct Request request;
+		
+		if (!parse_request(buffer, &request) || request.content_length > MOCK_REQUEST_MAX_SIZE - headers_size) {
+			break;
+		}
+		
+		/* Request bodies (the token request) are read and ignored */
+		while (offset < headers_size + request.content_length) {
+			const ssize_t count = recv(fd, buffer + offset, MOCK_REQUEST_MAX_SIZE - offset, 0);
+			
+			if (count <= 0) {
+				break;
+			}
+			
+			offset += (size_t) count;
+		}
+		
+		const size_t request_size = headers_size + request.content_length;
+		
+		if (offset < request_size || !route(fd, &request) || request.close) {
+			break;
+		}
+		
+		memmove(buffer, buffer + request_size, offset - request_size);
+		offset -= request_size;
+	}
+	
+	free(buffer);
+	close(fd);
+	
+	return NULL;
+	
+}
+
+int main(int argc, char* argv[]) {
+	
+	if (!options_parse(argc, argv)) {
+		options_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	
+	if (!load_segment() || !load_attachment()) {
+		fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
+		return EXIT_FAILURE;
+	}
+	
+	signal(SIGPIPE, SIG_IGN);
+	
+	const int server = socket(AF_INET, SOCK_STREAM, 0);
+	
+	if (server == -1) {
+		perror("socket");
+		return EXIT_FAILURE;
+	}
+	
+	const int enable = 1;
+	setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+	
+	struct sockaddr_in address = {
+		.sin_family = AF_INET,
+		.sin_port = htons(options.port),
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+	};
+	
+	if (bind(server, (struct sockaddr*) &address, sizeof(address)) == -1 || listen(server, 128) == -1) {
+		perror("bind");
+		close(server);
+		return EXIT_FAILURE;
+	}
+	
+	printf(
+		"+ Servindo %zu produto(s), %zu aula(s) de %zu segmento(s) de %zu bytes em http://127.0.0.1:%u\r\n",
+		options.products,
+		options.products * options.modules * options.pages,
+		options.segments,
+		segment.size,
+		(unsigned int) options.port
+	);
+	fflush(stdout);
+	
+	while (1) {
+		const int fd = accept(server, NULL, NULL);
+		
+		if (fd == -1) {
+			if (errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			}
+			
+			perror("accept");
+			break;
+		}
+		
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+		
+		pthread_t thread;
+		
+		if (pthread_create(&thread, NULL, serve_connection, (void*) (intptr_t) fd) != 0) {
+			close(fd);
+			continue;
+		}
+		
+		pthread_detach(thread);
+	}
+	
+	close(server);
+	
+	return EXIT_FAILURE;
+	
+}
@@ -0,0 +1,169 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <jansson.h>
+
+#include "cache.h"
+#include "errors.h"
+#include "utils.h"
+#include "memory.h"
+
+static const char TEMPORARY_FILE_EXTENSION[] = ".tmp";
+
+int resources_cache_load(
+	const char* const filename,
+	const char* const username,
+	struct Resources* const resources
+) {
+	/*
+	Loads the resource list cached for this user. Fails if there is none or if the
+	token it was validated with has already expired.
+	*/
+	
+	if (!file_exists(filename)) {
+		return UERR_JSON_CANNOT_PARSE;
+	}
+	
+	json_auto_t* tree = json_load_file(filename, 0, NULL);
+	
+	if (tree == NULL || !json_is_object(tree)) {
+		return UERR_JSON_CANNOT_PARSE;
+	}
+	
+	const json_t* const entry = json_object_get(tree, username);
+	
+	if (entry == NULL) {
+		return UERR_JSON_MISSING_REQUIRED_KEY;
+	}
+	
+	const json_t* obj = json_object_get(entry, "expires_at");
+	
+	if (obj == NULL || !json_is_integer(obj)) {
+		return UERR_JSON_NON_MATCHING_TYPE;
+	}
+	
+	if ((time_t) json_integer_value(obj) <= time(NULL)) {
+		return UERR_JSON_MISSING_REQUIRED_KEY;
+	}
+	
+	obj = json_object_get(entry, "resources");
+	
+	if (obj == NULL || !json_is_array(obj)) {
+		return UERR_JSON_NON_MATCHING_TYPE;
+	}
+	
+	const size_t array_size = json_array_size(obj);
+	
+	resources->offset = 0;
+	resources->size = sizeof(struct Resource) * array_size;
+	resources->items = memory_alloc(MEMORY_CATALOG, resources->size);
+	
+	if (resources->items == NULL) {
+		return UERR_MEMORY_ALLOCATE_FAILURE;
+	}
+	
+	size_t index = 0;
+	json_t* item = NULL;
+	
+	json_array_foreach(obj, index, item) {
+		const json_t* const name = json_object_get(item, "name");
+		const json_t* const subdomain = json_object_get(item, "subdomain");
+		
+		if (name == NULL || !json_is_string(name) || subdomain == NULL || !json_is_string(subdomain)) {
+			return UERR_JSON_NON_MATCHING_TYPE;
+		}
+		
+		struct Resource resource = {
+			.name = memory_strdup(MEMORY_CATALOG, json_string_value(name)),
+			.subdomain = memory_strdup(MEMORY_CATALOG, json_string_value(subdomain))
+		};
+		
+		if (resource.name == NULL || resource.subdomain == NULL) {
+			return UERR_MEMORY_ALLOCATE_FAILURE;
+		}
+		
+		resources->items[resources->offset++] = resource;
+	}
+	
+	return UERR_SUCCESS;
+	
+}
+
+int resources_cache_save(
+	const char* const filename,
+	const char* const username,
+	const time_t expires_at,
+	const struct Resources* const resources
+) {
+	/*
+	Stores the resource list of this user, keeping the entries of any other users.
+	The file is replaced atomically, so a concurrent reader never sees it half written.
+	*/
+	
+	json_auto_t* tree = NULL;
+	
+	if (file_exists(filename)) {
+		tree = json_load_file(filename, 0, NULL);
+	}
+	
+	if (tree == NULL || !json_is_object(tree)) {
+		json_decref(tree);
+		tree = json_object();
+		
+		if (tree == NULL) {
+			return UERR_MEMORY_ALLOCATE_FAILURE;
+		}
+	}
+	
+	json_t* const items = json_array();
+	
+	if (items == NULL) {
+		return UERR_MEMORY_ALLOCATE_FAILURE;
+	}
+	
+	for (size_t index = 0; index < resources->offset; index++) {
+		const struct Resource* const resource = &resources->items[index];
+		
+		json_t* const item = json_object();
+		
+		if (item == NULL) {
+			json_decref(items);
+			return UERR_MEMORY_ALLOCATE_FAILURE;
+		}
+		
+		json_object_set_new(item, "name", json_string(resource->name));
+		json_object_set_new(item, "subdomain", json_string(resource->subdomain));
+		
+		json_array_append_new(items, item);
+	}
+	
+	json_t* const entry = json_object();
+	
+	if (entry == NULL) {
+		json_decref(items);
+		return UERR_MEMORY_ALLOCATE_FAILURE;
+	}
+	
+	json_object_set_new(entry, "expires_at", json_integer(expires_at));
+	json_object_set_new(entry, "resources", items);
+	json_object_set_new(tree, username, entry);
+	
+	char temporary_file[strlen(filename) + strlen(TEMPORARY_FILE_EXTENSION) + 1];
+	strcpy(temporary_file, filename);
+	strcat(temporary_file, TEMPORARY_FILE_EXTENSION);
+	
+	if (json_dump_file(tree, temporary_file, JSON_COMPACT) != 0) {
+		remove_file(temporary_file);
+		return UERR_JSON_CANNOT_PARSE;
+	}
+	
+	if (!move_file(temporary_file, filename)) {
+		remove_file(temporary_file);
+		return UERR_JSON_CANNOT_PARSE;
+	}
+	
+	return UERR_SUCCESS;
+	
+}
@@ -0,0 +1,18 @@
+#include <time.h>
+
+#include "types.h"
+
+int resources_cache_load(
+	const char* const filename,
+	const char* const username,
+	struct Resources* const resources
+);
+
+int resources_cache_save(
+	const char* const filename,
+	const char* const username,
+	const time_t expires_at,
+	const struct Resources* const resources
+);
+
+#pragma once
@@ -1,18 +1,55 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <strings.h>
 
 #include "types.h"
+#include "callbacks.h"
+#include "utils.h"
+#include "memory.h"
 
-size_t curl_write_cb(char *chunk, size_t size, size_t nmemb, struct String* string) {
+#define STRING_MIN_CAPACITY 256
+#define STRING_MAX_PRESIZE (1024 * 1024 * 64)
+
+static const char HTTP_HEADER_CONTENT_LENGTH[] = "Content-Length:";
+static const char HTTP_STATUS_LINE_PREFIX[] = "HTTP/";
+
+static int parse_content_length(const char* const buffer, const size_t header_size, unsigned long long* const value) {
+	
+	const size_t name_size = strlen(HTTP_HEADER_CONTENT_LENGTH);
+	
+	if (header_size <= name_size || strncasecmp(buffer, HTTP_HEADER_CONTENT_LENGTH, name_size) != 0) {
+		return 0;
+	}
+	
+	char header_value[header_size - name_size + 1];
+	memcpy(header_value, buffer + name_size, header_size - name_size);
+	header_value[sizeof(header_value) - 1] = '\0';
+	
+	char* end = NULL;
+	*value = strtoull(header_value, &end, 10);
+	
+	return end != header_value;
+	
+}
+
+size_t curl_write_cb(char *chunk, size_t size, size_t nmemb, void* ptr) {
+	
+	struct String* const string = (struct String*) ptr;
 	
 	const size_t chunk_size = size * nmemb;
 	const size_t slength = string->slength + chunk_size;
 	
-	string->s = realloc(string->s, slength + 1);
-	
-	if (string->s == NULL) {
-		return 0;
+	if (slength + 1 > string->size) {
+		size_t capacity = string->size < STRING_MIN_CAPACITY ? STRING_MIN_CAPACITY : string->size;
+		
+		while (capacity < slength + 1) {
+			capacity *= 2;
+		}
+		
+		if (!string_reserve(string, capacity)) {
+			return 0;
+		}
 	}
 	
 	memcpy(string->s + string->slength, chunk, chunk_size);
@@ -24,6 +61,115 @@ size_t curl_write_cb(char *chunk, size_t size, size_t nmemb, struct String* stri
 	
 }
 
+size_t curl_header_cb(char *buffer, size_t size, size_t nitems, void* ptr) {
+	/*
+	Presizes the response buffer from the Content-Length header, if the server sent one.
+	*/
+	
+	struct String* const string = (struct String*) ptr;
+	
+	const size_t header_size = size * nitems;
+	unsigned long long content_length = 0;
+	
+	if (!parse_content_length(buffer, header_size, &content_length) || content_length == 0 || content_length > STRING_MAX_PRESIZE) {
+		return header_size;
+	}
+	
+	if (!string_reserve(string, string->slength + (size_t) content_length + 1)) {
+		return 0;
+	}
+	
+	return header_size;
+	
+}
+
 size_t curl_write_file_cb(char *chunk, size_t size, size_t nmemb, void* ptr) {
 	return fwrite(chunk, size, nmemb, (FILE*) ptr);
-}
\ No newline at end of file
+}
+
+size_t curl_write_download_cb(char *chunk, size_t size, size_t nmemb, void* ptr) {
+	/*
+	Writes to the file while keeping a running digest and byte count of what was written.
+	*/
+	
+	struct FileDownload* const download = (struct FileDownload*) ptr;
+	
+	const size_t count = fwrite(chunk, size, nmemb, download->stream);
+	
+	br_sha256_update(&download->context, chunk, count * size);
+	download->size += count * size;
+	
+	return count;
+	
+}
+
+size_t curl_header_download_cb(char *buffer, size_t size, size_t nitems, void* ptr) {
+	/*
+	Tracks the status and Content-Length of each response. Once the headers of a successful
+	one are complete, space for the whole file is reserved up front.
+	*/
+	
+	struct FileDownload* const download = (struct FileDownload*) ptr;
+	
+	const size_t header_size = size * nitems;
+	unsigned long long content_length = 0;
+	
+	if (header_size > strlen(HTTP_STATUS_LINE_PREFIX) && strncmp(buffer, HTTP_STATUS_LINE_PREFIX, strlen(HTTP_STATUS_LINE_PREFIX)) == 0) {
+		const char* const space = memchr(buffer, ' ', header_size);
+		
+		download->status = space == NULL ? 0 : strtol(space + 1, NULL, 10);
+		download->content_length = -1;
+	} else if (parse_content_length(buffer, header_size, &content_length)) {
+		download->content_length = (int64_t) content_length;
+	} else if (strspn(buffer, "\r\n") == header_size) {
+		if (download->status >= 200 && download->status < 300 && download->content_length > 0) {
+			preallocate_file(download->stream, (uint64_t) download->content_length);
+		}
+	}
+	
+	return header_size;
+	
+}
+
+int file_download_init(struct FileDownload* const obj, FILE* const stream) {
+	/*
+	Prepares a download into "stream". Writes are buffered so that they reach the file in large
+	chunks, at offsets that are multiples of the buffer size.
+	*/
+	
+	memset(obj, 0, sizeof(*obj));
+	
+	obj->stream = stream;
+	obj->content_length = -1;
+	obj->buffer = memory_alloc(MEMORY_HTTP, FILE_WRITE_BUFFER_SIZE);
+	
+	if (obj->buffer == NULL || setvbuf(stream, obj->buffer, _IOFBF, FILE_WRITE_BUFFER_SIZE) != 0) {
+		fclose(stream);
+		memory_free(obj->buffer);
+		
+		return 0;
+	}
+	
+	br_sha256_init(&obj->context);
+	
+	return 1;
+	
+}
+
+int file_download_finish(struct FileDownload* const obj) {
+	/*
+	Closes the file. Fails if anything could not be written or if fewer or more bytes arrived
+	than the server announced.
+	*/
+	
+	int ok = fclose(obj->stream) == 0;
+	
+	memory_free(obj->buffer);
+	
+	if (obj->content_length >= 0 && obj->size != (uint64_t) obj->content_length) {
+		ok = 0;
+	}
+	
+	return ok;
+	
+}
@@ -1,2 +1,27 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#include <bearssl.h>
+
+/* Size of the stdio buffer files are downloaded through */
+#define FILE_WRITE_BUFFER_SIZE (1024 * 1024 * 4)
+
+struct FileDownload {
+	FILE* stream;
+	char* buffer;
+	br_sha256_context context;
+	uint64_t size;
+	int64_t content_length;
+	long status;
+};
+
 size_t curl_write_cb(char *chunk, size_t size, size_t nmemb, void* string);
-size_t curl_write_file_cb(char *chunk, size_t size, size_t nmemb, void* ptr);
\ No newline at end of file
+size_t curl_header_cb(char *buffer, size_t size, size_t nitems, void* string);
+size_t curl_write_file_cb(char *chunk, size_t size, size_t nmemb, void* ptr);
+size_t curl_write_download_cb(char *chunk, size_t size, size_t nmemb, void* ptr);
+size_t curl_header_download_cb(char *buffer, size_t size, size_t nitems, void* ptr);
+
+int file_download_init(struct FileDownload* const obj, FILE* const stream);
+int file_download_finish(struct FileDownload* const obj);
+
+#pragma once
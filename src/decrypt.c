@@ -0,0 +1,102 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <bearssl.h>
+
+#include "decrypt.h"
+#include "errors.h"
+#include "utils.h"
+
+static const br_block_cbcdec_class* get_cbcdec_vtable(void) {
+	/*
+	Picks the fastest AES implementation the CPU supports at runtime. The constant-time
+	software implementation is used when there is no hardware support.
+	*/
+	
+	const br_block_cbcdec_class* vtable = br_aes_x86ni_cbcdec_get_vtable();
+	
+	if (vtable == NULL) {
+		vtable = br_aes_pwr8_cbcdec_get_vtable();
+	}
+	
+	if (vtable == NULL) {
+		vtable = &br_aes_ct64_cbcdec_vtable;
+	}
+	
+	return vtable;
+	
+}
+
+int decrypt_iv_parse(const char* const s, unsigned char* const iv) {
+	/*
+	Parses the hexadecimal IV attribute of an EXT-X-KEY tag (e.g. "0x0000000000000000000000000000002A").
+	*/
+	
+	const char* start = s;
+	
+	if (start[0] == '0' && (start[1] == 'x' || start[1] == 'X')) {
+		start += 2;
+	}
+	
+	const size_t size = strlen(start);
+	
+	if (size == 0 || size > AES_BLOCK_SIZE * 2) {
+		return 0;
+	}
+	
+	memset(iv, 0, AES_BLOCK_SIZE);
+	
+	/* Shorter values are right-aligned, as they represent a 128-bit integer */
+	for (size_t index = 0; index < size; index++) {
+		const char ch = start[size - 1 - index];
+		
+		if (!((ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'f') || (ch >= 'A' && ch <= 'F'))) {
+			return 0;
+		}
+		
+		const unsigned char value = (unsigned char) from_hex(ch);
+		unsigned char* const byte = &iv[AES_BLOCK_SIZE - 1 - (index / 2)];
+		
+		*byte |= (index % 2 == 0) ? value : (unsigned char) (value << 4);
+	}
+	
+	return 1;
+	
+}
+
+int decrypt_segment(const unsigned char* const key, const unsigned char* const iv, unsigned char* const data, size_t* const size) {
+	/*
+	Decrypts an AES-128-CBC encrypted segment in place and strips its PKCS#7 padding.
+	*/
+	
+	if (*size == 0 || *size % AES_BLOCK_SIZE != 0) {
+		return UERR_AES_INVALID_LENGTH;
+	}
+	
+	const br_block_cbcdec_class* const vtable = get_cbcdec_vtable();
+	
+	br_aes_gen_cbcdec_keys context;
+	vtable->init(&context.vtable, key, AES_BLOCK_SIZE);
+	
+	unsigned char chain[AES_BLOCK_SIZE];
+	memcpy(chain, iv, sizeof(chain));
+	
+	vtable->run(&context.vtable, chain, data, *size);
+	
+	const size_t padding = data[*size - 1];
+	
+	if (padding == 0 || padding > AES_BLOCK_SIZE) {
+		return UERR_AES_INVALID_PADDING;
+	}
+	
+	for (size_t index = 1; index <= padding; index++) {
+		if (data[*size - index] != padding) {
+			return UERR_AES_INVALID_PADDING;
+		}
+	}
+	
+	*size -= padding;
+	
+	return UERR_SUCCESS;
+	
+}
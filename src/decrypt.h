@@ -0,0 +1,8 @@
+#include <stdlib.h>
+
+#define AES_BLOCK_SIZE 16
+
+int decrypt_iv_parse(const char* const s, unsigned char* const iv);
+int decrypt_segment(const unsigned char* const key, const unsigned char* const iv, unsigned char* const data, size_t* const size);
+
+#pragma once
@@ -10,4 +10,15 @@
 
 #define UERR_JSON_CANNOT_PARSE -6 /* Cannot parse JSON tree */
 #define UERR_JSON_MISSING_REQUIRED_KEY -7 /* Missing required key in JSON tree */
-#define UERR_JSON_NON_MATCHING_TYPE -8 /* JSON object does not match the required type */
\ No newline at end of file
+#define UERR_JSON_NON_MATCHING_TYPE -8 /* JSON object does not match the required type */
+
+#define UERR_REMUX_UNSUPPORTED_STREAM -9 /* Transport stream carries a codec the remuxer cannot handle */
+#define UERR_REMUX_INVALID_STREAM -10 /* Transport stream is malformed */
+#define UERR_FILE_WRITE_FAILURE -11 /* Cannot write contents to file */
+#define UERR_FILE_READ_FAILURE -12 /* Cannot read contents of file */
+#define UERR_AES_INVALID_LENGTH -13 /* Encrypted data is not a multiple of the block size */
+#define UERR_AES_INVALID_PADDING -14 /* Decrypted data has malformed padding */
+#define UERR_AES_UNSUPPORTED_METHOD -15 /* Encryption method is not supported */
+#define UERR_OPTIONS_UNKNOWN -16 /* Unrecognized command-line option */
+#define UERR_OPTIONS_INVALID_VALUE -17 /* Command-line option has an invalid or missing value */
+#define UERR_SOCKET_FAILURE -18 /* Cannot create, bind or listen on a socket */
\ No newline at end of file
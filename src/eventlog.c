@@ -0,0 +1,323 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#ifdef _WIN32
+	#include <windows.h>
+#endif
+
+#include <curl/curl.h>
+#include <jansson.h>
+
+#include "eventlog.h"
+#include "errors.h"
+#include "utils.h"
+
+/* Wake the writer up once this many bytes are waiting, or every second otherwise */
+#define EVENTLOG_FLUSH_SIZE (64 * 1024)
+
+/* Past this many bytes waiting to be written, new events are dropped instead of queued */
+#define EVENTLOG_MAX_PENDING (8 * 1024 * 1024)
+
+struct EventBuffer {
+	char* data;
+	size_t size;
+	size_t capacity;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static pthread_t thread;
+
+static int enabled = 0;
+static int running = 0;
+static FILE* stream = NULL;
+
+/*
+Emitters append to "pending" under the lock; the writer swaps it with an empty buffer and
+writes it out with the lock released, so a slow disk never holds up a transfer.
+*/
+static struct EventBuffer pending = {0};
+static uint64_t dropped = 0;
+
+static void buffer_free(struct EventBuffer* const buffer) {
+	
+	free(buffer->data);
+	memset(buffer, 0, sizeof(*buffer));
+	
+}
+
+static int buffer_append(struct EventBuffer* const buffer, const char* const data, const size_t size) {
+	
+	if (buffer->size + size > buffer->capacity) {
+		size_t capacity = buffer->capacity == 0 ? EVENTLOG_FLUSH_SIZE : buffer->capacity;
+		
+		while (capacity < buffer->size + size) {
+			capacity *= 2;
+		}
+		
+		char* const items = realloc(buffer->data, capacity);
+		
+		if (items == NULL) {
+			return 0;
+		}
+		
+		buffer->data = items;
+		buffer->capacity = capacity;
+	}
+	
+	memcpy(buffer->data + buffer->size, data, size);
+	buffer->size += size;
+	
+	return 1;
+	
+}
+
+static void write_dropped(const uint64_t count) {
+	
+	fprintf(stream, "{\"time\": %.3f, \"event\": \"events_dropped\", \"count\": %llu}\n", (double) time(NULL), (unsigned long long) count);
+	
+}
+
+static void* eventlog_writer(void* ptr) {
+	
+	(void) ptr;
+	
+	struct EventBuffer buffer = {0};
+	
+	pthread_mutex_lock(&lock);
+	
+	while (1) {
+		if (running && pending.size < EVENTLOG_FLUSH_SIZE) {
+			const struct timespec deadline = {
+				.tv_sec = time(NULL) + 1
+			};
+			
+			pthread_cond_timedwait(&cond, &lock, &deadline);
+		}
+		
+		const int stopping = !running;
+		
+		/* Hands the old buffer back, so that both keep the capacity they grew to */
+		const struct EventBuffer swap = pending;
+		pending = buffer;
+		pending.size = 0;
+		buffer = swap;
+		
+		const uint64_t lost = dropped;
+		dropped = 0;
+		
+		pthread_mutex_unlock(&lock);
+		
+		if (buffer.size > 0) {
+			fwrite(buffer.data, 1, buffer.size, stream);
+		}
+		
+		if (lost > 0) {
+			write_dropped(lost);
+		}
+		
+		fflush(stream);
+		
+		pthread_mutex_lock(&lock);
+		
+		if (stopping && pending.size == 0) {
+			break;
+		}
+	}
+	
+	pthread_mutex_unlock(&lock);
+	
+	buffer_free(&buffer);
+	
+	return NULL;
+	
+}
+
+int eventlog_open(const char* const filename) {
+	/*
+	Starts the writer thread; events are appended to "filename", which is created if needed.
+	*/
+	
+	stream = open_file(filename, "ab");
+	
+	if (stream == NULL) {
+		return UERR_FILE_WRITE_FAILURE;
+	}
+	
+	running = 1;
+	
+	if (pthread_create(&thread, NULL, eventlog_writer, NULL) != 0) {
+		running = 0;
+		
+		fclose(stream);
+		stream = NULL;
+		
+		return UERR_PTHREAD_FAILURE;
+	}
+	
+	__atomic_store_n(&enabled, 1, __ATOMIC_RELEASE);
+	
+	return UERR_SUCCESS;
+	
+}
+
+void eventlog_close(void) {
+	/*
+	Writes out every event still waiting and closes the log.
+	*/
+	
+	if (!__atomic_exchange_n(&enabled, 0, __ATOMIC_ACQ_REL)) {
+		return;
+	}
+	
+	pthread_mutex_lock(&lock);
+	running = 0;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&lock);
+	
+	pthread_join(thread, NULL);
+	
+	fclose(stream);
+	stream = NULL;
+	
+	buffer_free(&pending);
+	
+}
+
+uint64_t eventlog_now(void) {
+	/*
+	Returns a monotonic time in microseconds, for eventlog_elapsed().
+	*/
+	
+	#ifdef _WIN32
+		static LARGE_INTEGER frequency = {0};
+		LARGE_INTEGER counter = {0};
+		
+		if (frequency.QuadPart == 0) {
+			QueryPerformanceFrequency(&frequency);
+		}
+		
+		QueryPerformanceCounter(&counter);
+		
+		return (uint64_t) (counter.QuadPart / frequency.QuadPart) * 1000000 + (uint64_t) (counter.QuadPart % frequency.QuadPart) * 1000000 / (uint64_t) frequency.QuadPart;
+	#else
+		struct timespec ts = {0};
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		
+		return (uint64_t) ts.tv_sec * 1000000 + (uint64_t) ts.tv_nsec / 1000;
+	#endif
+	
+}
+
+double eventlog_elapsed(const uint64_t start) {
+	return (double) (eventlog_now() - start) / 1e6;
+}
+
+static void eventlog_push(const char* const event, json_t* const fields) {
+	/*
+	Takes ownership of "fields".
+	*/
+	
+	struct timespec ts = {0};
+	timespec_get(&ts, TIME_UTC);
+	
+	json_t* const tree = json_pack("{s:f, s:s}", "time", (double) ts.tv_sec + (double) (ts.tv_nsec / 1000000) / 1e3, "event", event);
+	char* line = NULL;
+	
+	if (tree != NULL && fields != NULL && json_object_update(tree, fields) == 0) {
+		line = json_dumps(tree, JSON_COMPACT | JSON_PRESERVE_ORDER);
+	}
+	
+	json_decref(fields);
+	json_decref(tree);
+	
+	pthread_mutex_lock(&lock);
+	
+	const size_t size = line == NULL ? 0 : strlen(line);
+	
+	if (!running) {
+		/* Emitted while the log was being closed */
+	} else if (line == NULL || pending.size + size + 1 > EVENTLOG_MAX_PENDING || !buffer_append(&pending, line, size) || !buffer_append(&pending, "\n", 1)) {
+		dropped++;
+	} else if (pending.size >= EVENTLOG_FLUSH_SIZE) {
+		pthread_cond_signal(&cond);
+	}
+	
+	pthread_mutex_unlock(&lock);
+	
+	free(line);
+	
+}
+
+void eventlog_emit(const char* const event, const char* const format, ...) {
+	/*
+	Queues an event; never waits on the disk. Safe to call from any thread.
+	*/
+	
+	if (!__atomic_load_n(&enabled, __ATOMIC_ACQUIRE)) {
+		return;
+	}
+	
+	va_list arguments;
+	va_start(arguments, format);
+	
+	json_t* const fields = json_vpack_ex(NULL, 0, format, arguments);
+	
+	va_end(arguments);
+	
+	eventlog_push(event, fields);
+	
+}
+
+void eventlog_transfer(const char* const event, CURL* const handle, const CURLcode code, const char* const format, ...) {
+	/*
+	Same as eventlog_emit(), adding the outcome of the transfer just completed on "handle":
+	its CURLcode, HTTP status, bytes received and total time.
+	*/
+	
+	if (!__atomic_load_n(&enabled, __ATOMIC_ACQUIRE)) {
+		return;
+	}
+	
+	va_list arguments;
+	va_start(arguments, format);
+	
+	json_t* fields = json_vpack_ex(NULL, 0, format, arguments);
+	
+	va_end(arguments);
+	
+	long status = 0;
+	curl_off_t size = 0;
+	curl_off_t total = 0;
+	
+	curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &status);
+	curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD_T, &size);
+	curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME_T, &total);
+	
+	json_t* const outcome = json_pack(
+		"{s:i, s:i, s:I, s:f}",
+		"curl_code", (int) code,
+		"http_status", (int) status,
+		"bytes", (json_int_t) size,
+		"duration", (double) total / 1e6
+	);
+	
+	if (outcome != NULL && code != CURLE_OK) {
+		json_object_set_new(outcome, "curl_error", json_string(curl_easy_strerror(code)));
+	}
+	
+	if (fields != NULL && (outcome == NULL || json_object_update(fields, outcome) != 0)) {
+		json_decref(fields);
+		fields = NULL;
+	}
+	
+	json_decref(outcome);
+	
+	eventlog_push(event, fields);
+	
+}
@@ -0,0 +1,17 @@
+#include <stdint.h>
+
+#include <curl/curl.h>
+
+/*
+Events are JSON objects written one per line, each with "time" (seconds since the epoch),
+"event" and the fields given by a json_pack() format. Nothing is evaluated beyond the
+arguments themselves while the log is closed.
+*/
+int eventlog_open(const char* const filename);
+void eventlog_close(void);
+uint64_t eventlog_now(void);
+double eventlog_elapsed(const uint64_t start);
+void eventlog_emit(const char* const event, const char* const format, ...);
+void eventlog_transfer(const char* const event, CURL* const handle, const CURLcode code, const char* const format, ...);
+
+#pragma once
@@ -0,0 +1,331 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#ifndef _WIN32
+	#include <unistd.h>
+	#include <sys/socket.h>
+	#include <sys/time.h>
+	#include <netinet/in.h>
+	#include <arpa/inet.h>
+#endif
+
+#include "exporter.h"
+#include "metrics.h"
+#include "errors.h"
+#include "utils.h"
+
+/* Rewrite the textfile this often, in seconds */
+#define EXPORTER_INTERVAL 5
+
+/* Give up on a scraper that takes longer than this, in seconds, to send its request */
+#define EXPORTER_REQUEST_TIMEOUT 5
+
+#define EXPORTER_MAX_REQUEST_SIZE 4096
+
+static const char CONTENT_TYPE[] = "text/plain; version=0.0.4; charset=utf-8";
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static int running = 0;
+
+static const char* textfile = NULL;
+static pthread_t textfile_thread;
+
+#ifndef _WIN32
+	static int listener = -1;
+	static pthread_t listener_thread;
+#endif
+
+static int write_textfile(const char* const filename) {
+	/*
+	The file is written next to its final name and then moved over it, so that the textfile
+	collector never reads one halfway through.
+	*/
+	
+	char temporary[strlen(filename) + 1 + strlen(PART_FILE_EXTENSION) + 1];
+	strcpy(temporary, filename);
+	strcat(temporary, ".");
+	strcat(temporary, PART_FILE_EXTENSION);
+	
+	FILE* const stream = open_file(temporary, "wb");
+	
+	if (stream == NULL) {
+		return UERR_FILE_WRITE_FAILURE;
+	}
+	
+	const int status = metrics_export(stream);
+	
+	if (fclose(stream) != 0 || status != UERR_SUCCESS || !move_file(temporary, filename)) {
+		remove_file(temporary);
+		return UERR_FILE_WRITE_FAILURE;
+	}
+	
+	return UERR_SUCCESS;
+	
+}
+
+static void* textfile_loop(void* ptr) {
+	
+	(void) ptr;
+	
+	pthread_mutex_lock(&lock);
+	
+	while (running) {
+		pthread_mutex_unlock(&lock);
+		write_textfile(textfile);
+		pthread_mutex_lock(&lock);
+		
+		const struct timespec deadline = {
+			.tv_sec = time(NULL) + EXPORTER_INTERVAL
+		};
+		
+		while (running && pthread_cond_timedwait(&cond, &lock, &deadline) == 0);
+	}
+	
+	pthread_mutex_unlock(&lock);
+	
+	return NULL;
+	
+}
+
+#ifndef _WIN32
+	static void send_all(const int fd, const char* data, size_t size) {
+		
+		while (size > 0) {
+			const ssize_t count = send(fd, data, size, MSG_NOSIGNAL);
+			
+			if (count <= 0) {
+				return;
+			}
+			
+			data += count;
+			size -= (size_t) count;
+		}
+		
+	}
+	
+	static void respond(const int fd, const char* const status, const char* const body, const size_t size) {
+		
+		char header[256];
+		const int length = snprintf(
+			header,
+			sizeof(header),
+			"HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+			status,
+			CONTENT_TYPE,
+			size
+		);
+		
+		send_all(fd, header, (size_t) length);
+		send_all(fd, body, size);
+		
+	}
+	
+	static void serve(const int fd) {
+		/*
+		Answers a single request and closes the connection; scrapes are rare enough that
+		keeping connections open is not worth it.
+		*/
+		
+		char request[EXPORTER_MAX_REQUEST_SIZE];
+		size_t offset = 0;
+		
+		while (offset < sizeof(request) - 1) {
+			const ssize_t count = recv(fd, request + offset, sizeof(request) - 1 - offset, 0);
+			
+			if (count <= 0) {
+				return;
+			}
+			
+			offset += (size_t) count;
+			request[offset] = '\0';
+			
+			if (strstr(request, "\r\n\r\n") != NULL) {
+				break;
+			}
+		}
+		
+		if (strncmp(request, "GET ", 4) != 0) {
+			respond(fd, "405 Method Not Allowed", "", 0);
+			return;
+		}
+		
+		const char* const path = request + 4;
+		
+		if (strncmp(path, "/metrics ", 9) != 0 && strncmp(path, "/ ", 2) != 0) {
+			respond(fd, "404 Not Found", "", 0);
+			return;
+		}
+		
+		char* body = NULL;
+		size_t size = 0;
+		
+		FILE* const stream = open_memstream(&body, &size);
+		
+		if (stream == NULL) {
+			respond(fd, "500 Internal Server Error", "", 0);
+			return;
+		}
+		
+		const int status = metrics_export(stream);
+		fclose(stream);
+		
+		if (status == UERR_SUCCESS) {
+			respond(fd, "200 OK", body, size);
+		} else {
+			respond(fd, "500 Internal Server Error", "", 0);
+		}
+		
+		free(body);
+		
+	}
+	
+	static void* listener_loop(void* ptr) {
+		
+		(void) ptr;
+		
+		while (1) {
+			const int fd = accept(listener, NULL, NULL);
+			
+			if (fd == -1) {
+				pthread_mutex_lock(&lock);
+				const int stopped = !running;
+				pthread_mutex_unlock(&lock);
+				
+				if (stopped) {
+					break;
+				}
+				
+				continue;
+			}
+			
+			const struct timeval timeout = {
+				.tv_sec = EXPORTER_REQUEST_TIMEOUT
+			};
+			
+			setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+			setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+			
+			serve(fd);
+			close(fd);
+		}
+		
+		return NULL;
+		
+	}
+	
+	static int listener_open(const int port) {
+		
+		listener = socket(AF_INET, SOCK_STREAM, 0);
+		
+		if (listener == -1) {
+			return UERR_SOCKET_FAILURE;
+		}
+		
+		const int reuse = 1;
+		setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+		
+		/* Only reachable from this machine; anything further goes through a local scraper or proxy */
+		const struct sockaddr_in address = {
+			.sin_family = AF_INET,
+			.sin_port = htons((uint16_t) port),
+			.sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+		};
+		
+		if (bind(listener, (const struct sockaddr*) &address, sizeof(address)) != 0 || listen(listener, 16) != 0) {
+			close(listener);
+			listener = -1;
+			
+			return UERR_SOCKET_FAILURE;
+		}
+		
+		return UERR_SUCCESS;
+		
+	}
+#endif
+
+int exporter_start(const char* const filename, const int port) {
+	/*
+	Publishes the live metrics in the Prometheus text format: rewritten every few seconds to
+	"filename", for node_exporter's textfile collector, and served over HTTP on the loopback
+	interface at "port". Either can be turned off by passing NULL or 0. The endpoint is not
+	available on Windows.
+	*/
+	
+	running = 1;
+	
+	#ifndef _WIN32
+		if (port != 0) {
+			const int status = listener_open(port);
+			
+			if (status != UERR_SUCCESS) {
+				running = 0;
+				return status;
+			}
+			
+			if (pthread_create(&listener_thread, NULL, listener_loop, NULL) != 0) {
+				close(listener);
+				listener = -1;
+				running = 0;
+				
+				return UERR_PTHREAD_FAILURE;
+			}
+		}
+	#else
+		(void) port;
+	#endif
+	
+	if (filename != NULL) {
+		textfile = filename;
+		
+		if (pthread_create(&textfile_thread, NULL, textfile_loop, NULL) != 0) {
+			textfile = NULL;
+			exporter_stop();
+			
+			return UERR_PTHREAD_FAILURE;
+		}
+	}
+	
+	return UERR_SUCCESS;
+	
+}
+
+void exporter_stop(void) {
+	/*
+	Stops both exporters, leaving the textfile with the final values.
+	*/
+	
+	pthread_mutex_lock(&lock);
+	
+	const int was_running = running;
+	running = 0;
+	
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&lock);
+	
+	if (!was_running) {
+		return;
+	}
+	
+	#ifndef _WIN32
+		if (listener != -1) {
+			/* Wakes the listener thread up from accept() */
+			shutdown(listener, SHUT_RDWR);
+			pthread_join(listener_thread, NULL);
+			
+			close(listener);
+			listener = -1;
+		}
+	#endif
+	
+	if (textfile != NULL) {
+		pthread_join(textfile_thread, NULL);
+		write_textfile(textfile);
+		
+		textfile = NULL;
+	}
+	
+}
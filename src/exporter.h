@@ -0,0 +1,6 @@
+#include <stdlib.h>
+
+int exporter_start(const char* const filename, const int port);
+void exporter_stop(void);
+
+#pragma once
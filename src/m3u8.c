@@ -5,6 +5,7 @@
 #include "m3u8.h"
 #include "errors.h"
 #include "symbols.h"
+#include "memory.h"
 
 static const enum Type TYPES[] = {
 	EXTM3U,
@@ -185,7 +186,7 @@ int m3u8_parse(struct Tags* tags, const char* const s) {
 								if (separator == NULL) {
 									const size_t size = (size_t) (attribute_end - attribute_start);
 									
-									tag.value = (char*) malloc(size + 1);
+									tag.value = memory_alloc(MEMORY_M3U8, size + 1);
 									
 									if (tag.value == NULL) {
 										return UERR_MEMORY_ALLOCATE_FAILURE;
@@ -199,7 +200,7 @@ int m3u8_parse(struct Tags* tags, const char* const s) {
 									const size_t key_size = (size_t) (separator - attribute_start);
 									
 									if (key_size > 0) {
-										attr.key = (char*) malloc(key_size + 1);
+										attr.key = memory_alloc(MEMORY_M3U8, key_size + 1);
 										
 										if (attr.key == NULL) {
 											return UERR_MEMORY_ALLOCATE_FAILURE;
@@ -229,7 +230,7 @@ int m3u8_parse(struct Tags* tags, const char* const s) {
 									const size_t value_size = (size_t) (separator == attribute_end ? 0 : attribute_end - separator);
 									
 									if (value_size > 0) {
-										attr.value = (char*) malloc(value_size + 1);
+										attr.value = memory_alloc(MEMORY_M3U8, value_size + 1);
 										
 										if (attr.value == NULL) {
 											return UERR_MEMORY_ALLOCATE_FAILURE;
@@ -240,7 +241,7 @@ int m3u8_parse(struct Tags* tags, const char* const s) {
 									}
 									
 									const size_t size = tag.attributes.size + sizeof(struct Attribute) * 1;
-									struct Attribute* items = (struct Attribute*) realloc(tag.attributes.items, size);
+									struct Attribute* items = memory_realloc(MEMORY_M3U8, tag.attributes.items, size);
 									
 									if (items == NULL) {
 										return UERR_MEMORY_ALLOCATE_FAILURE;
@@ -269,7 +270,7 @@ int m3u8_parse(struct Tags* tags, const char* const s) {
 					}
 					
 					const size_t size = tags->size + sizeof(struct Tag) * 1;
-					struct Tag* items = (struct Tag*) realloc(tags->items, size);
+					struct Tag* items = memory_realloc(MEMORY_M3U8, tags->items, size);
 					
 					if (items == NULL) {
 						return UERR_MEMORY_ALLOCATE_FAILURE;
@@ -281,13 +282,11 @@ int m3u8_parse(struct Tags* tags, const char* const s) {
 					tags->items[tags->offset++] = tag;
 				} else if (tags->offset > 0) {
 					struct Tag* tag = &tags->items[tags->offset - 1];
-					tag->uri = malloc(sizeof(line));
+					tag->uri = memory_strdup(MEMORY_M3U8, line);
 					
 					if (tag->uri == NULL) {
 						return UERR_MEMORY_ALLOCATE_FAILURE;
 					}
-					
-					strcpy(tag->uri, line);
 				}
 			}
 		}
@@ -314,141 +313,34 @@ void m3u8_free(struct Tags* tags) {
 		for (size_t index = 0; index < tag->attributes.offset; index++) {
 			struct Attribute* attribute = &tag->attributes.items[index];
 			
-			free(attribute->key);
+			memory_free(attribute->key);
 			attribute->key = NULL;
 			
-			free(attribute->value);
+			memory_free(attribute->value);
 			attribute->value = NULL;
 		}
 		
 		tag->attributes.offset = 0;
 		tag->attributes.size = 0;
-		free(tag->attributes.items);
+		memory_free(tag->attributes.items);
 		tag->attributes.items = NULL;
 		
+		memory_free(tag->value);
+		tag->value = NULL;
+		
 		if (tag->uri != NULL) {
-			free(tag->uri);
+			memory_free(tag->uri);
 			tag->uri = NULL;
 		}
 	}
 	
 	tags->offset = 0;
 	tags->size = 0;
-	free(tags->items);
+	memory_free(tags->items);
 	tags->items = NULL;
 	
 }
 
-int tags_dumpf(const struct Tags* const tags, FILE* const stream) {
-	
-	for (size_t index = 0; index < tags->offset; index++) {
-		struct Tag* tag = &tags->items[index];
-		
-		if (fwrite(HASHTAG, sizeof(*HASHTAG), strlen(HASHTAG), stream) != strlen(HASHTAG)) {
-			return 0;
-		}
-		
-		const char* const name = tag_stringify(tag->type);
-		
-		if (fwrite(name, sizeof(*name), strlen(name), stream) != strlen(name)) {
-			return 0;
-		}
-		
-		if (tag->value == NULL) {
-			for (size_t index = 0; index < tag->attributes.offset; index++) {
-				if (index == 0) {
-					if (fwrite(COLON, sizeof(*COLON), strlen(COLON), stream) != strlen(COLON)) {
-						return 0;
-					}
-				} else {
-					if (fwrite(COMMA, sizeof(*COMMA), strlen(COMMA), stream) != strlen(COMMA)) {
-						return 0;
-					}
-				}
-				
-				const struct Attribute* const attribute = &tag->attributes.items[index];
-				
-				if (fwrite(attribute->key, sizeof(*attribute->key), strlen(attribute->key), stream) != strlen(attribute->key)) {
-					return 0;
-				}
-				
-				if (fwrite(EQUAL, sizeof(*EQUAL), strlen(EQUAL), stream) != strlen(EQUAL)) {
-					return 0;
-				}
-				
-				if (attribute->is_quoted) {
-					if (fwrite(QUOTATION_MARK, sizeof(*QUOTATION_MARK), strlen(QUOTATION_MARK), stream) != strlen(QUOTATION_MARK)) {
-						return 0;
-					}
-				}
-				
-				if (strcmp(attribute->key, "URI") == 0) {
-					char value[strlen(attribute->value) + 1];
-					strcpy(value, attribute->value);
-					
-					for (size_t index = 0; index < strlen(value); index++) {
-						char* ch = &value[index];
-						
-						if (*ch == *BACKSLASH) {
-							*ch = *SLASH;
-						}
-					}
-					
-					if (fwrite(value, sizeof(*value), strlen(value), stream) != strlen(value)) {
-						return 0;
-					}
-				} else {
-					if (fwrite(attribute->value, sizeof(*attribute->value), strlen(attribute->value), stream) != strlen(attribute->value)) {
-						return 0;
-					}
-				}
-				
-				if (attribute->is_quoted) {
-					if (fwrite(QUOTATION_MARK, sizeof(*QUOTATION_MARK), strlen(QUOTATION_MARK), stream) != strlen(QUOTATION_MARK)) {
-						return 0;
-					}
-				}
-			}
-		} else {
-			if (fwrite(COLON, sizeof(*COLON), strlen(COLON), stream) != strlen(COMMA)) {
-				return 0;
-			}
-			
-			if (fwrite(tag->value, sizeof(*tag->value), strlen(tag->value), stream) != strlen(tag->value)) {
-				return 0;
-			}
-		}
-		
-		if (tag->uri != NULL) {
-			if (fwrite(LF, sizeof(*LF), strlen(LF), stream) != strlen(LF)) {
-				return 0;
-			}
-			
-			char uri[strlen(tag->uri) + 1];
-			strcpy(uri, tag->uri);
-			
-			for (size_t index = 0; index < strlen(uri); index++) {
-				char* ch = &uri[index];
-				
-				if (*ch == *BACKSLASH) {
-					*ch = *SLASH;
-				}
-			}
-			
-			if (fwrite(uri, sizeof(*uri), strlen(uri), stream) != strlen(uri)) {
-				return 0;
-			}
-		}
-		
-		if (fwrite(LF, sizeof(*LF), strlen(LF), stream) != strlen(LF)) {
-			return 0;
-		}
-	}
-	
-	return 1;
-	
-}
-
 struct Attribute* attributes_get(const struct Attributes* attributes, const char* key) {
 	
 	for (size_t index = 0; index < attributes->offset; index++) {
@@ -465,48 +357,28 @@ struct Attribute* attributes_get(const struct Attributes* attributes, const char
 
 int attribute_set_value(struct Attribute* attribute, const char* const value) {
 	
-	free(attribute->value);
+	memory_free(attribute->value);
 	
-	attribute->value = malloc(strlen(value) + 1);
+	attribute->value = memory_strdup(MEMORY_M3U8, value);
 	
 	if (attribute->value == NULL) {
 		return 0;
 	}
 	
-	strcpy(attribute->value, value);
-	
 	return 1;
 	
 }
 
 int tag_set_value(struct Tag* tag, const char* const value) {
 	
-	free(tag->value);
+	memory_free(tag->value);
 	
-	tag->value = malloc(strlen(value) + 1);
+	tag->value = memory_strdup(MEMORY_M3U8, value);
 	
 	if (tag->value == NULL) {
 		return 0;
 	}
 	
-	strcpy(tag->value, value);
-	
-	return 1;
-	
-}
-
-int tag_set_uri(struct Tag* tag, const char* const value) {
-	
-	free(tag->uri);
-	
-	tag->uri = malloc(strlen(value) + 1);
-	
-	if (tag->uri == NULL) {
-		return 0;
-	}
-	
-	strcpy(tag->uri, value);
-	
 	return 1;
 	
 }
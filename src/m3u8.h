@@ -53,11 +53,8 @@ struct Tags {
 int m3u8_parse(struct Tags* tags, const char* const s);
 void m3u8_free(struct Tags* tags);
 
-int tags_dumpf(const struct Tags* const tags, FILE* const stream);
-
 const char* tag_stringify(const enum Type type);
 int tag_set_value(struct Tag* tag, const char* const value);
-int tag_set_uri(struct Tag* tag, const char* const value);
 
 struct Attribute* attributes_get(const struct Attributes* attributes, const char* key);
 int attribute_set_value(struct Attribute* attribute, const char* const value);
\ No newline at end of file
@@ -1,10 +1,15 @@
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #define A "SparkleC"
 #if defined(WIN32) && defined(UNICODE)
 	#include <stdarg.h>
 #endif
 
+#ifndef _WIN32
+	#include <unistd.h>
+#endif
+
 #include <curl/curl.h>
 #include <jansson.h>
 
@@ -16,11 +21,62 @@
 #include "symbols.h"
 #include "cacert.h"
 #include "m3u8.h"
+#include "stream.h"
+#include "token.h"
+#include "cache.h"
+#include "pool.h"
+#include "pathset.h"
+#include "options.h"
+#include "decrypt.h"
+#include "manifest.h"
+#include "sha256.h"
+#include "metrics.h"
+#include "trace.h"
+#include "progress.h"
+#include "memory.h"
+#include "plan.h"
+#include "exporter.h"
+#include "eventlog.h"
+#include "selftest.h"
+
+struct SegmentKey {
+	char* url;
+	struct String data;
+};
 
 struct SegmentDownload {
 	CURL* handle;
-	char* filename;
-	FILE* stream;
+	struct String data;
+	const struct SegmentKey* key;
+	unsigned char iv[AES_BLOCK_SIZE];
+	double duration;
+	struct ProgressTransfer transfer;
+	int done;
+};
+
+enum PlanStage {
+	PLAN_MASTER_PLAYLIST,
+	PLAN_MEDIA_PLAYLIST,
+	PLAN_ATTACHMENT
+};
+
+struct PlanItem {
+	enum PlanStage stage;
+	int missing;
+	const char* url;
+	uint64_t bandwidth;
+	CURL* handle;
+	struct String data;
+};
+
+struct ResourcesRevalidation {
+	pthread_t thread;
+	CURL* handle;
+	CURLM* multi;
+	const char* filename;
+	const char* username;
+	int code;
+	int running;
 };
 
 #if defined(WIN32) && defined(UNICODE)
@@ -114,26 +170,25 @@ static void curlcharpp_free(char** ptr) {
 	curl_free(*ptr);
 }
 
-static size_t progress_callback(void *clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) {
-	
-	printf("\r+ Atualmente em progresso: %i%% / 100%%", ((dlnow * 100) / dltotal));
-	
-	if (((dlnow * 100) / dltotal) == 100) {
-		printf("\n");
-	}
-	
-	return 0;
-	
+static void token_refresherpp_free(struct TokenRefresher** ptr) {
+	token_refresher_free(*ptr);
+}
+
+static void memorycharpp_free(char** ptr) {
+	memory_free(*ptr);
 }
 
 static const char MP4_FILE_EXTENSION[] = "mp4";
-static const char TS_FILE_EXTENSION[] = "ts";
-static const char KEY_FILE_EXTENSION[] = "key";
 
-static const char LOCAL_PLAYLIST_FILENAME[] = "playlist.m3u8";
 static const char LOCAL_ACCOUNTS_FILENAME[] = "accounts.json";
+static const char LOCAL_RESOURCES_FILENAME[] = "resources.json";
+
+/* Prefixes of the keys outputs are identified by in the manifest */
+static const char MEDIA_SOURCE_PREFIX[] = "media:";
+static const char ATTACHMENT_SOURCE_PREFIX[] = "attachment:";
 
 static const char HTTPS_SCHEME[] = "https://";
+static const char HTTP_SCHEME[] = "http://";
 
 static const char HTTP_HEADER_AUTHORIZATION[] = "Authorization";
 static const char HTTP_HEADER_REFERER[] = "Referer";
@@ -151,182 +206,458 @@ static const char* const HOSTNAMES[] = {
 };
 
 static const char HOTMART_CLUB_SUFFIX[] = ".club.hotmart.com";
+static const char HOTMART_REFERER[] = "https://hotmart.com";
 
-#define HOTMART_API_CLUB_PREFIX "https://api-club.hotmart.com/hot-club-api/rest/v3"
-#define HOTMART_API_SEC_PREFIX "https://api-sec-vlc.hotmart.com"
-#define SPARKLEAPP_API_PREFIX "https://api.sparkleapp.com.br"
+static const char HOTMART_API_CLUB_ORIGIN[] = "https://api-club.hotmart.com";
+static const char HOTMART_API_SEC_ORIGIN[] = "https://api-sec-vlc.hotmart.com";
+static const char SPARKLEAPP_API_ORIGIN[] = "https://api.sparkleapp.com.br";
 
-static const char HOTMART_NAVIGATION_ENDPOINT[] = 
-	HOTMART_API_CLUB_PREFIX
-	"/navigation";
+#define HOTMART_API_CLUB_PATH "/hot-club-api/rest/v3"
 
-static const char HOTMART_MEMBERSHIP_ENDPOINT[] = 
-	HOTMART_API_CLUB_PREFIX
-	"/membership";
+static const char HOTMART_NAVIGATION_PATH[] = HOTMART_API_CLUB_PATH "/navigation";
+static const char HOTMART_MEMBERSHIP_PATH[] = HOTMART_API_CLUB_PATH "/membership";
+static const char HOTMART_PAGE_PATH[] = HOTMART_API_CLUB_PATH "/page";
+static const char HOTMART_ATTACHMENT_PATH[] = HOTMART_API_CLUB_PATH "/attachment";
+static const char HOTMART_TOKEN_PATH[] = "/oauth/token";
+static const char HOTMART_TOKEN_CHECK_PATH[] = "/security/oauth/check_token";
 
-static const char HOTMART_PAGE_ENDPOINT[] = 
-	HOTMART_API_CLUB_PREFIX
-	"/page";
+/* Built at startup, since every endpoint can be served from another origin instead (--api-url) */
+struct Endpoints {
+	char* navigation;
+	char* membership;
+	char* page;
+	char* attachment;
+	char* token;
+	char* token_check;
+};
 
-static const char HOTMART_ATTACHMENT_ENDPOINT[] = 
-	HOTMART_API_CLUB_PREFIX
-	"/attachment";
+#define MAX_INPUT_SIZE 1024
 
-static const char HOTMART_TOKEN_ENDPOINT[] = 
-	SPARKLEAPP_API_PREFIX
-	"/oauth/token";
+/* Connections the shared multi handle keeps open, both in total and per host */
+#define MAX_CONNECTIONS 30
 
-static const char HOTMART_TOKEN_CHECK_ENDPOINT[] = 
-	HOTMART_API_SEC_PREFIX
-	"/security/oauth/check_token";
+/* Playlists and attachments probed at once by --plan */
+#define PLAN_MAX_TRANSFERS 16
 
-#define MAX_INPUT_SIZE 1024
+/*
+Segments of a lecture that may be downloading or finished but waiting on an earlier one;
+this is what bounds the number of segments held in memory.
+*/
+#define SEGMENT_WINDOW MAX_CONNECTIONS
 
 static CURL* curl = NULL;
+static CURLM* multi_handle = NULL;
 
-static int authorize(
-	const char* const username,
-	const char* const password,
-	struct Credentials* const credentials
-) {
+/*
+API responses are decoded as they arrive by driving a multi handle of their own, which must not
+hold any other transfer: json_stream_load() consumes every completion message it reads.
+*/
+static CURLM* api_multi_handle = NULL;
+
+static struct TokenRefresher refresher = {0};
+static struct RemuxPool pool = {0};
+static struct Manifest manifest = {0};
+
+static struct Endpoints endpoints = {0};
+
+/* Bytes that did not have to be downloaded because an identical output already existed */
+static uint64_t deduplicated_bytes = 0;
+
+static void remux_pool_shutdown(void) {
+	/*
+	Lectures already downloaded are still written out when leaving early; the one being
+	downloaded, if any, is discarded.
+	*/
+	remux_pool_free(&pool);
+	manifest_close(&manifest);
+}
+
+static char* endpoint_build(const char* const origin, const char* const path) {
 	
-	char* user __attribute__((__cleanup__(curlcharpp_free))) = curl_easy_escape(NULL, username, 0);
+	size_t size = strlen(origin);
 	
-	if (user == NULL) {
-		return UERR_CURL_FAILURE;
+	while (size > 0 && origin[size - 1] == *SLASH) {
+		size--;
 	}
 	
-	char* pass __attribute__((__cleanup__(curlcharpp_free))) = curl_easy_escape(NULL, password, 0);
+	char* const url = malloc(size + strlen(path) + 1);
 	
-	if (pass == NULL) {
-		return UERR_CURL_FAILURE;
+	if (url == NULL) {
+		return NULL;
 	}
 	
-	struct Query query __attribute__((__cleanup__(query_free))) = {0};
+	memcpy(url, origin, size);
+	strcpy(url + size, path);
 	
-	add_parameter(&query, "grant_type", "password");
-	add_parameter(&query, "username", user);
-	add_parameter(&query, "password", pass);
+	return url;
 	
-	char* post_fields __attribute__((__cleanup__(charpp_free))) = NULL;
-	const int code = query_stringify(query, &post_fields);
+}
+
+static void endpoints_free(void) {
 	
-	if (code != UERR_SUCCESS) {
-		return code;
-	}
+	free(endpoints.navigation);
+	free(endpoints.membership);
+	free(endpoints.page);
+	free(endpoints.attachment);
+	free(endpoints.token);
+	free(endpoints.token_check);
 	
-	struct String string __attribute__((__cleanup__(string_free))) = {0};
+}
+
+static int endpoints_init(const char* const origin) {
+	
+	const char* const club = origin == NULL ? HOTMART_API_CLUB_ORIGIN : origin;
+	const char* const sec = origin == NULL ? HOTMART_API_SEC_ORIGIN : origin;
+	const char* const sparkleapp = origin == NULL ? SPARKLEAPP_API_ORIGIN : origin;
+	
+	endpoints.navigation = endpoint_build(club, HOTMART_NAVIGATION_PATH);
+	endpoints.membership = endpoint_build(club, HOTMART_MEMBERSHIP_PATH);
+	endpoints.page = endpoint_build(club, HOTMART_PAGE_PATH);
+	endpoints.attachment = endpoint_build(club, HOTMART_ATTACHMENT_PATH);
+	endpoints.token = endpoint_build(sparkleapp, HOTMART_TOKEN_PATH);
+	endpoints.token_check = endpoint_build(sec, HOTMART_TOKEN_CHECK_PATH);
+	
+	return (
+		endpoints.navigation != NULL &&
+		endpoints.membership != NULL &&
+		endpoints.page != NULL &&
+		endpoints.attachment != NULL &&
+		endpoints.token != NULL &&
+		endpoints.token_check != NULL
+	);
 	
-	curl_easy_setopt(curl, CURLOPT_COPYPOSTFIELDS, post_fields);
-	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_write_cb);
-	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &string);
-	curl_easy_setopt(curl, CURLOPT_URL, HOTMART_TOKEN_ENDPOINT);
+}
+
+static const char* report_filename = NULL;
+
+static void metrics_shutdown(void) {
 	
-	if (curl_easy_perform(curl) != CURLE_OK) {
-		return UERR_CURL_FAILURE;
+	if (metrics_report(report_filename) != UERR_SUCCESS) {
+		fprintf(stderr, "- Não foi possível gravar o relatório em '%s'!\r\n", report_filename);
 	}
 	
-	json_auto_t* tree = json_loads(string.s, 0, NULL);
-	
-	if (tree == NULL) {
-		return UERR_JSON_CANNOT_PARSE;
-	}
+}
+
+static void memory_shutdown(void) {
+	memory_report(stderr);
+}
+
+static int output_matches_record(const char* const filename, const uint64_t size, const int verify) {
+	/*
+	Checks an output of "size" bytes against what was recorded when it was finished: the size
+	first, and the digest only when asked to, since that means reading the whole file back.
+	*/
 	
-	const json_t* obj = json_object_get(tree, "access_token");
+	uint64_t expected_size = 0;
+	char expected_sha256[SHA256_HEX_SIZE];
 	
-	if (obj == NULL) {
-		return UERR_JSON_MISSING_REQUIRED_KEY;
+	if (!manifest_lookup(&manifest, filename, &expected_size, expected_sha256) || size != expected_size) {
+		return 0;
 	}
 	
-	if (!json_is_string(obj)) {
-		return UERR_JSON_NON_MATCHING_TYPE;
+	if (!verify) {
+		return 1;
 	}
 	
-	const char* const access_token = json_string_value(obj);
+	char sha256[SHA256_HEX_SIZE];
+	uint64_t hashed_size = 0;
 	
-	obj = json_object_get(tree, "refresh_token");
+	return sha256_file(filename, sha256, &hashed_size) && hashed_size == expected_size && strcmp(sha256, expected_sha256) == 0;
 	
-	if (obj == NULL) {
-		return UERR_JSON_MISSING_REQUIRED_KEY;
-	}
+}
+
+static int output_is_complete(
+	const struct Directory* const directory,
+	const char* const name,
+	const char* const filename,
+	const int verify
+) {
 	
-	if (!json_is_string(obj)) {
-		return UERR_JSON_NON_MATCHING_TYPE;
+	uint64_t size = 0;
+	
+	return directory_get_file_size(directory, name, &size) && output_matches_record(filename, size, verify);
+	
+}
+
+static int output_reuse(const char* const source, const char* const filename, const int verify) {
+	/*
+	Looks for an intact output already downloaded from the same source, under another name, and
+	makes "filename" share its contents instead of downloading it again.
+	*/
+	
+	char* const existing = manifest_find_source(&manifest, source);
+	
+	if (existing == NULL) {
+		return 0;
 	}
 	
-	const char* const refresh_token = json_string_value(obj);
+	uint64_t size = 0;
+	char sha256[SHA256_HEX_SIZE];
 	
-	obj = json_object_get(tree, "expires_in");
+	int ok = (
+		strcmp(existing, filename) != 0 &&
+		get_file_size(existing, &size) &&
+		output_matches_record(existing, size, verify) &&
+		manifest_lookup(&manifest, existing, &size, sha256)
+	);
 	
-	if (obj == NULL) {
-		return UERR_JSON_MISSING_REQUIRED_KEY;
+	if (ok) {
+		printf("+ Reaproveitando o arquivo idêntico '%s'\r\n", existing);
+		ok = duplicate_file(existing, filename) && manifest_record(&manifest, filename, size, sha256, source) == UERR_SUCCESS;
 	}
 	
-	if (!json_is_integer(obj)) {
-		return UERR_JSON_NON_MATCHING_TYPE;
+	if (ok) {
+		deduplicated_bytes += size;
 	}
 	
-	const int expires_in = json_integer_value(obj);
+	memory_free(existing);
 	
-	credentials->expires_in = expires_in;
+	return ok;
 	
-	credentials->access_token = malloc(strlen(access_token) + 1);
-	credentials->refresh_token = malloc(strlen(refresh_token) + 1);
+}
+
+static int api_headers(
+	struct curl_slist** const list,
+	const char* const access_token,
+	const char* const subdomain,
+	const char* const referer
+) {
 	
-	if (credentials->access_token == NULL || credentials->refresh_token == NULL) {
-		return UERR_MEMORY_ALLOCATE_FAILURE;
-	}
+	char authorization[strlen(HTTP_AUTHENTICATION_BEARER) + strlen(SPACE) + strlen(access_token) + 1];
+	strcpy(authorization, HTTP_AUTHENTICATION_BEARER);
+	strcat(authorization, SPACE);
+	strcat(authorization, access_token);
 	
-	strcpy(credentials->access_token, access_token);
-	strcpy(credentials->refresh_token, refresh_token);
+	const char* const headers[][2] = {
+		{HTTP_HEADER_AUTHORIZATION, authorization},
+		{HTTP_HEADER_CLUB, subdomain},
+		{HTTP_HEADER_REFERER, referer}
+	};
 	
-	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, NULL);
-	curl_easy_setopt(curl, CURLOPT_WRITEDATA, NULL);
-	curl_easy_setopt(curl, CURLOPT_URL, NULL);
-	curl_easy_setopt(curl, CURLOPT_COPYPOSTFIELDS, NULL);
+	for (size_t index = 0; index < sizeof(headers) / sizeof(*headers); index++) {
+		const char** const header = (const char**) headers[index];
+		const char* const key = header[0];
+		const char* const value = header[1];
+		
+		if (value == NULL) {
+			continue;
+		}
+		
+		char item[strlen(key) + strlen(HTTP_HEADER_SEPARATOR) + strlen(value) + 1];
+		strcpy(item, key);
+		strcat(item, HTTP_HEADER_SEPARATOR);
+		strcat(item, value);
+		
+		struct curl_slist* tmp = curl_slist_append(*list, item);
+		
+		if (tmp == NULL) {
+			return UERR_CURL_FAILURE;
+		}
+		
+		*list = tmp;
+	}
 	
 	return UERR_SUCCESS;
 	
 }
 
-static int get_resources(
-	const struct Credentials* const credentials,
-	struct Resources* const resources
+static int get_response_code(CURL* const handle) {
+	
+	long response_code = 0;
+	curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &response_code);
+	
+	return (int) response_code;
+	
+}
+
+static int is_unauthorized(CURL* const handle) {
+	return get_response_code(handle) == 401;
+}
+
+static void page_error(
+	const char* const stage,
+	const struct Resource* const resource,
+	const struct Module* const module,
+	const struct Page* const page,
+	const int status
+) {
+	/*
+	Logs the stage at which the download of a page was given up on.
+	*/
+	
+	eventlog_emit(
+		"error",
+		"{s:s, s:s?, s:s?, s:s?, s:i}",
+		"stage", stage,
+		"resource", resource->name,
+		"module", module->id,
+		"page", page->id,
+		"status", status
+	);
+	
+}
+
+static int api_load(
+	CURL* const handle,
+	CURLM* const multi,
+	struct curl_slist** const list,
+	const char* const subdomain,
+	const char* const referer,
+	json_t** const tree
+) {
+	/*
+	Performs an authenticated API request. If the server rejects the access token,
+	it is refreshed and the request is sent once more with the new one.
+	*/
+	
+	for (int attempt = 0; ; attempt++) {
+		char* access_token __attribute__((__cleanup__(charpp_free))) = token_get_access_token(&refresher);
+		
+		if (access_token == NULL) {
+			return UERR_MEMORY_ALLOCATE_FAILURE;
+		}
+		
+		curl_slist_free_all(*list);
+		*list = NULL;
+		
+		const int code = api_headers(list, access_token, subdomain, referer);
+		
+		if (code != UERR_SUCCESS) {
+			return code;
+		}
+		
+		curl_easy_setopt(handle, CURLOPT_HTTPHEADER, *list);
+		
+		const int status = json_stream_load(multi, handle, tree);
+		metrics_record(handle, TRANSFER_CATALOG);
+		TRACE_TRANSFER(handle, "catalog");
+		
+		if (status != UERR_CURL_FAILURE || attempt > 0 || !is_unauthorized(handle)) {
+			return status;
+		}
+		
+		if (token_refresh(&refresher, access_token) != UERR_SUCCESS) {
+			return status;
+		}
+		
+		metrics_count(COUNTER_RETRIES);
+	}
+	
+}
+
+static int authorize(
+	const char* const username,
+	const char* const password,
+	struct Credentials* const credentials
 ) {
 	
+	char* user __attribute__((__cleanup__(curlcharpp_free))) = curl_easy_escape(NULL, username, 0);
+	
+	if (user == NULL) {
+		return UERR_CURL_FAILURE;
+	}
+	
+	char* pass __attribute__((__cleanup__(curlcharpp_free))) = curl_easy_escape(NULL, password, 0);
+	
+	if (pass == NULL) {
+		return UERR_CURL_FAILURE;
+	}
+	
 	struct Query query __attribute__((__cleanup__(query_free))) = {0};
 	
-	add_parameter(&query, "token", credentials->access_token);
+	add_parameter(&query, "grant_type", "password");
+	add_parameter(&query, "username", user);
+	add_parameter(&query, "password", pass);
 	
-	char* squery __attribute__((__cleanup__(charpp_free))) = NULL;
-	const int code = query_stringify(query, &squery);
+	char* post_fields __attribute__((__cleanup__(memorycharpp_free))) = NULL;
+	const int code = query_stringify(query, &post_fields);
 	
 	if (code != UERR_SUCCESS) {
 		return code;
 	}
 	
-	CURLU* cu __attribute__((__cleanup__(curlupp_free))) = curl_url();
-	curl_url_set(cu, CURLUPART_URL, HOTMART_TOKEN_CHECK_ENDPOINT, 0);
-	curl_url_set(cu, CURLUPART_QUERY, squery, 0);
+	curl_easy_setopt(curl, CURLOPT_COPYPOSTFIELDS, post_fields);
+	curl_easy_setopt(curl, CURLOPT_URL, endpoints.token);
 	
-	char* url __attribute__((__cleanup__(curlcharpp_free))) = NULL;
-	curl_url_get(cu, CURLUPART_URL, &url, 0);
-	curl_easy_setopt(curl, CURLOPT_URL, url);
+	json_auto_t* tree = NULL;
+	const int status = json_stream_load(api_multi_handle, curl, &tree);
+	metrics_record(curl, TRANSFER_AUTH);
+	TRACE_TRANSFER(curl, "auth");
 	
-	struct String string __attribute__((__cleanup__(string_free))) = {0};
+	if (status != UERR_SUCCESS) {
+		return status;
+	}
 	
-	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_write_cb);
-	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &string);
-	curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+	const int parse_status = credentials_parse(tree, credentials);
 	
-	if (curl_easy_perform(curl) != CURLE_OK) {
-		return UERR_CURL_FAILURE;
+	if (parse_status != UERR_SUCCESS) {
+		return parse_status;
+	}
+	
+	curl_easy_setopt(curl, CURLOPT_URL, NULL);
+	curl_easy_setopt(curl, CURLOPT_COPYPOSTFIELDS, NULL);
+	
+	return UERR_SUCCESS;
+	
+}
+
+static int check_token(CURL* const handle, CURLM* const multi, json_t** const tree) {
+	
+	for (int attempt = 0; ; attempt++) {
+		char* access_token __attribute__((__cleanup__(charpp_free))) = token_get_access_token(&refresher);
+		
+		if (access_token == NULL) {
+			return UERR_MEMORY_ALLOCATE_FAILURE;
+		}
+		
+		struct Query query __attribute__((__cleanup__(query_free))) = {0};
+		
+		add_parameter(&query, "token", access_token);
+		
+		char* squery __attribute__((__cleanup__(memorycharpp_free))) = NULL;
+		const int code = query_stringify(query, &squery);
+		
+		if (code != UERR_SUCCESS) {
+			return code;
+		}
+		
+		CURLU* cu __attribute__((__cleanup__(curlupp_free))) = curl_url();
+		curl_url_set(cu, CURLUPART_URL, endpoints.token_check, 0);
+		curl_url_set(cu, CURLUPART_QUERY, squery, 0);
+		
+		char* url __attribute__((__cleanup__(curlcharpp_free))) = NULL;
+		curl_url_get(cu, CURLUPART_URL, &url, 0);
+		curl_easy_setopt(handle, CURLOPT_URL, url);
+		curl_easy_setopt(handle, CURLOPT_HTTPGET, 1L);
+		
+		const int status = json_stream_load(multi, handle, tree);
+		metrics_record(handle, TRANSFER_AUTH);
+		TRACE_TRANSFER(handle, "auth");
+		
+		if (status != UERR_CURL_FAILURE || attempt > 0 || !is_unauthorized(handle)) {
+			return status;
+		}
+		
+		if (token_refresh(&refresher, access_token) != UERR_SUCCESS) {
+			return status;
+		}
+		
+		metrics_count(COUNTER_RETRIES);
 	}
 	
-	json_auto_t* tree = json_loads(string.s, 0, NULL);
+}
+
+static int get_resources(
+	CURL* const handle,
+	CURLM* const multi,
+	struct Resources* const resources
+) {
+	
+	json_auto_t* tree = NULL;
+	const int status = check_token(handle, multi, &tree);
 	
-	if (tree == NULL) {
-		return UERR_JSON_CANNOT_PARSE;
+	if (status != UERR_SUCCESS) {
+		return status;
 	}
 	
 	const json_t* obj = json_object_get(tree, "resources");
@@ -339,19 +670,14 @@ static int get_resources(
 		return UERR_JSON_NON_MATCHING_TYPE;
 	}
 	
-	char authorization[strlen(HTTP_AUTHENTICATION_BEARER) + strlen(SPACE) + strlen(credentials->access_token) + 1];
-	strcpy(authorization, HTTP_AUTHENTICATION_BEARER);
-	strcat(authorization, SPACE);
-	strcat(authorization, credentials->access_token);
-	
 	size_t index = 0;
 	json_t *item = NULL;
 	const size_t array_size = json_array_size(obj);
 	
-	curl_easy_setopt(curl, CURLOPT_URL, HOTMART_MEMBERSHIP_ENDPOINT);
+	curl_easy_setopt(handle, CURLOPT_URL, endpoints.membership);
 	
 	resources->size = sizeof(struct Resource) * array_size;
-	resources->items = malloc(resources->size);
+	resources->items = memory_alloc(MEMORY_CATALOG, resources->size);
 	
 	if (resources->items == NULL) {
 		return UERR_MEMORY_ALLOCATE_FAILURE;
@@ -384,45 +710,15 @@ static int get_resources(
 		
 		const char* const subdomain = json_string_value(obj);
 		
-		const char* const headers[][2] = {
-			{HTTP_HEADER_AUTHORIZATION, authorization},
-			{HTTP_HEADER_CLUB, subdomain}
-		};
-		
 		struct curl_slist* list __attribute__((__cleanup__(curl_slistp_free_all))) = NULL;
 		
-		for (size_t index = 0; index < sizeof(headers) / sizeof(*headers); index++) {
-			const char** const header = (const char**) headers[index];
-			const char* const key = header[0];
-			const char* const value = header[1];
-			
-			char item[strlen(key) + strlen(HTTP_HEADER_SEPARATOR) + strlen(value) + 1];
-			strcpy(item, key);
-			strcat(item, HTTP_HEADER_SEPARATOR);
-			strcat(item, value);
-			
-			struct curl_slist* tmp = curl_slist_append(list, item);
-			
-			if (tmp == NULL) {
-				return UERR_CURL_FAILURE;
-			}
-			
-			list = tmp;
-		}
-		
-		struct String string __attribute__((__cleanup__(string_free))) = {0};
-		
-		curl_easy_setopt(curl, CURLOPT_WRITEDATA, &string);
-		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, list);
-		
-		if (curl_easy_perform(curl) != CURLE_OK) {
-			return UERR_CURL_FAILURE;
-		}
+		json_auto_t* subtree = NULL;
+		const int status = api_load(handle, multi, &list, subdomain, NULL, &subtree);
 		
-		json_auto_t* subtree = json_loads(string.s, 0, NULL);
+		curl_easy_setopt(handle, CURLOPT_HTTPHEADER, NULL);
 		
-		if (subtree == NULL) {
-			return UERR_JSON_CANNOT_PARSE;
+		if (status != UERR_SUCCESS) {
+			return status;
 		}
 		
 		obj = json_object_get(subtree, "name");
@@ -438,80 +734,35 @@ static int get_resources(
 		const char* const name = json_string_value(obj);
 		
 		struct Resource resource = {
-			.name = malloc(strlen(name) + 1),
-			.subdomain = malloc(strlen(subdomain) + 1)
+			.name = memory_strdup(MEMORY_CATALOG, name),
+			.subdomain = memory_strdup(MEMORY_CATALOG, subdomain)
 		};
 		
 		if (resource.name == NULL || resource.subdomain == NULL) {
 			return UERR_MEMORY_ALLOCATE_FAILURE;
 		}
 		
-		strcpy(resource.name, name);
-		strcpy(resource.subdomain, subdomain);
-		
 		resources->items[resources->offset++] = resource;
 	}
 	
-	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, NULL);
-	curl_easy_setopt(curl, CURLOPT_WRITEDATA, NULL);
-	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, NULL);
-	curl_easy_setopt(curl, CURLOPT_URL, NULL);
+	curl_easy_setopt(handle, CURLOPT_HTTPHEADER, NULL);
+	curl_easy_setopt(handle, CURLOPT_URL, NULL);
 	
 	return UERR_SUCCESS;
 	
 }
 
-static int get_modules(
-	const struct Credentials* const credentials,
-	struct Resource* const resource
-) {
-	
-	char authorization[strlen(HTTP_AUTHENTICATION_BEARER) + strlen(SPACE) + strlen(credentials->access_token) + 1];
-	strcpy(authorization, HTTP_AUTHENTICATION_BEARER);
-	strcat(authorization, SPACE);
-	strcat(authorization, credentials->access_token);
-	
-	const char* const headers[][2] = {
-		{HTTP_HEADER_AUTHORIZATION, authorization},
-		{HTTP_HEADER_CLUB, resource->subdomain}
-	};
+static int get_modules(struct Resource* const resource) {
 	
 	struct curl_slist* list __attribute__((__cleanup__(curl_slistp_free_all))) = NULL;
 	
-	for (size_t index = 0; index < sizeof(headers) / sizeof(*headers); index++) {
-		const char** const header = (const char**) headers[index];
-		const char* const key = header[0];
-		const char* const value = header[1];
-		
-		char item[strlen(key) + strlen(HTTP_HEADER_SEPARATOR) + strlen(value) + 1];
-		strcpy(item, key);
-		strcat(item, HTTP_HEADER_SEPARATOR);
-		strcat(item, value);
-		
-		struct curl_slist* tmp = curl_slist_append(list, item);
-		
-		if (tmp == NULL) {
-			return UERR_CURL_FAILURE;
-		}
-		
-		list = tmp;
-	}
-	
-	struct String string __attribute__((__cleanup__(string_free))) = {0};
+	curl_easy_setopt(curl, CURLOPT_URL, endpoints.navigation);
 	
-	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_write_cb);
-	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &string);
-	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, list);
-	curl_easy_setopt(curl, CURLOPT_URL, HOTMART_NAVIGATION_ENDPOINT);
+	json_auto_t* tree = NULL;
+	const int status = api_load(curl, api_multi_handle, &list, resource->subdomain, NULL, &tree);
 	
-	if (curl_easy_perform(curl) != CURLE_OK) {
-		return UERR_CURL_FAILURE;
-	}
-	
-	json_auto_t* tree = json_loads(string.s, 0, NULL);
-	
-	if (tree == NULL) {
-		return UERR_JSON_CANNOT_PARSE;
+	if (status != UERR_SUCCESS) {
+		return status;
 	}
 	
 	const json_t* obj = json_object_get(tree, "modules");
@@ -528,10 +779,10 @@ static int get_modules(
 	json_t *item = NULL;
 	const size_t array_size = json_array_size(obj);
 	
-	curl_easy_setopt(curl, CURLOPT_URL, HOTMART_MEMBERSHIP_ENDPOINT);
+	curl_easy_setopt(curl, CURLOPT_URL, endpoints.membership);
 	
 	resource->modules.size = sizeof(struct Module) * array_size;
-	resource->modules.items = malloc(resource->modules.size);
+	resource->modules.items = memory_alloc(MEMORY_CATALOG, resource->modules.size);
 	
 	if (resource->modules.items == NULL) {
 		return UERR_MEMORY_ALLOCATE_FAILURE;
@@ -579,8 +830,8 @@ static int get_modules(
 		const int is_locked = json_boolean_value(obj);
 		
 		struct Module module = {
-			.id = malloc(strlen(id) + 1),
-			.name = malloc(strlen(name) + 1),
+			.id = memory_strdup(MEMORY_CATALOG, id),
+			.name = memory_strdup(MEMORY_CATALOG, name),
 			.is_locked = is_locked
 		};
 		
@@ -588,9 +839,6 @@ static int get_modules(
 			return UERR_MEMORY_ALLOCATE_FAILURE;
 		}
 		
-		strcpy(module.id, id);
-		strcpy(module.name, name);
-		
 		obj = json_object_get(item, "pages");
 		
 		if (obj == NULL) {
@@ -606,7 +854,7 @@ static int get_modules(
 		const size_t array_size = json_array_size(obj);
 		
 		module.pages.size = sizeof(struct Page) * array_size;
-		module.pages.items = malloc(module.pages.size);
+		module.pages.items = memory_alloc(MEMORY_CATALOG, module.pages.size);
 		
 		if (module.pages.items == NULL) {
 			return UERR_MEMORY_ALLOCATE_FAILURE;
@@ -642,25 +890,20 @@ static int get_modules(
 			const char* const name = json_string_value(obj);
 			
 			struct Page page = {
-				.id = malloc(strlen(hash) + 1),
-				.name = malloc(strlen(name) + 1)
+				.id = memory_strdup(MEMORY_CATALOG, hash),
+				.name = memory_strdup(MEMORY_CATALOG, name)
 			};
 			
 			if (page.id == NULL || page.name == NULL) {
 				return UERR_MEMORY_ALLOCATE_FAILURE;
 			}
 			
-			strcpy(page.id, hash);
-			strcpy(page.name, name);
-			
 			module.pages.items[module.pages.offset++] = page;
 		}
 		
 		resource->modules.items[resource->modules.offset++] = module;
 	}
 	
-	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, NULL);
-	curl_easy_setopt(curl, CURLOPT_WRITEDATA, NULL);
 	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, NULL);
 	curl_easy_setopt(curl, CURLOPT_URL, NULL);
 	
@@ -669,64 +912,24 @@ static int get_modules(
 }
 
 static int get_page(
-	const struct Credentials* const credentials,
 	const struct Resource* const resource,
 	struct Page* const page
 ) {
 	
-	char authorization[strlen(HTTP_AUTHENTICATION_BEARER) + strlen(SPACE) + strlen(credentials->access_token) + 1];
-	strcpy(authorization, HTTP_AUTHENTICATION_BEARER);
-	strcat(authorization, SPACE);
-	strcat(authorization, credentials->access_token);
-	
-	const char* const headers[][2] = {
-		{HTTP_HEADER_AUTHORIZATION, authorization},
-		{HTTP_HEADER_CLUB, resource->subdomain},
-		{HTTP_HEADER_REFERER, "https://hotmart.com"}
-	};
-	
 	struct curl_slist* list __attribute__((__cleanup__(curl_slistp_free_all))) = NULL;
 	
-	for (size_t index = 0; index < sizeof(headers) / sizeof(*headers); index++) {
-		const char** const header = (const char**) headers[index];
-		const char* const key = header[0];
-		const char* const value = header[1];
-		
-		char item[strlen(key) + strlen(HTTP_HEADER_SEPARATOR) + strlen(value) + 1];
-		strcpy(item, key);
-		strcat(item, HTTP_HEADER_SEPARATOR);
-		strcat(item, value);
-		
-		struct curl_slist* tmp = curl_slist_append(list, item);
-		
-		if (tmp == NULL) {
-			return UERR_CURL_FAILURE;
-		}
-		
-		list = tmp;
-	}
-	
-	struct String string __attribute__((__cleanup__(string_free))) = {0};
-	
-	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_write_cb);
-	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &string);
-	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, list);
-	
-	char url[strlen(HOTMART_PAGE_ENDPOINT) + strlen(SLASH) + strlen(page->id) + 1];
-	strcpy(url, HOTMART_PAGE_ENDPOINT);
+	char url[strlen(endpoints.page) + strlen(SLASH) + strlen(page->id) + 1];
+	strcpy(url, endpoints.page);
 	strcat(url, SLASH);
 	strcat(url, page->id);
 	
 	curl_easy_setopt(curl, CURLOPT_URL, url);
 	
-	if (curl_easy_perform(curl) != CURLE_OK) {
-		return UERR_CURL_FAILURE;
-	}
+	json_auto_t* tree = NULL;
+	const int status = api_load(curl, api_multi_handle, &list, resource->subdomain, HOTMART_REFERER, &tree);
 	
-	json_auto_t* tree = json_loads(string.s, 0, NULL);
-	
-	if (tree == NULL) {
-		return UERR_JSON_CANNOT_PARSE;
+	if (status != UERR_SUCCESS) {
+		return status;
 	}
 	
 	const json_t* obj = json_object_get(tree, "mediasSrc");
@@ -741,7 +944,7 @@ static int get_page(
 		const size_t array_size = json_array_size(obj);
 		
 		page->medias.size = sizeof(struct Media) * array_size;
-		page->medias.items = malloc(page->medias.size);
+		page->medias.items = memory_alloc(MEMORY_CATALOG, page->medias.size);
 		
 		if (page->medias.items == NULL) {
 			return UERR_MEMORY_ALLOCATE_FAILURE;
@@ -766,10 +969,20 @@ static int get_page(
 			
 			struct String string __attribute__((__cleanup__(string_free))) = {0};
 			
+			curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_write_cb);
 			curl_easy_setopt(curl, CURLOPT_WRITEDATA, &string);
+			curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, curl_header_cb);
+			curl_easy_setopt(curl, CURLOPT_HEADERDATA, &string);
 			curl_easy_setopt(curl, CURLOPT_URL, media_page);
 			
-			if (curl_easy_perform(curl) != CURLE_OK) {
+			const CURLcode code = curl_easy_perform(curl);
+			metrics_record(curl, TRANSFER_PLAYER_PAGE);
+			TRACE_TRANSFER(curl, "player_page");
+			
+			curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, NULL);
+			curl_easy_setopt(curl, CURLOPT_HEADERDATA, NULL);
+			
+			if (code != CURLE_OK) {
 				return UERR_CURL_FAILURE;
 			}
 			
@@ -779,9 +992,23 @@ static int get_page(
 				return UERR_STRSTR_FAILURE;
 			}
 			
-			const char* const start = strstr(ptr, HTTPS_SCHEME);
+			const char* start = strstr(ptr, HTTPS_SCHEME);
+			
+			/* Servers other than Hotmart's, such as a local mock, may serve the playlist over plain HTTP */
+			if (start == NULL) {
+				start = strstr(ptr, HTTP_SCHEME);
+			}
+			
+			if (start == NULL) {
+				return UERR_STRSTR_FAILURE;
+			}
+			
 			const char* const end = strstr(start, QUOTATION_MARK);
 			
+			if (end == NULL) {
+				return UERR_STRSTR_FAILURE;
+			}
+			
 			size_t size = (size_t) (end - start);
 			
 			char url[size + 1];
@@ -803,15 +1030,13 @@ static int get_page(
 			}
 			
 			struct Media media = {
-				.url = malloc(strlen(url) + 1)
+				.url = memory_strdup(MEMORY_CATALOG, url)
 			};
 			
 			if (media.url == NULL) {
 				return UERR_MEMORY_ALLOCATE_FAILURE;
 			}
 			
-			strcpy(media.url, url);
-			
 			page->medias.items[page->medias.offset++] = media;
 		}
 		
@@ -829,7 +1054,7 @@ static int get_page(
 		const size_t array_size = json_array_size(obj);
 		
 		page->attachments.size = sizeof(struct Attachment) * array_size;
-		page->attachments.items = malloc(page->attachments.size);
+		page->attachments.items = memory_alloc(MEMORY_CATALOG, page->attachments.size);
 		
 		if (page->attachments.items == NULL) {
 			return UERR_MEMORY_ALLOCATE_FAILURE;
@@ -866,26 +1091,20 @@ static int get_page(
 			
 			const char* const id = json_string_value(obj);
 			
-			char url[strlen(HOTMART_ATTACHMENT_ENDPOINT) + strlen(SLASH) + strlen(id) + strlen(SLASH) + 8 + 1];
-			strcpy(url, HOTMART_ATTACHMENT_ENDPOINT);
+			char url[strlen(endpoints.attachment) + strlen(SLASH) + strlen(id) + strlen(SLASH) + 8 + 1];
+			strcpy(url, endpoints.attachment);
 			strcat(url, SLASH);
 			strcat(url, id);
 			strcat(url, SLASH);
 			strcat(url, "download");
 			
-			struct String string __attribute__((__cleanup__(string_free))) = {0};
-			
-			curl_easy_setopt(curl, CURLOPT_WRITEDATA, &string);
 			curl_easy_setopt(curl, CURLOPT_URL, url);
 			
-			if (curl_easy_perform(curl) != CURLE_OK) {
-				return UERR_CURL_FAILURE;
-			}
+			json_auto_t* subtree = NULL;
+			const int status = api_load(curl, api_multi_handle, &list, resource->subdomain, HOTMART_REFERER, &subtree);
 			
-			json_auto_t* subtree = json_loads(string.s, 0, NULL);
-			
-			if (tree == NULL) {
-				return UERR_JSON_CANNOT_PARSE;
+			if (status != UERR_SUCCESS) {
+				return status;
 			}
 			
 			obj = json_object_get(subtree, "directDownloadUrl");
@@ -901,17 +1120,15 @@ static int get_page(
 			const char* const download_url = json_string_value(obj);
 			
 			struct Attachment attachment = {
-				.url = malloc(strlen(download_url) + 1),
-				.extension = malloc(strlen(file_extension) + 1)
+				.id = memory_strdup(MEMORY_CATALOG, id),
+				.url = memory_strdup(MEMORY_CATALOG, download_url),
+				.extension = memory_strdup(MEMORY_CATALOG, file_extension)
 			};
 			
-			if (attachment.url == NULL || attachment.extension == NULL) {
+			if (attachment.id == NULL || attachment.url == NULL || attachment.extension == NULL) {
 				return UERR_MEMORY_ALLOCATE_FAILURE;
 			}
 			
-			strcpy(attachment.url, download_url);
-			strcpy(attachment.extension, file_extension);
-			
 			page->attachments.items[page->attachments.offset++] = attachment;
 		}
 	}
@@ -925,6 +1142,262 @@ static int get_page(
 	
 }
 
+static int accounts_save(const char* const filename, const struct Credentials* const credentials) {
+	/*
+	Stores the credentials in the accounts file, replacing the entry of the same user if there is one.
+	*/
+	
+	json_auto_t* tree = NULL;
+	
+	if (file_exists(filename)) {
+		tree = json_load_file(filename, 0, NULL);
+		
+		if (tree == NULL || !json_is_array(tree)) {
+			return UERR_JSON_CANNOT_PARSE;
+		}
+	} else {
+		tree = json_array();
+		
+		if (tree == NULL) {
+			return UERR_MEMORY_ALLOCATE_FAILURE;
+		}
+	}
+	
+	json_t* obj = NULL;
+	
+	size_t index = 0;
+	json_t* item = NULL;
+	
+	json_array_foreach(tree, index, item) {
+		const json_t* const subobj = json_object_get(item, "username");
+		
+		if (subobj != NULL && json_is_string(subobj) && strcmp(json_string_value(subobj), credentials->username) == 0) {
+			obj = item;
+			break;
+		}
+	}
+	
+	if (obj == NULL) {
+		obj = json_object();
+		
+		if (obj == NULL || json_array_append_new(tree, obj) != 0) {
+			return UERR_MEMORY_ALLOCATE_FAILURE;
+		}
+	}
+	
+	json_object_set_new(obj, "username", json_string(credentials->username));
+	json_object_set_new(obj, "access_token", json_string(credentials->access_token));
+	json_object_set_new(obj, "refresh_token", json_string(credentials->refresh_token));
+	json_object_set_new(obj, "expires_at", json_integer(credentials->expires_at));
+	
+	FILE* const file = fopen(filename, "wb");
+	
+	if (file == NULL) {
+		return UERR_MEMORY_ALLOCATE_FAILURE;
+	}
+	
+	char* const buffer = json_dumps(tree, JSON_COMPACT);
+	
+	if (buffer == NULL) {
+		fclose(file);
+		return UERR_MEMORY_ALLOCATE_FAILURE;
+	}
+	
+	const size_t buffer_size = strlen(buffer);
+	const size_t wsize = fwrite(buffer, sizeof(*buffer), buffer_size, file);
+	
+	free(buffer);
+	fclose(file);
+	
+	if (wsize != buffer_size) {
+		return UERR_MEMORY_ALLOCATE_FAILURE;
+	}
+	
+	return UERR_SUCCESS;
+	
+}
+
+static void accounts_refreshed(const struct Credentials* const credentials, void* const data) {
+	/*
+	Called by the token refresher whenever it obtains a new access token.
+	*/
+	
+	pthread_mutex_lock(&refresher.lock);
+	accounts_save((const char*) data, credentials);
+	pthread_mutex_unlock(&refresher.lock);
+	
+}
+
+static void* revalidate_resources(void* ptr) {
+	/*
+	Fetches the resource list again while the user is choosing from the cached one,
+	so that the cache is up to date on the next run.
+	*/
+	
+	struct ResourcesRevalidation* const obj = (struct ResourcesRevalidation*) ptr;
+	
+	struct Resources resources = {0};
+	
+	TRACE_BEGIN(start);
+	obj->code = get_resources(obj->handle, obj->multi, &resources);
+	TRACE_END(start, "get_resources", NULL);
+	
+	if (obj->code == UERR_SUCCESS) {
+		obj->code = resources_cache_save(obj->filename, obj->username, token_get_expires_at(&refresher), &resources);
+	}
+	
+	resources_free(&resources);
+	
+	return NULL;
+	
+}
+
+static void resources_revalidation_stop(struct ResourcesRevalidation* const obj) {
+	/*
+	Waits for the revalidation to finish, if it was started, and releases its handles.
+	*/
+	
+	if (obj->running) {
+		pthread_join(obj->thread, NULL);
+		obj->running = 0;
+	}
+	
+	curl_easy_cleanup(obj->handle);
+	obj->handle = NULL;
+	
+	curl_multi_cleanup(obj->multi);
+	obj->multi = NULL;
+	
+}
+
+static CURL* media_handle_init(const struct curl_blob* const blob, struct curl_slist* const resolve_list, const char* const url) {
+	/*
+	Creates a handle for fetching media segments and keys from the CDN.
+	*/
+	
+	CURL* const handle = curl_easy_init();
+	
+	if (handle == NULL) {
+		return NULL;
+	}
+	
+	curl_easy_setopt(handle, CURLOPT_FAILONERROR, 1L);
+	curl_easy_setopt(handle, CURLOPT_SSL_VERIFYPEER, 0L);
+	curl_easy_setopt(handle, CURLOPT_DOH_SSL_VERIFYPEER, 0L);
+	curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+	curl_easy_setopt(handle, CURLOPT_USERAGENT, HTTP_DEFAULT_USER_AGENT);
+	curl_easy_setopt(handle, CURLOPT_IPRESOLVE, CURL_IPRESOLVE_V4);
+	curl_easy_setopt(handle, CURLOPT_ACCEPT_ENCODING, NULL);
+	curl_easy_setopt(handle, CURLOPT_CAPATH, NULL);
+	curl_easy_setopt(handle, CURLOPT_CAINFO, NULL);
+	curl_easy_setopt(handle, CURLOPT_CAINFO_BLOB, blob);
+	curl_easy_setopt(handle, CURLOPT_RESOLVE, resolve_list);
+	curl_easy_setopt(handle, CURLOPT_URL, url);
+	
+	return handle;
+	
+}
+
+static char* get_staging_filename(const int unique, const char* const name) {
+	/*
+	Returns the name an output is written under before being published: a unique name when it
+	goes to the scratch directory, or the final name with a ".part" suffix otherwise.
+	*/
+	
+	static size_t counter = 0;
+	
+	if (!unique) {
+		char* const staging = memory_alloc(MEMORY_PATHS, strlen(name) + strlen(DOT) + strlen(PART_FILE_EXTENSION) + 1);
+		
+		if (staging == NULL) {
+			return NULL;
+		}
+		
+		strcpy(staging, name);
+		strcat(staging, DOT);
+		strcat(staging, PART_FILE_EXTENSION);
+		
+		return staging;
+	}
+	
+	#ifdef _WIN32
+		const unsigned long pid = (unsigned long) GetCurrentProcessId();
+	#else
+		const unsigned long pid = (unsigned long) getpid();
+	#endif
+	
+	const char* const format = "sparklec-%lu-%zu%s%s";
+	const int size = snprintf(NULL, 0, format, pid, counter, DOT, PART_FILE_EXTENSION);
+	
+	char* const staging = memory_alloc(MEMORY_PATHS, (size_t) size + 1);
+	
+	if (staging == NULL) {
+		return NULL;
+	}
+	
+	snprintf(staging, (size_t) size + 1, format, pid, counter, DOT, PART_FILE_EXTENSION);
+	counter++;
+	
+	return staging;
+	
+}
+
+static char* get_media_name(const struct Page* const page) {
+	/*
+	Returns the name the video of "page" is saved under.
+	*/
+	
+	char filename[strlen(page->name) + 1];
+	strcpy(filename, page->name);
+	normalize_filename(filename);
+	
+	char* const name = memory_alloc(MEMORY_PATHS, strlen(filename) + strlen(DOT) + strlen(MP4_FILE_EXTENSION) + 1);
+	
+	if (name == NULL) {
+		return NULL;
+	}
+	
+	strcpy(name, filename);
+	strcat(name, DOT);
+	strcat(name, MP4_FILE_EXTENSION);
+	
+	return name;
+	
+}
+
+static char* get_attachment_name(const struct Page* const page, const size_t index) {
+	/*
+	Returns the name the attachment at "index" of "page" is saved under. Attachments are
+	numbered when a page has more than one.
+	*/
+	
+	const struct Attachment* const attachment = &page->attachments.items[index];
+	
+	char filename[strlen(page->name) + 1];
+	strcpy(filename, page->name);
+	normalize_filename(filename);
+	
+	char number[32] = {'\0'};
+	
+	if (page->attachments.offset > 1) {
+		snprintf(number, sizeof(number), "%zu%s%s", index + 1, DOT, SPACE);
+	}
+	
+	char* const name = memory_alloc(MEMORY_PATHS, strlen(number) + strlen(filename) + strlen(DOT) + strlen(attachment->extension) + 1);
+	
+	if (name == NULL) {
+		return NULL;
+	}
+	
+	strcpy(name, number);
+	strcat(name, filename);
+	strcat(name, DOT);
+	strcat(name, attachment->extension);
+	
+	return name;
+	
+}
+
 static int ask_user_credentials(struct Credentials* const obj) {
 	
 	char username[MAX_INPUT_SIZE + 1] = {'\0'};
@@ -954,7 +1427,11 @@ static int ask_user_credentials(struct Credentials* const obj) {
 	
 	*strchr(password, '\n') = '\0';
 	
-	if (authorize(username, password, obj) != UERR_SUCCESS) {
+	TRACE_BEGIN(auth_start);
+	const int status = authorize(username, password, obj);
+	TRACE_END(auth_start, "auth", NULL);
+	
+	if (status != UERR_SUCCESS) {
 		fprintf(stderr, "- Não foi possível realizar a autenticação!\r\n");
 		return 0;
 	}
@@ -974,23 +1451,590 @@ static int ask_user_credentials(struct Credentials* const obj) {
 }
 
 #if defined(WIN32) && defined(UNICODE)
-	#define main wmain
+	static char** arguments_from_wide(const int argc, wchar_t* const wargv[]) {
+		/*
+		Converts the arguments to UTF-8. They are kept for the whole run, like argv itself, as
+		the options point into them.
+		*/
+		
+		char** const argv = malloc(sizeof(*argv) * ((size_t) argc + 1));
+		
+		if (argv == NULL) {
+			return NULL;
+		}
+		
+		for (int index = 0; index < argc; index++) {
+			const int size = WideCharToMultiByte(CP_UTF8, 0, wargv[index], -1, NULL, 0, NULL, NULL);
+			
+			argv[index] = malloc((size_t) size);
+			
+			if (argv[index] == NULL) {
+				return NULL;
+			}
+			
+			WideCharToMultiByte(CP_UTF8, 0, wargv[index], -1, argv[index], size, NULL, NULL);
+		}
+		
+		argv[argc] = NULL;
+		
+		return argv;
+		
+	}
 #endif
 
-int main() {
+static void plan_add_unsized(struct Plan* const plan, const int missing) {
+	
+	plan->total.unsized++;
+	
+	if (missing) {
+		plan->missing.unsized++;
+	}
+	
+}
+
+static int plan_item_start(
+	struct PlanItem* const item,
+	const char* const url,
+	const struct curl_blob* const blob,
+	struct curl_slist* const resolve_list
+) {
+	
+	if (item->handle == NULL) {
+		item->handle = media_handle_init(blob, resolve_list, url);
+		
+		if (item->handle == NULL) {
+			return 0;
+		}
+		
+		curl_easy_setopt(item->handle, CURLOPT_TIMEOUT, 60L);
+		curl_easy_setopt(item->handle, CURLOPT_PRIVATE, item);
+		
+		if (item->stage == PLAN_ATTACHMENT) {
+			curl_easy_setopt(item->handle, CURLOPT_NOBODY, 1L);
+		} else {
+			curl_easy_setopt(item->handle, CURLOPT_WRITEFUNCTION, curl_write_cb);
+			curl_easy_setopt(item->handle, CURLOPT_WRITEDATA, &item->data);
+			curl_easy_setopt(item->handle, CURLOPT_HEADERFUNCTION, curl_header_cb);
+			curl_easy_setopt(item->handle, CURLOPT_HEADERDATA, &item->data);
+		}
+	} else {
+		curl_multi_remove_handle(multi_handle, item->handle);
+		curl_easy_setopt(item->handle, CURLOPT_URL, url);
+	}
+	
+	item->data.slength = 0;
+	
+	if (item->data.s != NULL) {
+		*item->data.s = '\0';
+	}
+	
+	return curl_multi_add_handle(multi_handle, item->handle) == CURLM_OK;
+	
+}
+
+static int plan_item_complete(
+	struct PlanItem* const item,
+	const CURLcode result,
+	const struct curl_blob* const blob,
+	struct curl_slist* const resolve_list,
+	struct Plan* const plan
+) {
+	/*
+	Accounts for a finished transfer. Returns whether another one was started for the same item,
+	as happens when a master playlist is followed to the media playlist of its best variant.
+	*/
+	
+	if (item->stage == PLAN_ATTACHMENT) {
+		metrics_record(item->handle, TRANSFER_ATTACHMENT);
+		TRACE_TRANSFER(item->handle, "attachment");
+		
+		curl_off_t length = -1;
+		
+		if (result == CURLE_OK) {
+			curl_easy_getinfo(item->handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+		}
+		
+		if (length < 0) {
+			plan_add_unsized(plan, item->missing);
+			return 0;
+		}
+		
+		plan->total.attachment_bytes += (uint64_t) length;
+		
+		if (item->missing) {
+			plan->missing.attachment_bytes += (uint64_t) length;
+		}
+		
+		return 0;
+	}
+	
+	metrics_record(item->handle, TRANSFER_PLAYLIST);
+	TRACE_TRANSFER(item->handle, "playlist");
+	
+	struct Tags tags = {0};
+	
+	if (result != CURLE_OK || item->data.s == NULL || m3u8_parse(&tags, item->data.s) != UERR_SUCCESS) {
+		m3u8_free(&tags);
+		plan_add_unsized(plan, item->missing);
+		
+		return 0;
+	}
+	
+	if (item->stage == PLAN_MASTER_PLAYLIST) {
+		/* The same variant the download would pick: the widest, then the one with the highest bandwidth */
+		const struct Tag* variant = NULL;
+		int variant_width = -1;
+		uint64_t variant_bandwidth = 0;
+		
+		for (size_t index = 0; index < tags.offset; index++) {
+			const struct Tag* const tag = &tags.items[index];
+			
+			if (tag->type != EXT_X_STREAM_INF || tag->uri == NULL) {
+				continue;
+			}
+			
+			const struct Attribute* const resolution = attributes_get(&tag->attributes, "RESOLUTION");
+			const struct Attribute* const bandwidth = attributes_get(&tag->attributes, "BANDWIDTH");
+			
+			const int width = resolution == NULL || resolution->value == NULL ? 0 : atoi(resolution->value);
+			const uint64_t value = bandwidth == NULL || bandwidth->value == NULL ? 0 : strtoull(bandwidth->value, NULL, 10);
+			
+			if (width > variant_width || (width == variant_width && value > variant_bandwidth)) {
+				variant = tag;
+				variant_width = width;
+				variant_bandwidth = value;
+			}
+		}
+		
+		/* A playlist without variants already lists the segments */
+		if (variant != NULL) {
+			CURLU* cu __attribute__((__cleanup__(curlupp_free))) = curl_url();
+			curl_url_set(cu, CURLUPART_URL, item->url, 0);
+			curl_url_set(cu, CURLUPART_URL, variant->uri, 0);
+			
+			char* url __attribute__((__cleanup__(curlcharpp_free))) = NULL;
+			curl_url_get(cu, CURLUPART_URL, &url, 0);
+			
+			m3u8_free(&tags);
+			
+			item->stage = PLAN_MEDIA_PLAYLIST;
+			item->bandwidth = variant_bandwidth;
+			
+			if (url == NULL || !plan_item_start(item, url, blob, resolve_list)) {
+				plan_add_unsized(plan, item->missing);
+				return 0;
+			}
+			
+			return 1;
+		}
+	}
+	
+	struct PlanCounts counts = {0};
+	
+	for (size_t index = 0; index < tags.offset; index++) {
+		const struct Tag* const tag = &tags.items[index];
+		
+		if (tag->type == EXTINF && tag->uri != NULL) {
+			counts.segments++;
+			counts.duration += tag->value == NULL ? 0 : strtod(tag->value, NULL);
+		} else if (tag->type == EXT_X_KEY) {
+			const struct Attribute* const uri = attributes_get(&tag->attributes, "URI");
+			
+			if (uri == NULL || uri->value == NULL) {
+				continue;
+			}
+			
+			/* Keys are fetched once per URI */
+			int seen = 0;
+			
+			for (size_t position = 0; position < index && !seen; position++) {
+				const struct Tag* const previous = &tags.items[position];
+				const struct Attribute* const previous_uri = previous->type == EXT_X_KEY ? attributes_get(&previous->attributes, "URI") : NULL;
+				
+				seen = previous_uri != NULL && previous_uri->value != NULL && strcmp(previous_uri->value, uri->value) == 0;
+			}
+			
+			counts.keys += !seen;
+		}
+	}
+	
+	m3u8_free(&tags);
+	
+	counts.media_bytes = (uint64_t) ((double) item->bandwidth / 8 * counts.duration);
+	
+	if (item->bandwidth == 0) {
+		plan_add_unsized(plan, item->missing);
+	}
+	
+	for (int index = 0; index < 1 + item->missing; index++) {
+		struct PlanCounts* const dst = index == 0 ? &plan->total : &plan->missing;
+		
+		dst->segments += counts.segments;
+		dst->keys += counts.keys;
+		dst->duration += counts.duration;
+		dst->media_bytes += counts.media_bytes;
+	}
+	
+	return 0;
+	
+}
+
+static int plan_transfers(
+	struct PlanItem* const items,
+	const size_t count,
+	const struct curl_blob* const blob,
+	struct curl_slist* const resolve_list,
+	struct Plan* const plan
+) {
+	/*
+	Runs the playlist and attachment requests of the plan with up to PLAN_MAX_TRANSFERS of them
+	in flight. A failed request only leaves its item out of the estimates.
+	*/
+	
+	size_t next = 0;
+	size_t running = 0;
+	
+	metrics_gauge_set(GAUGE_CONCURRENCY_WINDOW, PLAN_MAX_TRANSFERS);
+	
+	while (next < count || running > 0) {
+		while (running < PLAN_MAX_TRANSFERS && next < count) {
+			struct PlanItem* const item = &items[next++];
+			
+			if (plan_item_start(item, item->url, blob, resolve_list)) {
+				running++;
+			} else {
+				plan_add_unsized(plan, item->missing);
+			}
+		}
+		
+		int still_running = 0;
+		CURLMcode mc = curl_multi_perform(multi_handle, &still_running);
+		
+		metrics_gauge_set(GAUGE_ACTIVE_TRANSFERS, still_running);
+		
+		CURLMsg* msg = NULL;
+		int msgs_left = 0;
+		
+		while ((msg = curl_multi_info_read(multi_handle, &msgs_left))) {
+			if (msg->msg != CURLMSG_DONE) {
+				continue;
+			}
+			
+			CURL* const handle = msg->easy_handle;
+			const CURLcode result = msg->data.result;
+			
+			struct PlanItem* item = NULL;
+			curl_easy_getinfo(handle, CURLINFO_PRIVATE, (char**) &item);
+			
+			if (!plan_item_complete(item, result, blob, resolve_list, plan)) {
+				curl_multi_remove_handle(multi_handle, handle);
+				curl_easy_cleanup(handle);
+				
+				item->handle = NULL;
+				string_free(&item->data);
+				
+				running--;
+			}
+		}
+		
+		if (running > 0 && mc == CURLM_OK) {
+			mc = curl_multi_poll(multi_handle, NULL, 0, 1000, NULL);
+		}
+		
+		if (mc != CURLM_OK) {
+			metrics_gauge_set(GAUGE_ACTIVE_TRANSFERS, 0);
+			return UERR_CURL_FAILURE;
+		}
+	}
+	
+	metrics_gauge_set(GAUGE_ACTIVE_TRANSFERS, 0);
+	
+	return UERR_SUCCESS;
+	
+}
+
+static int plan_resource(
+	struct Resource* const resource,
+	const char* const root,
+	const int verify,
+	const struct curl_blob* const blob,
+	struct curl_slist* const resolve_list,
+	struct Plan* const plan
+) {
+	/*
+	Fills "plan" with what downloading "resource" into "root" would take. Nothing is written:
+	the catalog and playlists are fetched and attachments are only probed with HEAD requests.
+	*/
+	
+	char directory[strlen(resource->name) + 1];
+	strcpy(directory, resource->name);
+	normalize_filename(directory);
+	
+	char resource_path[strlen(root) + strlen(PATH_SEPARATOR) + strlen(directory) + 1];
+	strcpy(resource_path, root);
+	strcat(resource_path, PATH_SEPARATOR);
+	strcat(resource_path, directory);
+	
+	struct PathSet existing __attribute__((__cleanup__(pathset_free))) = {0};
+	
+	if (directory_exists(resource_path) && !pathset_scan(&existing, resource_path, 3)) {
+		return UERR_FILE_READ_FAILURE;
+	}
+	
+	size_t items_count = 0;
+	
+	for (size_t index = 0; index < resource->modules.offset; index++) {
+		struct Module* const module = &resource->modules.items[index];
+		
+		if (module->is_locked) {
+			continue;
+		}
+		
+		printf("+ Obtendo lista de páginas do módulo '%s'\r\n", module->name);
+		
+		for (size_t index = 0; index < module->pages.offset; index++) {
+			struct Page* const page = &module->pages.items[index];
+			
+			TRACE_BEGIN(page_start);
+			const int status = get_page(resource, page);
+			TRACE_END(page_start, "get_page", page->name);
+			
+			if (status != UERR_SUCCESS) {
+				return status;
+			}
+			
+			items_count += page->medias.offset + page->attachments.offset;
+		}
+	}
+	
+	struct PlanItem* const items = calloc(items_count == 0 ? 1 : items_count, sizeof(*items));
+	
+	if (items == NULL) {
+		return UERR_MEMORY_ALLOCATE_FAILURE;
+	}
+	
+	size_t items_offset = 0;
+	int status = UERR_SUCCESS;
+	
+	for (size_t index = 0; index < resource->modules.offset && status == UERR_SUCCESS; index++) {
+		const struct Module* const module = &resource->modules.items[index];
+		
+		if (module->is_locked) {
+			continue;
+		}
+		
+		char module_directory[strlen(module->name) + 1];
+		strcpy(module_directory, module->name);
+		normalize_filename(module_directory);
+		
+		for (size_t index = 0; index < module->pages.offset && status == UERR_SUCCESS; index++) {
+			const struct Page* const page = &module->pages.items[index];
+			
+			char page_directory[strlen(page->name) + 1];
+			strcpy(page_directory, page->name);
+			normalize_filename(page_directory);
+			
+			int page_missing = 0;
+			
+			for (size_t position = 0; position < page->medias.offset + page->attachments.offset; position++) {
+				const int is_media = position < page->medias.offset;
+				
+				char* const name = is_media ? get_media_name(page) : get_attachment_name(page, position - page->medias.offset);
+				
+				if (name == NULL) {
+					status = UERR_MEMORY_ALLOCATE_FAILURE;
+					break;
+				}
+				
+				/* Outputs are keyed by their path below the product directory, as in the existing set */
+				char key[strlen(module_directory) + strlen(PATH_SEPARATOR) + strlen(page_directory) + strlen(PATH_SEPARATOR) + strlen(name) + 1];
+				strcpy(key, module_directory);
+				strcat(key, PATH_SEPARATOR);
+				strcat(key, page_directory);
+				strcat(key, PATH_SEPARATOR);
+				strcat(key, name);
+				
+				memory_free(name);
+				
+				char filename[strlen(resource_path) + strlen(PATH_SEPARATOR) + strlen(key) + 1];
+				strcpy(filename, resource_path);
+				strcat(filename, PATH_SEPARATOR);
+				strcat(filename, key);
+				
+				uint64_t size = 0;
+				
+				const int present = (
+					pathset_contains(&existing, key) &&
+					get_file_size(filename, &size) &&
+					output_matches_record(filename, size, verify)
+				);
+				
+				struct PlanItem* const item = &items[items_offset++];
+				
+				item->missing = !present;
+				
+				if (is_media) {
+					item->stage = PLAN_MASTER_PLAYLIST;
+					item->url = page->medias.items[position].url;
+				} else {
+					item->stage = PLAN_ATTACHMENT;
+					item->url = page->attachments.items[position - page->medias.offset].url;
+				}
+				
+				page_missing = page_missing || !present;
+			}
+			
+			plan->total.pages++;
+			plan->total.medias += page->medias.offset;
+			plan->total.attachments += page->attachments.offset;
+			
+			if (page_missing) {
+				plan->missing.pages++;
+			}
+		}
+	}
+	
+	for (size_t index = 0; index < items_offset; index++) {
+		const struct PlanItem* const item = &items[index];
+		
+		if (!item->missing) {
+			continue;
+		}
+		
+		if (item->stage == PLAN_ATTACHMENT) {
+			plan->missing.attachments++;
+		} else {
+			plan->missing.medias++;
+		}
+	}
+	
+	if (status == UERR_SUCCESS) {
+		printf("+ Verificando %zu lista(s) de reprodução e anexo(s)\r\n", items_offset);
+		status = plan_transfers(items, items_offset, blob, resolve_list, plan);
+	}
+	
+	free(items);
+	
+	return status;
+	
+}
+
+#if defined(WIN32) && defined(UNICODE)
+	int wmain(int argc, wchar_t* wargv[]) {
+#else
+	int main(int argc, char* argv[]) {
+#endif
 	
 	#ifdef WIN32
 		SetConsoleOutputCP(CP_UTF8);
 		SetConsoleCP(CP_UTF8);
 	#endif
 	
+	#if defined(WIN32) && defined(UNICODE)
+		char** const argv = arguments_from_wide(argc, wargv);
+		
+		if (argv == NULL) {
+			fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
+			return EXIT_FAILURE;
+		}
+	#endif
+	
+	struct Options options __attribute__((__cleanup__(options_free))) = {0};
+	
+	if (options_parse(&options, argc, argv) != UERR_SUCCESS) {
+		options_usage(stderr, argv[0]);
+		return EXIT_FAILURE;
+	}
+	
+	if (options.memory_stats) {
+		/* Before any other thread exists, so that SIGUSR1 is only ever delivered to the reporter */
+		if (!memory_watch()) {
+			fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
+			return EXIT_FAILURE;
+		}
+		
+		atexit(memory_shutdown);
+	}
+	
+	/* Registered before the remux pool and the exporters, so that it is closed after them */
+	if (options.event_log_filename != NULL) {
+		if (eventlog_open(options.event_log_filename) != UERR_SUCCESS) {
+			fprintf(stderr, "- Não foi possível criar o arquivo '%s'!\r\n", options.event_log_filename);
+			return EXIT_FAILURE;
+		}
+		
+		atexit(eventlog_close);
+	}
+	
+	if (options.report_filename != NULL) {
+		report_filename = options.report_filename;
+		
+		metrics_enable();
+		atexit(metrics_shutdown);
+	}
+	
+	if (options.metrics_filename != NULL || options.metrics_port != 0) {
+		if (exporter_start(options.metrics_filename, (int) options.metrics_port) != UERR_SUCCESS) {
+			fprintf(stderr, "- Não foi possível iniciar a exportação de métricas!\r\n");
+			return EXIT_FAILURE;
+		}
+		
+		atexit(exporter_stop);
+	}
+	
+	progress_init();
+	
+	atexit(endpoints_free);
+	
+	if (!endpoints_init(options.api_url)) {
+		fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
+		return EXIT_FAILURE;
+	}
+	
+	#ifdef SPARKLEC_ENABLE_TRACE
+		if (options.trace_filename != NULL) {
+			if (trace_open(options.trace_filename) != UERR_SUCCESS) {
+				fprintf(stderr, "- Não foi possível criar o arquivo '%s'!\r\n", options.trace_filename);
+				return EXIT_FAILURE;
+			}
+			
+			atexit(trace_close);
+		}
+	#endif
+	
+	if (options.scratch_directory != NULL && !directory_exists(options.scratch_directory)) {
+		fprintf(stderr, "- O diretório '%s' não existe, criando-o\r\n", options.scratch_directory);
+		
+		if (!create_directory(options.scratch_directory)) {
+			fprintf(stderr, "- Ocorreu um erro ao tentar criar o diretório!\r\n");
+			return EXIT_FAILURE;
+		}
+	}
+	
+	struct Directory scratch_directory __attribute__((__cleanup__(directory_close))) = {0};
+	
+	if (options.scratch_directory != NULL && !directory_open(&scratch_directory, options.scratch_directory)) {
+		fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
+		return EXIT_FAILURE;
+	}
+	
+	if (options.selftest_throughput) {
+		/* Runs before the login, since nothing here needs an account or the network */
+		if (selftest_throughput(stdout, options.scratch_directory == NULL ? "." : options.scratch_directory, options.buffer_size) != UERR_SUCCESS) {
+			fprintf(stderr, "- Ocorreu uma falha ao medir a vazão!\r\n");
+			return EXIT_FAILURE;
+		}
+		
+		return EXIT_SUCCESS;
+	}
+	
 	char* const directory = get_configuration_directory();
 	
 	char configuration_directory[strlen(directory) + strlen(A) + 1];
 	strcpy(configuration_directory, directory);
 	strcat(configuration_directory, A);
 	
-	free(directory);
+	memory_free(directory);
 	
 	if (!directory_exists(configuration_directory)) {
 		fprintf(stderr, "- Diretório de configurações não encontrado, criando-o\r\n");
@@ -1006,17 +2050,32 @@ int main() {
 	strcat(accounts_file, PATH_SEPARATOR);
 	strcat(accounts_file, LOCAL_ACCOUNTS_FILENAME);
 	
+	char resources_file[strlen(configuration_directory) + strlen(PATH_SEPARATOR) + strlen(LOCAL_RESOURCES_FILENAME) + 1];
+	strcpy(resources_file, configuration_directory);
+	strcat(resources_file, PATH_SEPARATOR);
+	strcat(resources_file, LOCAL_RESOURCES_FILENAME);
+	
 	curl_global_init(CURL_GLOBAL_ALL);
 	
-	CURLM* multi_handle = curl_multi_init();
+	multi_handle = curl_multi_init();
+	api_multi_handle = curl_multi_init();
 	
-	if (multi_handle == NULL) {
+	if (multi_handle == NULL || api_multi_handle == NULL) {
 		fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
 		return EXIT_FAILURE;
 	}
 	
-	curl_multi_setopt(multi_handle, CURLMOPT_MAX_HOST_CONNECTIONS, (long) 30);
-	curl_multi_setopt(multi_handle, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long) 30);
+	curl_multi_setopt(multi_handle, CURLMOPT_MAX_HOST_CONNECTIONS, (long) MAX_CONNECTIONS);
+	curl_multi_setopt(multi_handle, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long) MAX_CONNECTIONS);
+	
+	metrics_gauge_set(GAUGE_CONCURRENCY_WINDOW, MAX_CONNECTIONS);
+	
+	if (remux_pool_init(&pool, options.remux_jobs, &manifest, options.remux_spool) != UERR_SUCCESS) {
+		fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
+		return EXIT_FAILURE;
+	}
+	
+	atexit(remux_pool_shutdown);
 	
 	curl = curl_easy_init();
 	
@@ -1033,6 +2092,8 @@ int main() {
 	curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
 	curl_easy_setopt(curl, CURLOPT_USERAGENT, HTTP_DEFAULT_USER_AGENT);
 	curl_easy_setopt(curl, CURLOPT_IPRESOLVE, CURL_IPRESOLVE_V4);
+	curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+	curl_easy_setopt(curl, CURLOPT_BUFFERSIZE, (long) options.buffer_size);
 	
 	struct curl_blob blob = {
 		.data = (char*) CACERT,
@@ -1044,8 +2105,12 @@ int main() {
 	
 	struct curl_slist* resolve_list __attribute__((__cleanup__(curl_slistp_free_all))) = NULL;
 	
-	for (size_t index = 0; index < sizeof(HOSTNAMES) / sizeof(*HOSTNAMES); index++) {
-		const char* const hostname = HOSTNAMES[index];
+	/* Entries given with --resolve replace the built-in ones */
+	const char* const* const hostnames = options.resolve_count > 0 ? options.resolve : HOSTNAMES;
+	const size_t hostnames_count = options.resolve_count > 0 ? options.resolve_count : sizeof(HOSTNAMES) / sizeof(*HOSTNAMES);
+	
+	for (size_t index = 0; index < hostnames_count; index++) {
+		const char* const hostname = hostnames[index];
 		
 		struct curl_slist* tmp = curl_slist_append(resolve_list, hostname);
 		
@@ -1112,16 +2177,23 @@ int main() {
 			
 			const char* const refresh_token = json_string_value(subobj);
 			
+			subobj = json_object_get(item, "expires_at");
+			
+			const time_t expires_at = (subobj != NULL && json_is_integer(subobj)) ? (time_t) json_integer_value(subobj) : 0;
+			
 			struct Credentials credentials = {
+				.username = malloc(strlen(username) + 1),
 				.access_token = malloc(strlen(access_token) + 1),
-				.refresh_token = malloc(strlen(refresh_token) + 1)
+				.refresh_token = malloc(strlen(refresh_token) + 1),
+				.expires_at = expires_at
 			};
 			
-			if (credentials.access_token == NULL || credentials.refresh_token == NULL) {
+			if (credentials.username == NULL || credentials.access_token == NULL || credentials.refresh_token == NULL) {
 				fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
 				return EXIT_FAILURE;
 			}
 			
+			strcpy(credentials.username, username);
 			strcpy(credentials.access_token, access_token);
 			strcpy(credentials.refresh_token, refresh_token);
 			
@@ -1156,38 +2228,10 @@ int main() {
 				return EXIT_FAILURE;
 			}
 			
-			FILE* const file = fopen(accounts_file, "wb");
-			
-			if (file == NULL) {
-				fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
-				return EXIT_FAILURE;
-			}
-			
-			json_auto_t* subtree = json_object();
-			json_object_set_new(subtree, "username", json_string(credentials.username));
-			json_object_set_new(subtree, "access_token", json_string(credentials.access_token));
-			json_object_set_new(subtree, "refresh_token", json_string(credentials.refresh_token));
-			
-			json_array_append(tree, subtree);
-			
-			char* const buffer = json_dumps(tree, JSON_COMPACT);
-			
-			if (buffer == NULL) {
-				fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
-				return EXIT_FAILURE;
-			}
-			
-			const size_t buffer_size = strlen(buffer);
-			const size_t wsize = fwrite(buffer, sizeof(*buffer), buffer_size, file);
-			
-			free(buffer);
-			fclose(file);
-			
-			if (wsize != buffer_size) {
+			if (accounts_save(accounts_file, &credentials) != UERR_SUCCESS) {
 				fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
 				return EXIT_FAILURE;
 			}
-			
 		} else {
 			credentials = items[value - 1];
 		}
@@ -1196,48 +2240,75 @@ int main() {
 			return EXIT_FAILURE;
 		}
 		
-		FILE* const file = fopen(accounts_file, "wb");
-		
-		if (file == NULL) {
+		if (accounts_save(accounts_file, &credentials) != UERR_SUCCESS) {
 			fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
 			return EXIT_FAILURE;
 		}
+	}
+	
+	/*
+	The refresher reads the credentials, the accounts file and the token endpoint, so it is
+	stopped on every way out of main, before they go away.
+	*/
+	struct TokenRefresher* refresher_guard __attribute__((__cleanup__(token_refresherpp_free))) = &refresher;
+	
+	if (token_refresher_init(&refresher, &credentials, curl_easy_duphandle(curl), endpoints.token, accounts_refreshed, accounts_file) != UERR_SUCCESS) {
+		fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
+		return EXIT_FAILURE;
+	}
+	
+	if (token_is_expired(&refresher)) {
+		printf("+ Renovando token de acesso expirado\r\n");
 		
-		json_auto_t* tree = json_array();
-		json_auto_t* obj = json_object();
-		json_object_set_new(obj, "username", json_string(credentials.username));
-		json_object_set_new(obj, "access_token", json_string(credentials.access_token));
-		json_object_set_new(obj, "refresh_token", json_string(credentials.refresh_token));
-		
-		json_array_append(tree, obj);
-		
-		char* const buffer = json_dumps(tree, JSON_COMPACT);
+		TRACE_BEGIN(auth_start);
+		const int status = token_refresh(&refresher, NULL);
+		TRACE_END(auth_start, "auth", NULL);
 		
-		if (buffer == NULL) {
-			fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
+		if (status != UERR_SUCCESS) {
+			fprintf(stderr, "- Não foi possível renovar o token de acesso!\r\n");
 			return EXIT_FAILURE;
 		}
+	}
+	
+	if (token_refresher_start(&refresher) != UERR_SUCCESS) {
+		fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
+		return EXIT_FAILURE;
+	}
+	
+	struct Resources resources = {0};
+	
+	/* Joined on every way out of main, as it reads data that lives on this stack */
+	struct ResourcesRevalidation revalidation __attribute__((__cleanup__(resources_revalidation_stop))) = {
+		.filename = resources_file,
+		.username = credentials.username
+	};
+	
+	if (resources_cache_load(resources_file, credentials.username, &resources) == UERR_SUCCESS) {
+		printf("+ Usando lista de produtos em cache\r\n");
 		
-		const size_t buffer_size = strlen(buffer);
-		const size_t wsize = fwrite(buffer, sizeof(*buffer), buffer_size, file);
+		revalidation.handle = curl_easy_duphandle(curl);
+		revalidation.multi = curl_multi_init();
 		
-		free(buffer);
-		fclose(file);
+		revalidation.running = (
+			revalidation.handle != NULL &&
+			revalidation.multi != NULL &&
+			pthread_create(&revalidation.thread, NULL, revalidate_resources, &revalidation) == 0
+		);
+	} else {
+		printf("+ Obtendo lista de produtos\r\n");
 		
-		if (wsize != buffer_size) {
-			fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
+		resources_free(&resources);
+		
+		TRACE_BEGIN(resources_start);
+		const int status = get_resources(curl, api_multi_handle, &resources);
+		TRACE_END(resources_start, "get_resources", NULL);
+		
+		if (status != UERR_SUCCESS) {
+			fprintf(stderr, "- Não foi possível obter a lista de produtos!\r\n");
 			return EXIT_FAILURE;
 		}
 		
-	}
-	
-	printf("+ Obtendo lista de produtos\r\n");
-	
-	struct Resources resources = {0};
-	
-	if (get_resources(&credentials, &resources) != UERR_SUCCESS) {
-		fprintf(stderr, "- Não foi possível obter a lista de produtos!\r\n");
-		return EXIT_FAILURE;
+		resources_cache_save(resources_file, credentials.username, token_get_expires_at(&refresher), &resources);
 	}
 	
 	printf("+ Selecione o que deseja baixar:\r\n\r\n");
@@ -1296,39 +2367,124 @@ int main() {
 		return EXIT_FAILURE;
 	}
 	
+	/*
+	The output tree is walked through open directory handles: each resource, module and page
+	directory is opened once and everything below it is created and looked up relative to it.
+	*/
+	struct Directory root_directory __attribute__((__cleanup__(directory_close))) = {0};
+	
+	if (!directory_open(&root_directory, cwd)) {
+		fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
+		return EXIT_FAILURE;
+	}
+	
+	if (manifest_open(&manifest, cwd, options.plan) != UERR_SUCCESS) {
+		fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
+		return EXIT_FAILURE;
+	}
+	
+	/* Totals of --plan across every product in the queue */
+	struct Plan plan = {0};
+	
+	const uint64_t run_started = eventlog_now();
+	eventlog_emit("run_start", "{s:I, s:b}", "products", (json_int_t) queue_count, "plan", options.plan);
+	
 	for (size_t index = 0; index < queue_count; index++) {
 		struct Resource* resource = &download_queue[index];
 		
 		printf("+ Obtendo lista de módulos do produto '%s'\r\n", resource->name);
 		
-		if (get_modules(&credentials, resource) != UERR_SUCCESS) {
+		TRACE_BEGIN(modules_start);
+		const uint64_t modules_started = eventlog_now();
+		const int modules_status = get_modules(resource);
+		TRACE_END(modules_start, "get_modules", resource->name);
+		
+		eventlog_emit(
+			"modules",
+			"{s:s?, s:I, s:i, s:i, s:f}",
+			"resource", resource->name,
+			"modules", (json_int_t) resource->modules.offset,
+			"status", modules_status,
+			"http_status", get_response_code(curl),
+			"duration", eventlog_elapsed(modules_started)
+		);
+		
+		if (modules_status != UERR_SUCCESS) {
 			fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
 			return EXIT_FAILURE;
 		}
 		
+		if (options.plan) {
+			struct Plan resource_plan = {0};
+			
+			if (plan_resource(resource, cwd, options.verify, &blob, resolve_list, &resource_plan) != UERR_SUCCESS) {
+				fprintf(stderr, "- Não foi possível planejar o download do produto '%s'!\r\n", resource->name);
+				return EXIT_FAILURE;
+			}
+			
+			char title[strlen(resource->name) + 32];
+			snprintf(title, sizeof(title), "Plano para o produto '%s'", resource->name);
+			
+			plan_print(stdout, title, &resource_plan);
+			plan_merge(&plan, &resource_plan);
+			
+			continue;
+		}
+		
 		char directory[strlen(resource->name) + 1];
 		strcpy(directory, resource->name);
 		normalize_filename(directory);
 		
-		char resource_directory[strlen(cwd) + strlen(PATH_SEPARATOR) + strlen(directory) + 1];
-		strcpy(resource_directory, cwd);
-		strcat(resource_directory, PATH_SEPARATOR);
-		strcat(resource_directory, directory);
+		struct Directory resource_directory __attribute__((__cleanup__(directory_close))) = {0};
+		int created = 0;
+		
+		if (!directory_open_child(&resource_directory, &root_directory, directory, &created)) {
+			fprintf(stderr, "- Ocorreu um erro ao tentar criar o diretório!\r\n");
+			return EXIT_FAILURE;
+		}
+		
+		if (created) {
+			fprintf(stderr, "- O diretório '%s' não existe, criando-o\r\n", resource_directory.path);
+		}
+		
+		/*
+		Everything already downloaded for this product is listed once, up front, and the skip decisions
+		below are taken from that list instead of checking each file separately.
+		*/
+		struct PathSet existing __attribute__((__cleanup__(pathset_free))) = {0};
+		
+		if (!created && !pathset_scan(&existing, resource_directory.path, 3)) {
+			fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
+			return EXIT_FAILURE;
+		}
+		
+		size_t pages_count = 0;
 		
-		if (!directory_exists(resource_directory)) {
-			fprintf(stderr, "- O diretório '%s' não existe, criando-o\r\n", resource_directory);
+		for (size_t index = 0; index < resource->modules.offset; index++) {
+			const struct Module* const module = &resource->modules.items[index];
 			
-			if (!create_directory(resource_directory)) {
-				fprintf(stderr, "- Ocorreu um erro ao tentar criar o diretório!\r\n");
-				return EXIT_FAILURE;
+			if (!module->is_locked) {
+				pages_count += module->pages.offset;
 			}
 		}
 		
+		progress_set_pages(pages_count);
+		metrics_gauge_add(GAUGE_PAGES_TOTAL, (int64_t) pages_count);
+		
 		for (size_t index = 0; index < resource->modules.offset; index++) {
 			struct Module* module = &resource->modules.items[index];
 			
 			printf("+ Verificando estado do módulo '%s'\r\n", module->name);
 			
+			eventlog_emit(
+				"module",
+				"{s:s?, s:s?, s:I, s:b}",
+				"resource", resource->name,
+				"module", module->id,
+				"pages", (json_int_t) module->pages.offset,
+				"locked", module->is_locked
+			);
+			
 			if (module->is_locked) {
 				fprintf(stderr, "- Módulo inacessível, pulando para o próximo\r\n");
 				continue;
@@ -1338,18 +2494,16 @@ int main() {
 			strcpy(directory, module->name);
 			normalize_filename(directory);
 			
-			char module_directory[strlen(resource_directory) + strlen(PATH_SEPARATOR) + strlen(directory) + 1];
-			strcpy(module_directory, resource_directory);
-			strcat(module_directory, PATH_SEPARATOR);
-			strcat(module_directory, directory);
+			struct Directory module_directory __attribute__((__cleanup__(directory_close))) = {0};
+			int created = 0;
 			
-			if (!directory_exists(module_directory)) {
-				fprintf(stderr, "- O diretório '%s' não existe, criando-o\r\n", module_directory);
-				
-				if (!create_directory(module_directory)) {
-					fprintf(stderr, "- Ocorreu um erro ao tentar criar o diretório!\r\n");
-					return EXIT_FAILURE;
-				}
+			if (!directory_open_child(&module_directory, &resource_directory, directory, &created)) {
+				fprintf(stderr, "- Ocorreu um erro ao tentar criar o diretório!\r\n");
+				return EXIT_FAILURE;
+			}
+			
+			if (created) {
+				fprintf(stderr, "- O diretório '%s' não existe, criando-o\r\n", module_directory.path);
 			}
 			
 			printf("+ Obtendo lista de páginas do módulo '%s'\r\n", module->name);
@@ -1357,7 +2511,28 @@ int main() {
 			for (size_t index = 0; index < module->pages.offset; index++) {
 				struct Page* page = &module->pages.items[index];
 				
-				if (get_page(&credentials, resource, page) != UERR_SUCCESS) {
+				progress_next_page();
+				metrics_gauge_add(GAUGE_PAGES_DONE, 1);
+				
+				TRACE_BEGIN(page_start);
+				const uint64_t page_started = eventlog_now();
+				const int page_status = get_page(resource, page);
+				TRACE_END(page_start, "get_page", page->name);
+				
+				eventlog_emit(
+					"page",
+					"{s:s?, s:s?, s:s?, s:I, s:I, s:i, s:i, s:f}",
+					"resource", resource->name,
+					"module", module->id,
+					"page", page->id,
+					"medias", (json_int_t) page->medias.offset,
+					"attachments", (json_int_t) page->attachments.offset,
+					"status", page_status,
+					"http_status", get_response_code(curl),
+					"duration", eventlog_elapsed(page_started)
+				);
+				
+				if (page_status != UERR_SUCCESS) {
 					fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
 					return EXIT_FAILURE;
 				}
@@ -1368,53 +2543,93 @@ int main() {
 				strcpy(directory, page->name);
 				normalize_filename(directory);
 				
-				char page_directory[strlen(module_directory) + strlen(PATH_SEPARATOR) + strlen(directory) + 1];
-				strcpy(page_directory, module_directory);
-				strcat(page_directory, PATH_SEPARATOR);
-				strcat(page_directory, directory);
+				struct Directory page_directory __attribute__((__cleanup__(directory_close))) = {0};
+				int created = 0;
 				
-				if (!directory_exists(page_directory)) {
-					fprintf(stderr, "- O diretório '%s' não existe, criando-o\r\n", page_directory);
-					
-					if (!create_directory(page_directory)) {
-						fprintf(stderr, "- Ocorreu um erro ao tentar criar o diretório!\r\n");
-						return EXIT_FAILURE;
-					}
+				if (!directory_open_child(&page_directory, &module_directory, directory, &created)) {
+					fprintf(stderr, "- Ocorreu um erro ao tentar criar o diretório!\r\n");
+					return EXIT_FAILURE;
+				}
+				
+				if (created) {
+					fprintf(stderr, "- O diretório '%s' não existe, criando-o\r\n", page_directory.path);
 				}
 				
 				for (size_t index = 0; index < page->medias.offset; index++) {
 					struct Media* media = &page->medias.items[index];
 					
-					char filename[strlen(page->name) + 1];
-					strcpy(filename, page->name);
-					normalize_filename(filename);
+					char* media_name __attribute__((__cleanup__(memorycharpp_free))) = get_media_name(page);
+					
+					if (media_name == NULL) {
+						page_error("media", resource, module, page, UERR_MEMORY_ALLOCATE_FAILURE);
+						fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
+						return EXIT_FAILURE;
+					}
 					
-					char media_filename[strlen(page_directory) + strlen(PATH_SEPARATOR) + strlen(filename) + strlen(DOT) + strlen(MP4_FILE_EXTENSION) + 1];
-					strcpy(media_filename, page_directory);
+					char media_filename[strlen(page_directory.path) + strlen(PATH_SEPARATOR) + strlen(media_name) + 1];
+					strcpy(media_filename, page_directory.path);
 					strcat(media_filename, PATH_SEPARATOR);
-					strcat(media_filename, filename);
-					strcat(media_filename, DOT);
-					strcat(media_filename, MP4_FILE_EXTENSION);
+					strcat(media_filename, media_name);
 					
-					if (!file_exists(media_filename)) {
-						fprintf(stderr, "- O arquivo '%s' não existe, ele será baixado\r\n", media_filename);
+					const char* const media_key = media_filename + strlen(resource_directory.path) + strlen(PATH_SEPARATOR);
+					
+					/* Media URLs are identified without their query string, which may carry expiring tokens */
+					const size_t media_url_size = strcspn(media->url, "?");
+					
+					char media_source[strlen(MEDIA_SOURCE_PREFIX) + media_url_size + 1];
+					strcpy(media_source, MEDIA_SOURCE_PREFIX);
+					strncat(media_source, media->url, media_url_size);
+					
+					const int media_exists = pathset_contains(&existing, media_key);
+					
+					if (!media_exists || !output_is_complete(&page_directory, media_name, media_filename, options.verify)) {
+						if (media_exists) {
+							fprintf(stderr, "- O arquivo '%s' está incompleto ou corrompido, ele será baixado novamente\r\n", media_filename);
+						} else {
+							fprintf(stderr, "- O arquivo '%s' não existe, ele será baixado\r\n", media_filename);
+						}
+						
+						if (output_reuse(media_source, media_filename, options.verify)) {
+							eventlog_emit("media_reused", "{s:s?, s:s?, s:s?, s:s}", "resource", resource->name, "module", module->id, "page", page->id, "file", media_filename);
+							
+							if (!pathset_add(&existing, media_key)) {
+								page_error("media", resource, module, page, UERR_MEMORY_ALLOCATE_FAILURE);
+								fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
+								return EXIT_FAILURE;
+							}
+							
+							continue;
+						}
+						
 						printf("+ Baixando de '%s' para '%s'\r\n", media->url, media_filename);
 						
+						TRACE_BEGIN(playlist_start);
+						
 						struct String string __attribute__((__cleanup__(string_free))) = {0};
 						
 						curl_easy_setopt(curl, CURLOPT_HTTPHEADER, NULL);
 						curl_easy_setopt(curl, CURLOPT_URL, media->url);
 						curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_write_cb);
 						curl_easy_setopt(curl, CURLOPT_WRITEDATA, &string);
+						curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, curl_header_cb);
+						curl_easy_setopt(curl, CURLOPT_HEADERDATA, &string);
 						
-						if (curl_easy_perform(curl) != CURLE_OK) {
+						const CURLcode media_code = curl_easy_perform(curl);
+						metrics_record(curl, TRANSFER_PLAYLIST);
+						TRACE_TRANSFER(curl, "playlist");
+						eventlog_transfer("master_playlist", curl, media_code, "{s:s?, s:s?, s:s?, s:s}", "resource", resource->name, "module", module->id, "page", page->id, "file", media_filename);
+						
+						if (media_code != CURLE_OK) {
+							page_error("master_playlist", resource, module, page, UERR_CURL_FAILURE);
 							fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
 							return EXIT_FAILURE;
 						}
 						
 						struct Tags tags = {0};
+						int parse_status = m3u8_parse(&tags, string.s);
 						
-						if (m3u8_parse(&tags, string.s) != UERR_SUCCESS) {
+						if (parse_status != UERR_SUCCESS) {
+							page_error("master_playlist", resource, module, page, parse_status);
 							fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
 							return EXIT_FAILURE;
 						}
@@ -1460,151 +2675,269 @@ int main() {
 						
 						curl_easy_setopt(curl, CURLOPT_URL, playlist_full_url);
 						
-						if (curl_easy_perform(curl) != CURLE_OK) {
+						const CURLcode playlist_code = curl_easy_perform(curl);
+						metrics_record(curl, TRANSFER_PLAYLIST);
+						TRACE_TRANSFER(curl, "playlist");
+						eventlog_transfer("media_playlist", curl, playlist_code, "{s:s?, s:s?, s:s?, s:s}", "resource", resource->name, "module", module->id, "page", page->id, "file", media_filename);
+						
+						curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, NULL);
+						curl_easy_setopt(curl, CURLOPT_HEADERDATA, NULL);
+						
+						if (playlist_code != CURLE_OK) {
+							page_error("media_playlist", resource, module, page, UERR_CURL_FAILURE);
+							fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
+							return EXIT_FAILURE;
+						}
+						
+						parse_status = m3u8_parse(&tags, string.s);
+						
+						if (parse_status != UERR_SUCCESS) {
+							page_error("media_playlist", resource, module, page, parse_status);
 							fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
 							return EXIT_FAILURE;
 						}
 						
-						if (m3u8_parse(&tags, string.s) != UERR_SUCCESS) {
+						uint64_t media_sequence = 0;
+						double duration = 0;
+						
+						for (size_t index = 0; index < tags.offset; index++) {
+							const struct Tag* const tag = &tags.items[index];
+							
+							if (tag->type == EXT_X_MEDIA_SEQUENCE && tag->value != NULL) {
+								media_sequence = strtoull(tag->value, NULL, 10);
+							} else if (tag->type == EXTINF && tag->value != NULL) {
+								duration += strtod(tag->value, NULL);
+							}
+						}
+						
+						TRACE_END(playlist_start, "playlist", media_filename);
+						
+						/*
+						Segments are handed to a remux worker as they complete, which writes the MP4 container
+						while this lecture is still downloading and after the downloader has moved on.
+						*/
+						char* const staging_name = get_staging_filename(options.scratch_directory != NULL, media_name);
+						char* const staging_filename = staging_name == NULL ? NULL : directory_join(options.scratch_directory != NULL ? &scratch_directory : &page_directory, staging_name);
+						memory_free(staging_name);
+						
+						if (staging_filename == NULL) {
+							page_error("remux_submit", resource, module, page, UERR_MEMORY_ALLOCATE_FAILURE);
 							fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
 							return EXIT_FAILURE;
 						}
 						
-						int segment_number = 1;
+						struct RemuxJob* const job = remux_pool_submit(&pool, staging_filename, media_filename, media_source, duration);
+						memory_free(staging_filename);
+						
+						if (job == NULL || !pathset_add(&existing, media_key)) {
+							page_error("remux_submit", resource, module, page, UERR_MEMORY_ALLOCATE_FAILURE);
+							fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
+							return EXIT_FAILURE;
+						}
 						
 						struct SegmentDownload downloads[tags.offset];
 						size_t downloads_offset = 0;
 						
-						char playlist_filename[strlen(page_directory) + strlen(PATH_SEPARATOR) + strlen(LOCAL_PLAYLIST_FILENAME) + 1];
-						strcpy(playlist_filename, page_directory);
-						strcat(playlist_filename, PATH_SEPARATOR);
-						strcat(playlist_filename, LOCAL_PLAYLIST_FILENAME);
+						/* Keys are fetched once per URI, since a playlist may rotate them */
+						struct SegmentKey keys[tags.offset];
+						size_t keys_offset = 0;
 						
-						for (size_t index = 0; index < tags.offset; index++) {
+						const struct SegmentKey* key = NULL;
+						
+						unsigned char iv[AES_BLOCK_SIZE];
+						int has_iv = 0;
+						
+						uint64_t sequence = media_sequence;
+						
+						CURLcode code = CURLE_OK;
+						int status = UERR_SUCCESS;
+						
+						for (size_t index = 0; index < tags.offset && code == CURLE_OK && status == UERR_SUCCESS; index++) {
 							struct Tag* tag = &tags.items[index];
 							
 							if (tag->type == EXT_X_KEY) {
-								struct Attribute* attribute = attributes_get(&tag->attributes, "URI");
+								const struct Attribute* const method = attributes_get(&tag->attributes, "METHOD");
+								const struct Attribute* const uri = attributes_get(&tag->attributes, "URI");
+								const struct Attribute* const attribute = attributes_get(&tag->attributes, "IV");
+								
+								key = NULL;
+								
+								if (method == NULL || method->value == NULL || strcmp(method->value, "NONE") == 0) {
+									continue;
+								}
 								
-								curl_url_set(cu, CURLUPART_URL, attribute->value, 0);
+								if (strcmp(method->value, "AES-128") != 0 || uri == NULL || uri->value == NULL) {
+									status = UERR_AES_UNSUPPORTED_METHOD;
+									break;
+								}
+								
+								has_iv = attribute != NULL && attribute->value != NULL;
+								
+								if (has_iv && !decrypt_iv_parse(attribute->value, iv)) {
+									status = UERR_AES_UNSUPPORTED_METHOD;
+									break;
+								}
+								
+								curl_url_set(cu, CURLUPART_URL, uri->value, 0);
 								
 								char* url __attribute__((__cleanup__(curlcharpp_free))) = NULL;
 								curl_url_get(cu, CURLUPART_URL, &url, 0);
 								
-								char* filename = malloc(strlen(page_directory) + strlen(PATH_SEPARATOR) + strlen(KEY_FILE_EXTENSION) + strlen(DOT) + strlen(KEY_FILE_EXTENSION) + 1);
-								strcpy(filename, page_directory);
-								strcat(filename, PATH_SEPARATOR);
-								strcat(filename, KEY_FILE_EXTENSION);
-								strcat(filename, DOT);
-								strcat(filename, KEY_FILE_EXTENSION);
-								
-								attribute_set_value(attribute, filename);
-								tag_set_uri(tag, filename);
+								curl_url_set(cu, CURLUPART_URL, playlist_full_url, 0);
 								
-								CURL* handle = curl_easy_init();
+								for (size_t position = 0; position < keys_offset; position++) {
+									if (strcmp(keys[position].url, url) == 0) {
+										key = &keys[position];
+										break;
+									}
+								}
 								
-								if (handle == NULL) {
-									fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
-									return EXIT_FAILURE;
+								if (key != NULL) {
+									continue;
 								}
 								
-								curl_easy_setopt(handle, CURLOPT_FAILONERROR, 1L);
-								curl_easy_setopt(handle, CURLOPT_SSL_VERIFYPEER, 0L);
-								curl_easy_setopt(handle, CURLOPT_DOH_SSL_VERIFYPEER, 0L);
-								curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
-								curl_easy_setopt(handle, CURLOPT_USERAGENT, HTTP_DEFAULT_USER_AGENT);
-								curl_easy_setopt(handle, CURLOPT_IPRESOLVE, CURL_IPRESOLVE_V4);
-								curl_easy_setopt(handle, CURLOPT_CAPATH, NULL);
-								curl_easy_setopt(handle, CURLOPT_CAINFO, NULL);
-								curl_easy_setopt(handle, CURLOPT_CAINFO_BLOB, &blob);
-								curl_easy_setopt(handle, CURLOPT_RESOLVE, resolve_list);
-								curl_easy_setopt(handle, CURLOPT_URL, url);
+								struct SegmentKey* const item = &keys[keys_offset++];
+								memset(item, 0, sizeof(*item));
+								
+								item->url = url;
+								url = NULL;
 								
-								FILE* const stream = fopen(filename, "wb");
+								CURL* const handle = media_handle_init(&blob, resolve_list, item->url);
 								
-								if (stream == NULL) {
-									fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
-									return EXIT_FAILURE;
+								if (handle == NULL) {
+									status = UERR_CURL_FAILURE;
+									break;
 								}
 								
-								curl_easy_setopt(handle, CURLOPT_WRITEDATA, (void*) stream);
-								curl_multi_add_handle(multi_handle, handle);
+								curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, curl_write_cb);
+								curl_easy_setopt(handle, CURLOPT_WRITEDATA, &item->data);
 								
-								struct SegmentDownload download = {
-									.handle = handle,
-									.filename = filename,
-									.stream = stream
-								};
+								code = curl_easy_perform(handle);
+								metrics_record(handle, TRANSFER_KEY);
+								TRACE_TRANSFER(handle, "key");
+								eventlog_transfer("key", handle, code, "{s:s?, s:s?, s:s?, s:s}", "resource", resource->name, "module", module->id, "page", page->id, "file", media_filename);
+								curl_easy_cleanup(handle);
 								
-								downloads[downloads_offset++] = download;
+								if (code == CURLE_OK && item->data.slength != AES_BLOCK_SIZE) {
+									status = UERR_AES_INVALID_LENGTH;
+								}
 								
-								curl_url_set(cu, CURLUPART_URL, playlist_full_url, 0);
+								key = item;
 							} else if (tag->type == EXTINF && tag->uri != NULL) {
 								curl_url_set(cu, CURLUPART_URL, tag->uri, 0);
 								
 								char* url __attribute__((__cleanup__(curlcharpp_free))) = NULL;
 								curl_url_get(cu, CURLUPART_URL, &url, 0);
 								
-								char value[intlen(segment_number) + 1];
-								snprintf(value, sizeof(value), "%i", segment_number);
-								
-								char* filename = malloc(strlen(page_directory) + strlen(PATH_SEPARATOR) + strlen(value) + strlen(DOT) + strlen(TS_FILE_EXTENSION) + 1);
-								strcpy(filename, page_directory);
-								strcat(filename, PATH_SEPARATOR);
-								strcat(filename, value);
-								strcat(filename, DOT);
-								strcat(filename, TS_FILE_EXTENSION);
-								
-								tag_set_uri(tag, filename);
-								
-								CURL* handle = curl_easy_init();
+								CURL* handle = media_handle_init(&blob, resolve_list, url);
 								
 								if (handle == NULL) {
-									fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
-									return EXIT_FAILURE;
+									status = UERR_CURL_FAILURE;
+									break;
 								}
 								
-								curl_easy_setopt(handle, CURLOPT_FAILONERROR, 1L);
-								curl_easy_setopt(handle, CURLOPT_SSL_VERIFYPEER, 0L);
-								curl_easy_setopt(handle, CURLOPT_DOH_SSL_VERIFYPEER, 0L);
-								curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
-								curl_easy_setopt(handle, CURLOPT_USERAGENT, HTTP_DEFAULT_USER_AGENT);
-								curl_easy_setopt(handle, CURLOPT_IPRESOLVE, CURL_IPRESOLVE_V4);
-								curl_easy_setopt(handle, CURLOPT_CAPATH, NULL);
-								curl_easy_setopt(handle, CURLOPT_CAINFO, NULL);
-								curl_easy_setopt(handle, CURLOPT_CAINFO_BLOB, &blob);
-								curl_easy_setopt(handle, CURLOPT_RESOLVE, resolve_list);
-								curl_easy_setopt(handle, CURLOPT_URL, url);
+								struct SegmentDownload* const download = &downloads[downloads_offset++];
+								memset(download, 0, sizeof(*download));
 								
-								FILE* const stream = fopen(filename, "wb");
+								download->handle = handle;
+								download->key = key;
+								download->duration = tag->value == NULL ? 0 : strtod(tag->value, NULL);
 								
-								if (stream == NULL) {
-									fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
-									return EXIT_FAILURE;
+								if (key != NULL && has_iv) {
+									memcpy(download->iv, iv, sizeof(download->iv));
+								} else if (key != NULL) {
+									/* Without an explicit IV, the media sequence number of the segment is used as one */
+									for (size_t position = 0; position < sizeof(sequence); position++) {
+										download->iv[AES_BLOCK_SIZE - 1 - position] = (unsigned char) (sequence >> (position * 8));
+									}
 								}
 								
-								curl_easy_setopt(handle, CURLOPT_WRITEDATA, (void*) stream);
-								curl_multi_add_handle(multi_handle, handle);
+								/* Kept in memory until every segment before it has been written out */
+								curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, curl_write_cb);
+								curl_easy_setopt(handle, CURLOPT_WRITEDATA, &download->data);
 								
-								struct SegmentDownload download = {
-									.handle = handle,
-									.filename = filename,
-									.stream = stream
-								};
+								curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 0L);
+								curl_easy_setopt(handle, CURLOPT_XFERINFOFUNCTION, progress_transfer_cb);
+								curl_easy_setopt(handle, CURLOPT_XFERINFODATA, &download->transfer);
 								
-								downloads[downloads_offset++] = download;
-								
-								segment_number++;
+								sequence++;
 							}
-							
 						}
 						
-						int still_running = 1;
+						int still_running = code == CURLE_OK && status == UERR_SUCCESS;
+						size_t next_segment = 0;
+						
+						/* Transfers are started in playlist order, at most SEGMENT_WINDOW past the next segment to be written */
+						size_t next_transfer = 0;
+						
+						while (still_running && next_transfer < downloads_offset && next_transfer < SEGMENT_WINDOW) {
+							curl_multi_add_handle(multi_handle, downloads[next_transfer++].handle);
+						}
+						
+						const uint64_t segments_started = eventlog_now();
+						uint64_t segments_bytes = 0;
+						
+						progress_begin(0, duration);
 						
 						while (still_running) {
 							CURLMcode mc = curl_multi_perform(multi_handle, &still_running);
 							
-							printf("\r+ Atualmente em progresso: %i%% / 100%%", (((downloads_offset - still_running) * 100) / downloads_offset));
+							metrics_gauge_set(GAUGE_ACTIVE_TRANSFERS, still_running);
+							progress_draw(0);
+							
+							CURLMsg* msg = NULL;
+							int msgs_left = 0;
+							
+							while ((msg = curl_multi_info_read(multi_handle, &msgs_left))) {
+								if (msg->msg != CURLMSG_DONE) {
+									continue;
+								}
+								
+								metrics_record(msg->easy_handle, TRANSFER_SEGMENT);
+								TRACE_TRANSFER(msg->easy_handle, "segment");
+								
+								if (msg->data.result != CURLE_OK && code == CURLE_OK) {
+									code = msg->data.result;
+								}
+								
+								for (size_t index = 0; index < downloads_offset; index++) {
+									struct SegmentDownload* download = &downloads[index];
+									
+									if (download->handle == msg->easy_handle) {
+										download->done = 1;
+										
+										if (msg->data.result == CURLE_OK) {
+											progress_segment_done(download->transfer.received, download->duration);
+											segments_bytes += download->transfer.received;
+										}
+										
+										eventlog_transfer("segment", msg->easy_handle, msg->data.result, "{s:s?, s:s, s:I}", "page", page->id, "file", media_filename, "index", (json_int_t) index);
+										
+										break;
+									}
+								}
+							}
+							
+							if (code != CURLE_OK) {
+								break;
+							}
+							
+							/* Segments must reach the remuxer in playlist order */
+							while (status == UERR_SUCCESS && next_segment < downloads_offset && downloads[next_segment].done) {
+								struct SegmentDownload* const download = &downloads[next_segment++];
+								
+								const unsigned char* const key = download->key == NULL ? NULL : (unsigned char*) download->key->data.s;
+								status = remux_job_push(&pool, job, &download->data, key, download->iv);
+								
+								if (status == UERR_SUCCESS && next_transfer < downloads_offset) {
+									curl_multi_add_handle(multi_handle, downloads[next_transfer++].handle);
+									still_running = 1;
+								}
+							}
+							
+							if (status != UERR_SUCCESS) {
+								break;
+							}
 							
 							if (still_running) {
 								mc = curl_multi_poll(multi_handle, NULL, 0, 1000, NULL);
@@ -1615,185 +2948,226 @@ int main() {
 							}
 						}
 						
-						printf("\n");
-						
-						CURLMsg* msg = NULL;
-						int msgs_left = 0;
-						
-						CURLcode code = 0;
-						
-						while ((msg = curl_multi_info_read(multi_handle, &msgs_left))) {
-							if (msg->msg == CURLMSG_DONE) {
-								code = msg->data.result;
-								
-								if (code != CURLE_OK) {
-									break;
-								}
-							}
-						}
+						progress_end();
+						metrics_gauge_set(GAUGE_ACTIVE_TRANSFERS, 0);
 						
 						for (size_t index = 0; index < downloads_offset; index++) {
 							struct SegmentDownload* download = &downloads[index];
 							
-							fclose(download->stream);
+							string_free(&download->data);
 							
 							curl_multi_remove_handle(multi_handle, download->handle);
 							curl_easy_cleanup(download->handle);
 						}
 						
-						if (code != CURLE_OK) {
-							for (size_t index = 0; index < downloads_offset; index++) {
-								struct SegmentDownload* download = &downloads[index];
-								
-								remove_file(download->filename);
-								free(download->filename);
-							}
-						
-							fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
-							return EXIT_FAILURE;
-						}
-						
-						printf("+ Exportando lista de reprodução para '%s'\r\n", playlist_filename);
-						 
-						FILE* const stream = fopen(playlist_filename, "wb");
-						
-						if (stream == NULL) {
-							fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
-							return EXIT_FAILURE;
+						for (size_t index = 0; index < keys_offset; index++) {
+							struct SegmentKey* item = &keys[index];
+							
+							curl_free(item->url);
+							string_free(&item->data);
 						}
 						
-						const int ok = tags_dumpf(&tags, stream);
-						
-						fclose(stream);
 						m3u8_free(&tags);
 						
-						if (!ok) {
-							fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
-							return EXIT_FAILURE;
+						if (code == CURLE_OK && status == UERR_SUCCESS && next_segment != downloads_offset) {
+							code = CURLE_RECV_ERROR;
 						}
 						
-						//curl_multi_cleanup(multi_handle);
-						
-						char output_file[strlen(QUOTATION_MARK) * 2 + strlen(media_filename) + 1];
-						strcpy(output_file, QUOTATION_MARK);
-						strcat(output_file, media_filename);
-						strcat(output_file, QUOTATION_MARK);
-						
-						printf("+ Copiando arquivos de mídia para '%s'\r\n", media_filename);
+						remux_job_close(&pool, job, code != CURLE_OK || status != UERR_SUCCESS);
 						
-						const char* const command[][2] = {
-							{"ffmpeg", NULL},
-							{"-loglevel", "error"},
-							{"-allowed_extensions", "ALL"},
-							{"-i", playlist_filename},
-							{"-c", "copy"},
-							{"-movflags", "+faststart"},
-							{"-map_metadata", "-1"},
-							{output_file, NULL}
-						};
-						
-						char command_line[5000];
-						memset(command_line, '\0', sizeof(command_line));
+						eventlog_emit(
+							"segments",
+							"{s:s?, s:s?, s:s?, s:s, s:I, s:I, s:I, s:f, s:i, s:i}",
+							"resource", resource->name,
+							"module", module->id,
+							"page", page->id,
+							"file", media_filename,
+							"segments", (json_int_t) downloads_offset,
+							"delivered", (json_int_t) next_segment,
+							"bytes", (json_int_t) segments_bytes,
+							"duration", eventlog_elapsed(segments_started),
+							"curl_code", (int) code,
+							"status", status
+						);
 						
-						for (size_t index = 0; index < sizeof(command) / sizeof(*command); index++) {
-							const char** const argument = (const char**) command[index];
-							
-							const char* const key = argument[0];
-							const char* const value = argument[1];
-							
-							if (key != NULL) {
-								strcat(command_line, key);
-							}
-							
-							strcat(command_line, SPACE);
+						if (code != CURLE_OK || status != UERR_SUCCESS) {
+							page_error("segments", resource, module, page, status != UERR_SUCCESS ? status : UERR_CURL_FAILURE);
 							
-							if (value != NULL) {
-								strcat(command_line, QUOTATION_MARK);
-								strcat(command_line, value);
-								strcat(command_line, QUOTATION_MARK);
+							if (status == UERR_AES_UNSUPPORTED_METHOD) {
+								fprintf(stderr, "- A lista de reprodução usa um método de criptografia não suportado!\r\n");
+							} else {
+								fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
 							}
 							
-							strcat(command_line, SPACE);
-						}
-						
-						const int exit_code = execute_shell_command(command_line);
-						
-						for (size_t index = 0; index < downloads_offset; index++) {
-							struct SegmentDownload* download = &downloads[index];
-							
-							remove_file(download->filename);
-							free(download->filename);
-						}
-						
-						remove_file(playlist_filename);
-						
-						if (exit_code != 0) {
-							fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
 							return EXIT_FAILURE;
 						}
 					}
 				}
 				
-				curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, progress_callback);
+				curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+				curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, progress_transfer_cb);
+				curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, NULL);
 				
 				for (size_t index = 0; index < page->attachments.offset; index++) {
 					struct Attachment* attachment = &page->attachments.items[index];
 					
-					char filename[strlen(page->name) + 1];
-					strcpy(filename, page->name);
-					normalize_filename(filename);
+					char* attachment_name __attribute__((__cleanup__(memorycharpp_free))) = get_attachment_name(page, index);
 					
-					int attachment_number = index + 1;
+					if (attachment_name == NULL) {
+						page_error("attachment", resource, module, page, UERR_MEMORY_ALLOCATE_FAILURE);
+						fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
+						return EXIT_FAILURE;
+					}
 					
-					char attachment_filename[strlen(page_directory) + strlen(PATH_SEPARATOR) + ((page->attachments.offset > 1) ? (intlen(attachment_number) + strlen(DOT) + strlen(SPACE)) : 0) + strlen(filename) + strlen(DOT) + strlen(attachment->extension) + 1];
-					strcpy(attachment_filename, page_directory);
+					char attachment_filename[strlen(page_directory.path) + strlen(PATH_SEPARATOR) + strlen(attachment_name) + 1];
+					strcpy(attachment_filename, page_directory.path);
 					strcat(attachment_filename, PATH_SEPARATOR);
+					strcat(attachment_filename, attachment_name);
 					
-					if (page->attachments.offset > 1) {
-						char value[intlen(attachment_number) + 1];
-						snprintf(value, sizeof(value), "%i", attachment_number);
-						
-						strcat(attachment_filename, value);
-						strcat(attachment_filename, DOT);
-						strcat(attachment_filename, SPACE);
-					}
+					const char* const attachment_key = attachment_filename + strlen(resource_directory.path) + strlen(PATH_SEPARATOR);
 					
-					strcat(attachment_filename, filename);
-					strcat(attachment_filename, DOT);
-					strcat(attachment_filename, attachment->extension);
+					char attachment_source[strlen(ATTACHMENT_SOURCE_PREFIX) + strlen(attachment->id) + 1];
+					strcpy(attachment_source, ATTACHMENT_SOURCE_PREFIX);
+					strcat(attachment_source, attachment->id);
 					
-					if (!file_exists(attachment_filename)) {
-						fprintf(stderr, "- O arquivo '%s' não existe, ele será baixado\r\n", attachment_filename);
+					const int attachment_exists = pathset_contains(&existing, attachment_key);
+					
+					if (!attachment_exists || !output_is_complete(&page_directory, attachment_name, attachment_filename, options.verify)) {
+						if (attachment_exists) {
+							fprintf(stderr, "- O arquivo '%s' está incompleto ou corrompido, ele será baixado novamente\r\n", attachment_filename);
+						} else {
+							fprintf(stderr, "- O arquivo '%s' não existe, ele será baixado\r\n", attachment_filename);
+						}
+						
+						if (output_reuse(attachment_source, attachment_filename, options.verify)) {
+							eventlog_emit("attachment_reused", "{s:s?, s:s?, s:s?, s:s?, s:s}", "resource", resource->name, "module", module->id, "page", page->id, "attachment", attachment->id, "file", attachment_filename);
+							
+							if (!pathset_add(&existing, attachment_key)) {
+								page_error("attachment", resource, module, page, UERR_MEMORY_ALLOCATE_FAILURE);
+								fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
+								return EXIT_FAILURE;
+							}
+							
+							continue;
+						}
+						
 						printf("+ Baixando de '%s' para '%s'\r\n", attachment->url, attachment_filename);
 						
-						FILE* const stream = fopen(attachment_filename, "wb");
+						TRACE_BEGIN(attachment_start);
+						
+						const struct Directory* const staging_directory = options.scratch_directory != NULL ? &scratch_directory : &page_directory;
+						char* const staging_name = get_staging_filename(options.scratch_directory != NULL, attachment_name);
+						
+						if (staging_name == NULL) {
+							page_error("attachment", resource, module, page, UERR_MEMORY_ALLOCATE_FAILURE);
+							fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
+							return EXIT_FAILURE;
+						}
+						
+						FILE* const stream = directory_create_file(staging_directory, staging_name);
+						struct FileDownload download = {0};
 						
-						if (stream == NULL) {
+						if (stream == NULL || !file_download_init(&download, stream)) {
+							memory_free(staging_name);
+							page_error("attachment", resource, module, page, UERR_FILE_WRITE_FAILURE);
 							fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
 							return EXIT_FAILURE;
 						}
 						
 						curl_easy_setopt(curl, CURLOPT_HTTPHEADER, NULL);
 						curl_easy_setopt(curl, CURLOPT_URL, attachment->url);
-						curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, NULL);
-						curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void*) stream);
+						curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_write_download_cb);
+						curl_easy_setopt(curl, CURLOPT_WRITEDATA, &download);
+						curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, curl_header_download_cb);
+						curl_easy_setopt(curl, CURLOPT_HEADERDATA, &download);
+						
+						/* Attachments are sized by their Content-Length */
+						struct ProgressTransfer transfer = {
+							.sized = 1
+						};
+						
+						curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &transfer);
+						
+						progress_begin(0, 0);
 						
 						const CURLcode code = curl_easy_perform(curl);
+						metrics_record(curl, TRANSFER_ATTACHMENT);
+						TRACE_TRANSFER(curl, "attachment");
+						eventlog_transfer("attachment", curl, code, "{s:s?, s:s?, s:s?, s:s?, s:s}", "resource", resource->name, "module", module->id, "page", page->id, "attachment", attachment->id, "file", attachment_filename);
+						
+						progress_end();
+						
+						curl_easy_setopt(curl, CURLOPT_XFERINFODATA, NULL);
 						
-						fclose(stream);
+						curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, NULL);
+						curl_easy_setopt(curl, CURLOPT_HEADERDATA, NULL);
+						
+						const int closed = file_download_finish(&download);
 						
 						if (code != CURLE_OK) {
-							remove_file(attachment_filename);
+							directory_remove_file(staging_directory, staging_name);
+							memory_free(staging_name);
+							page_error("attachment", resource, module, page, UERR_CURL_FAILURE);
 							return UERR_CURL_FAILURE;
 						}
+						
+						if (!closed || !directory_publish_file(staging_directory, staging_name, &page_directory, attachment_name)) {
+							directory_remove_file(staging_directory, staging_name);
+							memory_free(staging_name);
+							page_error("attachment", resource, module, page, UERR_FILE_WRITE_FAILURE);
+							fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
+							return EXIT_FAILURE;
+						}
+						
+						memory_free(staging_name);
+						
+						char sha256[SHA256_HEX_SIZE];
+						sha256_hexdigest(&download.context, sha256);
+						
+						manifest_deduplicate(&manifest, attachment_filename, download.size, sha256);
+						
+						if (manifest_record(&manifest, attachment_filename, download.size, sha256, attachment_source) != UERR_SUCCESS || !pathset_add(&existing, attachment_key)) {
+							page_error("attachment", resource, module, page, UERR_FILE_WRITE_FAILURE);
+							fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
+							return EXIT_FAILURE;
+						}
+						
+						TRACE_END(attachment_start, "attachment", attachment_filename);
 					}
 				}
 				
+				curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
 				curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, NULL);
+				curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
 			}
 			
 		}
 	}
 	
+	if (options.plan && queue_count > 1) {
+		plan_print(stdout, "Plano para todos os produtos", &plan);
+	}
+	
+	resources_revalidation_stop(&revalidation);
+	
+	const size_t failures = remux_pool_wait(&pool);
+	
+	eventlog_emit(
+		"run_finish",
+		"{s:I, s:I, s:f}",
+		"remux_failures", (json_int_t) failures,
+		"deduplicated_bytes", (json_int_t) deduplicated_bytes,
+		"duration", eventlog_elapsed(run_started)
+	);
+	
+	if (deduplicated_bytes > 0) {
+		printf("+ %.2f MB deixaram de ser baixados por já existirem em outro lugar\r\n", (double) deduplicated_bytes / (1024 * 1024));
+	}
+	
+	if (failures > 0) {
+		fprintf(stderr, "- Ocorreu uma falha inesperada!\r\n");
+		return EXIT_FAILURE;
+	}
+	
 	return 0;
 }
@@ -0,0 +1,426 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <jansson.h>
+
+#include "manifest.h"
+#include "errors.h"
+#include "symbols.h"
+#include "utils.h"
+#include "memory.h"
+
+static const char MANIFEST_FILENAME[] = ".sparklec-manifest";
+
+static const char* manifest_key(const struct Manifest* const obj, const char* const filename) {
+	/*
+	Outputs are recorded relative to the manifest's directory, so that the tree can be moved.
+	*/
+	
+	const size_t size = strlen(obj->directory);
+	
+	if (strncmp(filename, obj->directory, size) == 0 && filename[size] == *PATH_SEPARATOR) {
+		return filename + size + 1;
+	}
+	
+	return filename;
+	
+}
+
+static char* manifest_read(FILE* const stream) {
+	
+	if (fseek(stream, 0, SEEK_END) != 0) {
+		return NULL;
+	}
+	
+	const long size = ftell(stream);
+	
+	if (size < 0 || fseek(stream, 0, SEEK_SET) != 0) {
+		return NULL;
+	}
+	
+	char* const buffer = malloc((size_t) size + 1);
+	
+	if (buffer == NULL) {
+		return NULL;
+	}
+	
+	if (fread(buffer, 1, (size_t) size, stream) != (size_t) size) {
+		free(buffer);
+		return NULL;
+	}
+	
+	buffer[size] = '\0';
+	
+	return buffer;
+	
+}
+
+static int manifest_compact(const struct Manifest* const obj, const char* const filename) {
+	/*
+	Writes only the latest record of each output next to the manifest and moves it over the
+	original, so that the file does not grow with every run that replaces an output.
+	*/
+	
+	char temporary[strlen(filename) + strlen(DOT) + strlen(PART_FILE_EXTENSION) + 1];
+	strcpy(temporary, filename);
+	strcat(temporary, DOT);
+	strcat(temporary, PART_FILE_EXTENSION);
+	
+	FILE* const stream = open_file(temporary, "wb");
+	
+	if (stream == NULL) {
+		return UERR_FILE_WRITE_FAILURE;
+	}
+	
+	const char* key = NULL;
+	json_t* tree = NULL;
+	
+	int written = 1;
+	
+	json_object_foreach(obj->entries, key, tree) {
+		char* const line = json_dumps(tree, JSON_COMPACT);
+		
+		written = line != NULL && fputs(line, stream) >= 0 && fputs(LF, stream) >= 0;
+		
+		free(line);
+		
+		if (!written) {
+			break;
+		}
+	}
+	
+	if (fclose(stream) != 0 || !written || !move_file(temporary, filename)) {
+		remove_file(temporary);
+		return UERR_FILE_WRITE_FAILURE;
+	}
+	
+	return UERR_SUCCESS;
+	
+}
+
+int manifest_open(struct Manifest* const obj, const char* const directory, const int readonly) {
+	/*
+	Loads the record of finished outputs kept in "directory" and opens it for appending. The
+	manifest is a JSON document per line; later lines replace earlier ones for the same file,
+	and a line cut short by a crash is ignored. Such lines are dropped from the file here.
+	
+	When "readonly" is set, the records are only loaded for lookups, and the file is neither
+	created nor modified.
+	*/
+	
+	memset(obj, 0, sizeof(*obj));
+	
+	obj->directory = memory_strdup(MEMORY_PATHS, directory);
+	obj->entries = json_object();
+	obj->sources = json_object();
+	obj->digests = json_object();
+	
+	pthread_mutex_init(&obj->lock, NULL);
+	
+	if (obj->directory == NULL || obj->entries == NULL || obj->sources == NULL || obj->digests == NULL) {
+		manifest_close(obj);
+		return UERR_MEMORY_ALLOCATE_FAILURE;
+	}
+	
+	char filename[strlen(directory) + strlen(PATH_SEPARATOR) + strlen(MANIFEST_FILENAME) + 1];
+	strcpy(filename, directory);
+	strcat(filename, PATH_SEPARATOR);
+	strcat(filename, MANIFEST_FILENAME);
+	
+	/* Lines that hold no record, or one replaced further down */
+	size_t stale = 0;
+	
+	FILE* const stream = open_file(filename, "rb");
+	
+	if (stream != NULL) {
+		char* const buffer = manifest_read(stream);
+		fclose(stream);
+		
+		if (buffer == NULL) {
+			manifest_close(obj);
+			return UERR_FILE_READ_FAILURE;
+		}
+		
+		char* line = buffer;
+		
+		while (*line != '\0') {
+			char* end = strchr(line, *LF);
+			
+			if (end == NULL) {
+				end = strchr(line, '\0');
+			}
+			
+			json_t* const tree = json_loadb(line, end - line, 0, NULL);
+			
+			int valid = 0;
+			
+			if (tree != NULL) {
+				const json_t* const path = json_object_get(tree, "path");
+				const json_t* const size = json_object_get(tree, "size");
+				const json_t* const sha256 = json_object_get(tree, "sha256");
+				
+				valid = json_is_string(path) && json_is_integer(size) && json_is_string(sha256) && strlen(json_string_value(sha256)) == SHA256_HEX_SIZE - 1;
+				
+				if (valid) {
+					if (json_object_get(obj->entries, json_string_value(path)) != NULL) {
+						stale++;
+					}
+					
+					json_object_set(obj->entries, json_string_value(path), tree);
+				}
+				
+				json_decref(tree);
+			}
+			
+			if (!valid && end != line) {
+				stale++;
+			}
+			
+			line = *end == '\0' ? end : end + 1;
+		}
+		
+		free(buffer);
+	}
+	
+	/* Only the latest record of each output says where it came from and what it holds */
+	const char* key = NULL;
+	json_t* tree = NULL;
+	
+	json_object_foreach(obj->entries, key, tree) {
+		const json_t* const source = json_object_get(tree, "source");
+		
+		json_object_set_new(obj->digests, json_string_value(json_object_get(tree, "sha256")), json_string(key));
+		
+		if (json_is_string(source)) {
+			json_object_set_new(obj->sources, json_string_value(source), json_string(key));
+		}
+	}
+	
+	if (readonly) {
+		return UERR_SUCCESS;
+	}
+	
+	if (stale > 0) {
+		const int status = manifest_compact(obj, filename);
+		
+		if (status != UERR_SUCCESS) {
+			manifest_close(obj);
+			return status;
+		}
+	}
+	
+	obj->stream = open_file(filename, "ab");
+	
+	if (obj->stream == NULL) {
+		manifest_close(obj);
+		return UERR_FILE_WRITE_FAILURE;
+	}
+	
+	return UERR_SUCCESS;
+	
+}
+
+int manifest_record(
+	struct Manifest* const obj,
+	const char* const filename,
+	const uint64_t size,
+	const char* const sha256,
+	const char* const source
+) {
+	/*
+	Records a finished output, along with where it was downloaded from, if known. Safe to
+	call from any thread.
+	*/
+	
+	const char* const key = manifest_key(obj, filename);
+	
+	json_t* const tree = json_pack("{s:s, s:I, s:s}", "path", key, "size", (json_int_t) size, "sha256", sha256);
+	
+	if (tree == NULL) {
+		return UERR_MEMORY_ALLOCATE_FAILURE;
+	}
+	
+	if (source != NULL && json_object_set_new(tree, "source", json_string(source)) != 0) {
+		json_decref(tree);
+		return UERR_MEMORY_ALLOCATE_FAILURE;
+	}
+	
+	char* const line = json_dumps(tree, JSON_COMPACT);
+	
+	if (line == NULL) {
+		json_decref(tree);
+		return UERR_MEMORY_ALLOCATE_FAILURE;
+	}
+	
+	pthread_mutex_lock(&obj->lock);
+	
+	const int written = obj->stream != NULL && fputs(line, obj->stream) >= 0 && fputs(LF, obj->stream) >= 0 && fflush(obj->stream) == 0;
+	
+	if (written) {
+		json_object_set(obj->entries, key, tree);
+		json_object_set_new(obj->digests, sha256, json_string(key));
+		
+		if (source != NULL) {
+			json_object_set_new(obj->sources, source, json_string(key));
+		}
+	}
+	
+	pthread_mutex_unlock(&obj->lock);
+	
+	free(line);
+	json_decref(tree);
+	
+	return written ? UERR_SUCCESS : UERR_FILE_WRITE_FAILURE;
+	
+}
+
+int manifest_lookup(
+	struct Manifest* const obj,
+	const char* const filename,
+	uint64_t* const size,
+	char* const sha256
+) {
+	/*
+	Returns whether the output has been recorded as finished, along with its size and digest.
+	*/
+	
+	pthread_mutex_lock(&obj->lock);
+	
+	const json_t* const tree = json_object_get(obj->entries, manifest_key(obj, filename));
+	
+	if (tree != NULL) {
+		*size = (uint64_t) json_integer_value(json_object_get(tree, "size"));
+		strcpy(sha256, json_string_value(json_object_get(tree, "sha256")));
+	}
+	
+	pthread_mutex_unlock(&obj->lock);
+	
+	return tree != NULL;
+	
+}
+
+static char* manifest_path(const struct Manifest* const obj, const char* const key) {
+	
+	char* const filename = memory_alloc(MEMORY_PATHS, strlen(obj->directory) + strlen(PATH_SEPARATOR) + strlen(key) + 1);
+	
+	if (filename == NULL) {
+		return NULL;
+	}
+	
+	strcpy(filename, obj->directory);
+	strcat(filename, PATH_SEPARATOR);
+	strcat(filename, key);
+	
+	return filename;
+	
+}
+
+char* manifest_find_source(struct Manifest* const obj, const char* const source) {
+	/*
+	Returns the full path of the output last recorded for "source", or NULL if there is none.
+	The caller owns the returned string.
+	*/
+	
+	pthread_mutex_lock(&obj->lock);
+	
+	const char* const key = json_string_value(json_object_get(obj->sources, source));
+	char* const filename = key == NULL ? NULL : manifest_path(obj, key);
+	
+	pthread_mutex_unlock(&obj->lock);
+	
+	return filename;
+	
+}
+
+static char* manifest_find_content(
+	struct Manifest* const obj,
+	const char* const filename,
+	const uint64_t size,
+	const char* const sha256
+) {
+	/*
+	Returns the full path of another output last recorded with the same size and digest as
+	"filename", or NULL if there is none. The caller owns the returned string.
+	*/
+	
+	pthread_mutex_lock(&obj->lock);
+	
+	const char* const key = json_string_value(json_object_get(obj->digests, sha256));
+	char* existing = NULL;
+	
+	if (key != NULL && strcmp(key, manifest_key(obj, filename)) != 0) {
+		/* The output may have been replaced since, with other contents */
+		const json_t* const tree = json_object_get(obj->entries, key);
+		
+		if (
+			tree != NULL &&
+			(uint64_t) json_integer_value(json_object_get(tree, "size")) == size &&
+			strcmp(json_string_value(json_object_get(tree, "sha256")), sha256) == 0
+		) {
+			existing = manifest_path(obj, key);
+		}
+	}
+	
+	pthread_mutex_unlock(&obj->lock);
+	
+	return existing;
+	
+}
+
+int manifest_deduplicate(
+	struct Manifest* const obj,
+	const char* const filename,
+	const uint64_t size,
+	const char* const sha256
+) {
+	/*
+	Called once "filename" is complete and hashed: if another output holds the same contents,
+	"filename" is replaced by a clone of it, or a hard link, so that the contents are stored
+	only once. Returns whether it was.
+	*/
+	
+	char* const existing = manifest_find_content(obj, filename, size, sha256);
+	
+	if (existing == NULL) {
+		return 0;
+	}
+	
+	uint64_t existing_size = 0;
+	
+	const int ok = get_file_size(existing, &existing_size) && existing_size == size && duplicate_file(existing, filename);
+	
+	if (ok) {
+		printf("+ O conteúdo de '%s' é idêntico ao de '%s', compartilhando-o\r\n", filename, existing);
+	}
+	
+	memory_free(existing);
+	
+	return ok;
+	
+}
+
+void manifest_close(struct Manifest* const obj) {
+	
+	if (obj->stream != NULL) {
+		fclose(obj->stream);
+		obj->stream = NULL;
+	}
+	
+	if (obj->entries != NULL || obj->directory != NULL) {
+		pthread_mutex_destroy(&obj->lock);
+	}
+	
+	json_decref(obj->entries);
+	obj->entries = NULL;
+	
+	json_decref(obj->sources);
+	obj->sources = NULL;
+	
+	json_decref(obj->digests);
+	obj->digests = NULL;
+	
+	memory_free(obj->directory);
+	obj->directory = NULL;
+	
+}
@@ -0,0 +1,41 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include <jansson.h>
+
+#include "sha256.h"
+
+struct Manifest {
+	char* directory;
+	FILE* stream;
+	json_t* entries;
+	json_t* sources;
+	json_t* digests;
+	pthread_mutex_t lock;
+};
+
+int manifest_open(struct Manifest* const obj, const char* const directory, const int readonly);
+int manifest_record(
+	struct Manifest* const obj,
+	const char* const filename,
+	const uint64_t size,
+	const char* const sha256,
+	const char* const source
+);
+int manifest_lookup(
+	struct Manifest* const obj,
+	const char* const filename,
+	uint64_t* const size,
+	char* const sha256
+);
+char* manifest_find_source(struct Manifest* const obj, const char* const source);
+int manifest_deduplicate(
+	struct Manifest* const obj,
+	const char* const filename,
+	const uint64_t size,
+	const char* const sha256
+);
+void manifest_close(struct Manifest* const obj);
+
+#pragma once
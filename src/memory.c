@@ -0,0 +1,224 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifndef _WIN32
+	#include <signal.h>
+	#include <pthread.h>
+#endif
+
+#include "memory.h"
+
+struct MemoryStats {
+	uint64_t calls;
+	uint64_t live;
+	uint64_t peak;
+};
+
+/* Placed in front of every block; the union keeps what follows it suitably aligned */
+union MemoryHeader {
+	struct {
+		size_t size;
+		enum MemorySubsystem subsystem;
+	} block;
+	max_align_t alignment;
+};
+
+static const char* const SUBSYSTEM_NAMES[MEMORY_SUBSYSTEM_COUNT] = {
+	"m3u8",
+	"catalog",
+	"http",
+	"query",
+	"paths"
+};
+
+static struct MemoryStats stats[MEMORY_SUBSYSTEM_COUNT] = {0};
+
+static void stats_add(const enum MemorySubsystem subsystem, const size_t size) {
+	
+	struct MemoryStats* const item = &stats[subsystem];
+	
+	__atomic_add_fetch(&item->calls, 1, __ATOMIC_RELAXED);
+	
+	const uint64_t live = __atomic_add_fetch(&item->live, (uint64_t) size, __ATOMIC_RELAXED);
+	uint64_t peak = __atomic_load_n(&item->peak, __ATOMIC_RELAXED);
+	
+	while (live > peak && !__atomic_compare_exchange_n(&item->peak, &peak, live, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	
+}
+
+static void stats_remove(const enum MemorySubsystem subsystem, const size_t size) {
+	__atomic_sub_fetch(&stats[subsystem].live, (uint64_t) size, __ATOMIC_RELAXED);
+}
+
+void* memory_alloc(const enum MemorySubsystem subsystem, const size_t size) {
+	
+	if (size > SIZE_MAX - sizeof(union MemoryHeader)) {
+		return NULL;
+	}
+	
+	union MemoryHeader* const header = malloc(sizeof(*header) + size);
+	
+	if (header == NULL) {
+		return NULL;
+	}
+	
+	header->block.size = size;
+	header->block.subsystem = subsystem;
+	
+	stats_add(subsystem, size);
+	
+	return header + 1;
+	
+}
+
+void* memory_calloc(const enum MemorySubsystem subsystem, const size_t count, const size_t size) {
+	
+	if (size != 0 && count > (SIZE_MAX - sizeof(union MemoryHeader)) / size) {
+		return NULL;
+	}
+	
+	union MemoryHeader* const header = calloc(1, sizeof(*header) + count * size);
+	
+	if (header == NULL) {
+		return NULL;
+	}
+	
+	header->block.size = count * size;
+	header->block.subsystem = subsystem;
+	
+	stats_add(subsystem, count * size);
+	
+	return header + 1;
+	
+}
+
+void* memory_realloc(const enum MemorySubsystem subsystem, void* const ptr, const size_t size) {
+	/*
+	A block keeps the subsystem it was first allocated under.
+	*/
+	
+	if (ptr == NULL) {
+		return memory_alloc(subsystem, size);
+	}
+	
+	if (size > SIZE_MAX - sizeof(union MemoryHeader)) {
+		return NULL;
+	}
+	
+	union MemoryHeader* const header = realloc((union MemoryHeader*) ptr - 1, sizeof(*header) + size);
+	
+	if (header == NULL) {
+		return NULL;
+	}
+	
+	stats_remove(header->block.subsystem, header->block.size);
+	stats_add(header->block.subsystem, size);
+	
+	header->block.size = size;
+	
+	return header + 1;
+	
+}
+
+char* memory_strdup(const enum MemorySubsystem subsystem, const char* const s) {
+	
+	const size_t size = strlen(s) + 1;
+	char* const copy = memory_alloc(subsystem, size);
+	
+	if (copy == NULL) {
+		return NULL;
+	}
+	
+	memcpy(copy, s, size);
+	
+	return copy;
+	
+}
+
+void memory_free(void* const ptr) {
+	
+	if (ptr == NULL) {
+		return;
+	}
+	
+	union MemoryHeader* const header = (union MemoryHeader*) ptr - 1;
+	stats_remove(header->block.subsystem, header->block.size);
+	
+	free(header);
+	
+}
+
+void memory_report(FILE* const stream) {
+	
+	fprintf(stream, "+ Uso de memória por subsistema:\r\n");
+	/* The widths count bytes, and "alocações" has two characters that take two bytes each */
+	fprintf(stream, "  %-10s %14s %16s %16s\r\n", "subsistema", "alocações", "em uso (bytes)", "pico (bytes)");
+	
+	for (size_t index = 0; index < MEMORY_SUBSYSTEM_COUNT; index++) {
+		const struct MemoryStats* const item = &stats[index];
+		
+		fprintf(
+			stream,
+			"  %-10s %12llu %16llu %16llu\r\n",
+			SUBSYSTEM_NAMES[index],
+			(unsigned long long) __atomic_load_n(&item->calls, __ATOMIC_RELAXED),
+			(unsigned long long) __atomic_load_n(&item->live, __ATOMIC_RELAXED),
+			(unsigned long long) __atomic_load_n(&item->peak, __ATOMIC_RELAXED)
+		);
+	}
+	
+	fflush(stream);
+	
+}
+
+#ifndef _WIN32
+	static sigset_t watched;
+	
+	static void* memory_watcher(void* ptr) {
+		
+		(void) ptr;
+		
+		while (1) {
+			int number = 0;
+			
+			if (sigwait(&watched, &number) == 0) {
+				memory_report(stderr);
+			}
+		}
+		
+		return NULL;
+		
+	}
+#endif
+
+int memory_watch(void) {
+	/*
+	Prints the report whenever the process receives SIGUSR1. Must be called before any other
+	thread is started, since they inherit the signal mask set here.
+	*/
+	
+	#ifdef _WIN32
+		return 1;
+	#else
+		sigemptyset(&watched);
+		sigaddset(&watched, SIGUSR1);
+		
+		if (pthread_sigmask(SIG_BLOCK, &watched, NULL) != 0) {
+			return 0;
+		}
+		
+		pthread_t thread;
+		
+		if (pthread_create(&thread, NULL, memory_watcher, NULL) != 0) {
+			return 0;
+		}
+		
+		pthread_detach(thread);
+		
+		return 1;
+	#endif
+	
+}
@@ -0,0 +1,27 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+enum MemorySubsystem {
+	MEMORY_M3U8,
+	MEMORY_CATALOG,
+	/* Every struct String buffer, including the segments handed over to the remux pool */
+	MEMORY_HTTP,
+	MEMORY_QUERY,
+	MEMORY_PATHS,
+	MEMORY_SUBSYSTEM_COUNT
+};
+
+/*
+Blocks returned by these functions carry a small header with their size and subsystem, so
+they must be released with memory_free() and never passed to free() or realloc().
+*/
+void* memory_alloc(const enum MemorySubsystem subsystem, const size_t size);
+void* memory_calloc(const enum MemorySubsystem subsystem, const size_t count, const size_t size);
+void* memory_realloc(const enum MemorySubsystem subsystem, void* const ptr, const size_t size);
+char* memory_strdup(const enum MemorySubsystem subsystem, const char* const s);
+void memory_free(void* const ptr);
+
+void memory_report(FILE* const stream);
+int memory_watch(void);
+
+#pragma once
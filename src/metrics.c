@@ -0,0 +1,424 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <curl/curl.h>
+#include <jansson.h>
+
+#include "metrics.h"
+#include "errors.h"
+
+/*
+Values are counted in log-scaled buckets: each power of two is split into this many buckets
+of equal width, which keeps every percentile within about 12% of the real value.
+*/
+#define HISTOGRAM_SUB_BUCKETS 8
+#define HISTOGRAM_SUB_BUCKETS_BITS 3
+#define HISTOGRAM_BUCKETS (64 * HISTOGRAM_SUB_BUCKETS)
+
+/* Responses are counted by status code; anything outside this range, or no response at all, as 0 */
+#define STATUS_CODES 600
+
+enum TransferMetric {
+	METRIC_NAMELOOKUP,
+	METRIC_CONNECT,
+	METRIC_APPCONNECT,
+	METRIC_STARTTRANSFER,
+	METRIC_TOTAL,
+	METRIC_SIZE,
+	METRIC_SPEED,
+	METRIC_COUNT
+};
+
+struct Histogram {
+	uint32_t buckets[HISTOGRAM_BUCKETS];
+};
+
+struct TransferStats {
+	char* name;
+	uint64_t count;
+	uint64_t bytes;
+	struct Histogram histograms[METRIC_COUNT];
+};
+
+static const char* const CLASS_NAMES[TRANSFER_CLASS_COUNT] = {
+	"auth",
+	"catalog",
+	"player_page",
+	"playlist",
+	"segment",
+	"key",
+	"attachment"
+};
+
+/* Times are kept in microseconds and reported in seconds */
+static const struct {
+	const char* name;
+	double scale;
+} METRICS[METRIC_COUNT] = {
+	{"namelookup", 1e-6},
+	{"connect", 1e-6},
+	{"appconnect", 1e-6},
+	{"starttransfer", 1e-6},
+	{"total", 1e-6},
+	{"size", 1},
+	{"speed", 1}
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static int enabled = 0;
+
+static struct TransferStats classes[TRANSFER_CLASS_COUNT] = {0};
+
+static struct TransferStats* hosts = NULL;
+static size_t hosts_offset = 0;
+static size_t hosts_size = 0;
+
+/* Live values are always kept, whether or not the report was asked for */
+static uint64_t live_transfers[TRANSFER_CLASS_COUNT] = {0};
+static uint64_t live_bytes[TRANSFER_CLASS_COUNT] = {0};
+static uint64_t statuses[STATUS_CODES] = {0};
+static int64_t gauges[GAUGE_COUNT] = {0};
+static uint64_t counters[COUNTER_COUNT] = {0};
+
+static const struct {
+	const char* name;
+	const char* help;
+} GAUGES[GAUGE_COUNT] = {
+	{"active_transfers", "Transfers currently running on the shared multi handle"},
+	{"concurrency_window", "Most transfers allowed to run at once"},
+	{"remux_queue_jobs", "Media files waiting for or undergoing conversion"},
+	{"remux_queue_bytes", "Segment bytes queued for conversion"},
+	{"pages_total", "Lessons found in the products selected so far"},
+	{"pages_done", "Lessons already processed"}
+};
+
+static const struct {
+	const char* name;
+	const char* help;
+} COUNTERS[COUNTER_COUNT] = {
+	{"retries_total", "Requests sent again after the access token was refreshed"},
+	{"token_refreshes_total", "Access tokens obtained with the refresh token"}
+};
+
+static size_t histogram_index(const uint64_t value) {
+	
+	if (value < HISTOGRAM_SUB_BUCKETS) {
+		return (size_t) value;
+	}
+	
+	const int shift = (63 - __builtin_clzll(value)) - HISTOGRAM_SUB_BUCKETS_BITS;
+	const size_t sub = (size_t) (value >> shift) - HISTOGRAM_SUB_BUCKETS;
+	
+	return (size_t) (shift + 1) * HISTOGRAM_SUB_BUCKETS + sub;
+	
+}
+
+static uint64_t histogram_value(const size_t index) {
+	/*
+	Returns the midpoint of the bucket.
+	*/
+	
+	if (index < HISTOGRAM_SUB_BUCKETS) {
+		return (uint64_t) index;
+	}
+	
+	const int shift = (int) (index / HISTOGRAM_SUB_BUCKETS) - 1;
+	const uint64_t lower = (uint64_t) (HISTOGRAM_SUB_BUCKETS + index % HISTOGRAM_SUB_BUCKETS) << shift;
+	
+	return lower + (((uint64_t) 1 << shift) >> 1);
+	
+}
+
+static uint64_t histogram_percentile(const struct Histogram* const histogram, const uint64_t count, const double percentile) {
+	
+	uint64_t rank = (uint64_t) (percentile * (double) count + 0.999999);
+	
+	if (rank == 0) {
+		rank = 1;
+	}
+	
+	uint64_t seen = 0;
+	
+	for (size_t index = 0; index < HISTOGRAM_BUCKETS; index++) {
+		seen += histogram->buckets[index];
+		
+		if (seen >= rank) {
+			return histogram_value(index);
+		}
+	}
+	
+	return 0;
+	
+}
+
+static struct TransferStats* get_host(const char* const name) {
+	
+	for (size_t index = 0; index < hosts_offset; index++) {
+		if (strcmp(hosts[index].name, name) == 0) {
+			return &hosts[index];
+		}
+	}
+	
+	if (hosts_offset == hosts_size) {
+		const size_t size = hosts_size == 0 ? 8 : hosts_size * 2;
+		struct TransferStats* const items = realloc(hosts, sizeof(*hosts) * size);
+		
+		if (items == NULL) {
+			return NULL;
+		}
+		
+		hosts = items;
+		hosts_size = size;
+	}
+	
+	struct TransferStats* const stats = &hosts[hosts_offset];
+	memset(stats, 0, sizeof(*stats));
+	
+	stats->name = malloc(strlen(name) + 1);
+	
+	if (stats->name == NULL) {
+		return NULL;
+	}
+	
+	strcpy(stats->name, name);
+	hosts_offset++;
+	
+	return stats;
+	
+}
+
+static void stats_add(struct TransferStats* const stats, const uint64_t values[METRIC_COUNT]) {
+	
+	stats->count++;
+	stats->bytes += values[METRIC_SIZE];
+	
+	for (size_t index = 0; index < METRIC_COUNT; index++) {
+		stats->histograms[index].buckets[histogram_index(values[index])]++;
+	}
+	
+}
+
+void metrics_enable(void) {
+	enabled = 1;
+}
+
+void metrics_record(CURL* const handle, const enum TransferClass type) {
+	/*
+	Adds the transfer just completed on "handle" to the live counters and, when the report
+	was asked for, its timings to its class and to its host. Safe to call from any thread.
+	*/
+	
+	curl_off_t size = 0;
+	long response_code = 0;
+	
+	curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD_T, &size);
+	curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &response_code);
+	
+	if (response_code < 0 || response_code >= STATUS_CODES) {
+		response_code = 0;
+	}
+	
+	__atomic_add_fetch(&live_transfers[type], 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&live_bytes[type], (uint64_t) size, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&statuses[response_code], 1, __ATOMIC_RELAXED);
+	
+	if (!enabled) {
+		return;
+	}
+	
+	curl_off_t namelookup = 0;
+	curl_off_t connect = 0;
+	curl_off_t appconnect = 0;
+	curl_off_t starttransfer = 0;
+	curl_off_t total = 0;
+	curl_off_t speed = 0;
+	
+	curl_easy_getinfo(handle, CURLINFO_NAMELOOKUP_TIME_T, &namelookup);
+	curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME_T, &connect);
+	curl_easy_getinfo(handle, CURLINFO_APPCONNECT_TIME_T, &appconnect);
+	curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME_T, &starttransfer);
+	curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME_T, &total);
+	curl_easy_getinfo(handle, CURLINFO_SPEED_DOWNLOAD_T, &speed);
+	
+	const uint64_t values[METRIC_COUNT] = {
+		[METRIC_NAMELOOKUP] = (uint64_t) namelookup,
+		[METRIC_CONNECT] = (uint64_t) connect,
+		[METRIC_APPCONNECT] = (uint64_t) appconnect,
+		[METRIC_STARTTRANSFER] = (uint64_t) starttransfer,
+		[METRIC_TOTAL] = (uint64_t) total,
+		[METRIC_SIZE] = (uint64_t) size,
+		[METRIC_SPEED] = (uint64_t) speed
+	};
+	
+	const char* url = NULL;
+	char* host = NULL;
+	
+	curl_easy_getinfo(handle, CURLINFO_EFFECTIVE_URL, &url);
+	
+	CURLU* const cu = curl_url();
+	
+	if (cu != NULL && url != NULL && curl_url_set(cu, CURLUPART_URL, url, 0) == CURLUE_OK) {
+		curl_url_get(cu, CURLUPART_HOST, &host, 0);
+	}
+	
+	curl_url_cleanup(cu);
+	
+	pthread_mutex_lock(&lock);
+	
+	stats_add(&classes[type], values);
+	
+	struct TransferStats* const stats = host == NULL ? NULL : get_host(host);
+	
+	if (stats != NULL) {
+		stats_add(stats, values);
+	}
+	
+	pthread_mutex_unlock(&lock);
+	
+	curl_free(host);
+	
+}
+
+static json_t* stats_dump(const struct TransferStats* const stats) {
+	
+	json_t* const tree = json_pack("{s:I, s:I}", "count", (json_int_t) stats->count, "bytes", (json_int_t) stats->bytes);
+	
+	if (tree == NULL) {
+		return NULL;
+	}
+	
+	for (size_t index = 0; index < METRIC_COUNT; index++) {
+		const struct Histogram* const histogram = &stats->histograms[index];
+		const double scale = METRICS[index].scale;
+		
+		json_t* const percentiles = json_pack(
+			"{s:f, s:f, s:f}",
+			"p50", (double) histogram_percentile(histogram, stats->count, 0.50) * scale,
+			"p95", (double) histogram_percentile(histogram, stats->count, 0.95) * scale,
+			"p99", (double) histogram_percentile(histogram, stats->count, 0.99) * scale
+		);
+		
+		if (percentiles == NULL || json_object_set_new(tree, METRICS[index].name, percentiles) != 0) {
+			json_decref(tree);
+			return NULL;
+		}
+	}
+	
+	return tree;
+	
+}
+
+int metrics_report(const char* const filename) {
+	/*
+	Writes the percentiles of every class and host that saw at least one transfer as JSON.
+	*/
+	
+	json_auto_t* tree = json_pack("{s:{}, s:{}}", "classes", "hosts");
+	
+	if (tree == NULL) {
+		return UERR_MEMORY_ALLOCATE_FAILURE;
+	}
+	
+	json_t* const classes_tree = json_object_get(tree, "classes");
+	json_t* const hosts_tree = json_object_get(tree, "hosts");
+	
+	int status = UERR_SUCCESS;
+	
+	pthread_mutex_lock(&lock);
+	
+	for (size_t index = 0; index < TRANSFER_CLASS_COUNT && status == UERR_SUCCESS; index++) {
+		if (classes[index].count == 0) {
+			continue;
+		}
+		
+		json_t* const stats = stats_dump(&classes[index]);
+		
+		if (stats == NULL || json_object_set_new(classes_tree, CLASS_NAMES[index], stats) != 0) {
+			status = UERR_MEMORY_ALLOCATE_FAILURE;
+		}
+	}
+	
+	for (size_t index = 0; index < hosts_offset && status == UERR_SUCCESS; index++) {
+		json_t* const stats = stats_dump(&hosts[index]);
+		
+		if (stats == NULL || json_object_set_new(hosts_tree, hosts[index].name, stats) != 0) {
+			status = UERR_MEMORY_ALLOCATE_FAILURE;
+		}
+	}
+	
+	pthread_mutex_unlock(&lock);
+	
+	if (status == UERR_SUCCESS && json_dump_file(tree, filename, JSON_INDENT(4)) != 0) {
+		status = UERR_FILE_WRITE_FAILURE;
+	}
+	
+	return status;
+	
+}
+
+void metrics_gauge_set(const enum MetricsGauge gauge, const int64_t value) {
+	__atomic_store_n(&gauges[gauge], value, __ATOMIC_RELAXED);
+}
+
+void metrics_gauge_add(const enum MetricsGauge gauge, const int64_t delta) {
+	__atomic_add_fetch(&gauges[gauge], delta, __ATOMIC_RELAXED);
+}
+
+void metrics_count(const enum MetricsCounter counter) {
+	__atomic_add_fetch(&counters[counter], 1, __ATOMIC_RELAXED);
+}
+
+int metrics_export(FILE* const stream) {
+	/*
+	Writes the live values in the Prometheus text exposition format. Safe to call from any thread.
+	*/
+	
+	fprintf(stream, "# HELP sparklec_transfers_total Transfers completed, by class\n");
+	fprintf(stream, "# TYPE sparklec_transfers_total counter\n");
+	
+	for (size_t index = 0; index < TRANSFER_CLASS_COUNT; index++) {
+		fprintf(stream, "sparklec_transfers_total{class=\"%s\"} %llu\n", CLASS_NAMES[index], (unsigned long long) __atomic_load_n(&live_transfers[index], __ATOMIC_RELAXED));
+	}
+	
+	fprintf(stream, "# HELP sparklec_downloaded_bytes_total Bytes received by completed transfers, by class\n");
+	fprintf(stream, "# TYPE sparklec_downloaded_bytes_total counter\n");
+	
+	for (size_t index = 0; index < TRANSFER_CLASS_COUNT; index++) {
+		fprintf(stream, "sparklec_downloaded_bytes_total{class=\"%s\"} %llu\n", CLASS_NAMES[index], (unsigned long long) __atomic_load_n(&live_bytes[index], __ATOMIC_RELAXED));
+	}
+	
+	fprintf(stream, "# HELP sparklec_http_responses_total Completed transfers by HTTP status code, 0 when there was no response\n");
+	fprintf(stream, "# TYPE sparklec_http_responses_total counter\n");
+	
+	for (size_t index = 0; index < STATUS_CODES; index++) {
+		const uint64_t count = __atomic_load_n(&statuses[index], __ATOMIC_RELAXED);
+		
+		if (count > 0) {
+			fprintf(stream, "sparklec_http_responses_total{code=\"%zu\"} %llu\n", index, (unsigned long long) count);
+		}
+	}
+	
+	for (size_t index = 0; index < GAUGE_COUNT; index++) {
+		fprintf(stream, "# HELP sparklec_%s %s\n", GAUGES[index].name, GAUGES[index].help);
+		fprintf(stream, "# TYPE sparklec_%s gauge\n", GAUGES[index].name);
+		fprintf(stream, "sparklec_%s %lld\n", GAUGES[index].name, (long long) __atomic_load_n(&gauges[index], __ATOMIC_RELAXED));
+	}
+	
+	const int64_t pages_total = __atomic_load_n(&gauges[GAUGE_PAGES_TOTAL], __ATOMIC_RELAXED);
+	const int64_t pages_done = __atomic_load_n(&gauges[GAUGE_PAGES_DONE], __ATOMIC_RELAXED);
+	
+	fprintf(stream, "# HELP sparklec_pages_remaining Lessons found but not processed yet\n");
+	fprintf(stream, "# TYPE sparklec_pages_remaining gauge\n");
+	fprintf(stream, "sparklec_pages_remaining %lld\n", (long long) (pages_total > pages_done ? pages_total - pages_done : 0));
+	
+	for (size_t index = 0; index < COUNTER_COUNT; index++) {
+		fprintf(stream, "# HELP sparklec_%s %s\n", COUNTERS[index].name, COUNTERS[index].help);
+		fprintf(stream, "# TYPE sparklec_%s counter\n", COUNTERS[index].name);
+		fprintf(stream, "sparklec_%s %llu\n", COUNTERS[index].name, (unsigned long long) __atomic_load_n(&counters[index], __ATOMIC_RELAXED));
+	}
+	
+	return ferror(stream) ? UERR_FILE_WRITE_FAILURE : UERR_SUCCESS;
+	
+}
@@ -0,0 +1,43 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#include <curl/curl.h>
+
+enum TransferClass {
+	TRANSFER_AUTH,
+	TRANSFER_CATALOG,
+	TRANSFER_PLAYER_PAGE,
+	TRANSFER_PLAYLIST,
+	TRANSFER_SEGMENT,
+	TRANSFER_KEY,
+	TRANSFER_ATTACHMENT,
+	TRANSFER_CLASS_COUNT
+};
+
+/* Values sampled live by the exporter, as opposed to the histograms kept for the report */
+enum MetricsGauge {
+	GAUGE_ACTIVE_TRANSFERS,
+	GAUGE_CONCURRENCY_WINDOW,
+	GAUGE_REMUX_QUEUE_JOBS,
+	GAUGE_REMUX_QUEUE_BYTES,
+	GAUGE_PAGES_TOTAL,
+	GAUGE_PAGES_DONE,
+	GAUGE_COUNT
+};
+
+enum MetricsCounter {
+	COUNTER_RETRIES,
+	COUNTER_TOKEN_REFRESHES,
+	COUNTER_COUNT
+};
+
+void metrics_enable(void);
+void metrics_record(CURL* const handle, const enum TransferClass type);
+int metrics_report(const char* const filename);
+
+void metrics_gauge_set(const enum MetricsGauge gauge, const int64_t value);
+void metrics_gauge_add(const enum MetricsGauge gauge, const int64_t delta);
+void metrics_count(const enum MetricsCounter counter);
+int metrics_export(FILE* const stream);
+
+#pragma once
@@ -0,0 +1,226 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "options.h"
+#include "errors.h"
+#include "utils.h"
+
+static const char OPTION_REMUX_JOBS[] = "--remux-jobs";
+static const char OPTION_REMUX_SPOOL[] = "--remux-spool";
+static const char OPTION_SCRATCH_DIRECTORY[] = "--scratch-dir";
+static const char OPTION_VERIFY[] = "--verify";
+static const char OPTION_MEMORY_STATS[] = "--memory-stats";
+static const char OPTION_PLAN[] = "--plan";
+static const char OPTION_SELFTEST_THROUGHPUT[] = "--selftest-throughput";
+static const char OPTION_BUFFER_SIZE[] = "--buffer-size";
+static const char OPTION_REPORT[] = "--report";
+static const char OPTION_METRICS_FILE[] = "--metrics-file";
+static const char OPTION_EVENT_LOG[] = "--event-log";
+static const char OPTION_API_URL[] = "--api-url";
+static const char OPTION_RESOLVE[] = "--resolve";
+
+#ifndef _WIN32
+	static const char OPTION_METRICS_PORT[] = "--metrics-port";
+#endif
+
+#ifdef SPARKLEC_ENABLE_TRACE
+	static const char OPTION_TRACE[] = "--trace";
+#endif
+
+/* Bounds accepted by CURLOPT_BUFFERSIZE */
+#define BUFFER_SIZE_MIN 1024
+#define BUFFER_SIZE_MAX (1024 * 1024 * 10)
+
+#define PORT_MAX 65535
+
+static const char* option_get_value(
+	const char* const name,
+	const int argc,
+	char* const argv[],
+	int* const index
+) {
+	/*
+	Returns the value of an option given either as "--name=value" or as "--name value",
+	or NULL if argv[*index] is not that option or its value is missing.
+	*/
+	
+	const char* const argument = argv[*index];
+	const size_t size = strlen(name);
+	
+	if (strncmp(argument, name, size) != 0) {
+		return NULL;
+	}
+	
+	if (argument[size] == '=') {
+		return &argument[size + 1];
+	}
+	
+	if (argument[size] == '\0' && *index + 1 < argc) {
+		return argv[++*index];
+	}
+	
+	return NULL;
+	
+}
+
+static int parse_size(const char* const s, size_t* const value) {
+	
+	if (!isnumeric(s)) {
+		return 0;
+	}
+	
+	const unsigned long long number = strtoull(s, NULL, 10);
+	
+	if (number == 0) {
+		return 0;
+	}
+	
+	*value = (size_t) number;
+	
+	return 1;
+	
+}
+
+int options_parse(struct Options* const obj, const int argc, char* const argv[]) {
+	
+	obj->remux_jobs = get_cpu_count();
+	obj->scratch_directory = NULL;
+	obj->verify = 0;
+	obj->memory_stats = 0;
+	obj->plan = 0;
+	obj->selftest_throughput = 0;
+	obj->buffer_size = 1024 * 512;
+	obj->report_filename = NULL;
+	obj->trace_filename = NULL;
+	obj->metrics_filename = NULL;
+	obj->event_log_filename = NULL;
+	obj->metrics_port = 0;
+	obj->api_url = NULL;
+	obj->resolve = NULL;
+	obj->resolve_count = 0;
+	
+	for (int index = 1; index < argc; index++) {
+		const char* value = NULL;
+		
+		if (strcmp(argv[index], OPTION_VERIFY) == 0) {
+			obj->verify = 1;
+		} else if (strcmp(argv[index], OPTION_MEMORY_STATS) == 0) {
+			obj->memory_stats = 1;
+		} else if (strcmp(argv[index], OPTION_PLAN) == 0) {
+			obj->plan = 1;
+		} else if (strcmp(argv[index], OPTION_SELFTEST_THROUGHPUT) == 0) {
+			obj->selftest_throughput = 1;
+		} else if (strcmp(argv[index], OPTION_REMUX_SPOOL) == 0) {
+			obj->remux_spool = 1;
+		} else if ((value = option_get_value(OPTION_REMUX_JOBS, argc, argv, &index)) != NULL) {
+			if (!parse_size(value, &obj->remux_jobs)) {
+				return UERR_OPTIONS_INVALID_VALUE;
+			}
+		} else if ((value = option_get_value(OPTION_BUFFER_SIZE, argc, argv, &index)) != NULL) {
+			if (!parse_size(value, &obj->buffer_size) || obj->buffer_size < BUFFER_SIZE_MIN || obj->buffer_size > BUFFER_SIZE_MAX) {
+				return UERR_OPTIONS_INVALID_VALUE;
+			}
+		} else if ((value = option_get_value(OPTION_REPORT, argc, argv, &index)) != NULL) {
+			if (*value == '\0') {
+				return UERR_OPTIONS_INVALID_VALUE;
+			}
+			
+			obj->report_filename = value;
+		} else if ((value = option_get_value(OPTION_METRICS_FILE, argc, argv, &index)) != NULL) {
+			if (*value == '\0') {
+				return UERR_OPTIONS_INVALID_VALUE;
+			}
+			
+			obj->metrics_filename = value;
+		} else if ((value = option_get_value(OPTION_EVENT_LOG, argc, argv, &index)) != NULL) {
+			if (*value == '\0') {
+				return UERR_OPTIONS_INVALID_VALUE;
+			}
+			
+			obj->event_log_filename = value;
+	#ifndef _WIN32
+		} else if ((value = option_get_value(OPTION_METRICS_PORT, argc, argv, &index)) != NULL) {
+			if (!parse_size(value, &obj->metrics_port) || obj->metrics_port > PORT_MAX) {
+				return UERR_OPTIONS_INVALID_VALUE;
+			}
+	#endif
+	#ifdef SPARKLEC_ENABLE_TRACE
+		} else if ((value = option_get_value(OPTION_TRACE, argc, argv, &index)) != NULL) {
+			if (*value == '\0') {
+				return UERR_OPTIONS_INVALID_VALUE;
+			}
+			
+			obj->trace_filename = value;
+	#endif
+		} else if ((value = option_get_value(OPTION_SCRATCH_DIRECTORY, argc, argv, &index)) != NULL) {
+			if (*value == '\0') {
+				return UERR_OPTIONS_INVALID_VALUE;
+			}
+			
+			obj->scratch_directory = value;
+		} else if ((value = option_get_value(OPTION_API_URL, argc, argv, &index)) != NULL) {
+			if (*value == '\0') {
+				return UERR_OPTIONS_INVALID_VALUE;
+			}
+			
+			obj->api_url = value;
+		} else if ((value = option_get_value(OPTION_RESOLVE, argc, argv, &index)) != NULL) {
+			if (*value == '\0') {
+				return UERR_OPTIONS_INVALID_VALUE;
+			}
+			
+			const char** const items = realloc(obj->resolve, sizeof(*obj->resolve) * (obj->resolve_count + 1));
+			
+			if (items == NULL) {
+				return UERR_MEMORY_ALLOCATE_FAILURE;
+			}
+			
+			items[obj->resolve_count++] = value;
+			obj->resolve = items;
+		} else {
+			return UERR_OPTIONS_UNKNOWN;
+		}
+	}
+	
+	return UERR_SUCCESS;
+	
+}
+
+void options_usage(FILE* const stream, const char* const program) {
+	
+	fprintf(stream, "Uso: %s [opções]\r\n", program);
+	fprintf(stream, "\r\n");
+	fprintf(stream, "  %s=<n>     Número de conversões de mídia em paralelo (padrão: número de núcleos)\r\n", OPTION_REMUX_JOBS);
+	fprintf(stream, "  %s      Guarda também o MPEG-TS de cada aula até a conversão terminar, para que o FFmpeg possa refazê-la\r\n", OPTION_REMUX_SPOOL);
+	fprintf(stream, "  %s=<dir>  Diretório para arquivos temporários, de preferência em um disco local\r\n", OPTION_SCRATCH_DIRECTORY);
+	fprintf(stream, "  %s=<n>    Tamanho do buffer de recepção, em bytes (padrão: 524288)\r\n", OPTION_BUFFER_SIZE);
+	fprintf(stream, "  %s=<arquivo>   Grava ao sair um relatório em JSON com os tempos das transferências\r\n", OPTION_REPORT);
+	fprintf(stream, "  %s=<arquivo> Regrava a cada 5 segundos as métricas no formato do Prometheus (textfile do node_exporter)\r\n", OPTION_METRICS_FILE);
+	
+	fprintf(stream, "  %s=<arquivo>   Grava um evento em JSON por linha a cada etapa, com ids, tempos, bytes e códigos de erro\r\n", OPTION_EVENT_LOG);
+	
+	#ifndef _WIN32
+		fprintf(stream, "  %s=<n>    Serve as métricas no formato do Prometheus em http://127.0.0.1:<n>/metrics\r\n", OPTION_METRICS_PORT);
+	#endif
+	
+	#ifdef SPARKLEC_ENABLE_TRACE
+		fprintf(stream, "  %s=<arquivo>    Grava os eventos de cada etapa no formato de trace do Chrome/Perfetto\r\n", OPTION_TRACE);
+	#endif
+	
+	fprintf(stream, "  %s             Confere o conteúdo dos arquivos já baixados, não apenas o tamanho\r\n", OPTION_VERIFY);
+	fprintf(stream, "  %s               Apenas estima aulas, segmentos, duração e tamanho do que seria baixado, sem baixar nada\r\n", OPTION_PLAN);
+	fprintf(stream, "  %s Mede, sem rede, a vazão máxima de recepção, gravação, sha256, decifragem e leitura de playlists\r\n", OPTION_SELFTEST_THROUGHPUT);
+	fprintf(stream, "  %s       Mostra ao sair a memória alocada por subsistema (também com o sinal SIGUSR1)\r\n", OPTION_MEMORY_STATS);
+	fprintf(stream, "  %s=<url>      Usa outro servidor no lugar das APIs do Hotmart (ex.: http://127.0.0.1:8080)\r\n", OPTION_API_URL);
+	fprintf(stream, "  %s=<h:p:ip>   Resolve o host h, porta p, para o endereço ip; substitui a tabela interna (repetível)\r\n", OPTION_RESOLVE);
+	
+}
+
+void options_free(struct Options* const obj) {
+	
+	free(obj->resolve);
+	obj->resolve = NULL;
+	obj->resolve_count = 0;
+	
+}
@@ -0,0 +1,27 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+struct Options {
+	size_t remux_jobs;
+	int remux_spool;
+	const char* scratch_directory;
+	int verify;
+	int memory_stats;
+	int plan;
+	int selftest_throughput;
+	size_t buffer_size;
+	const char* report_filename;
+	const char* trace_filename;
+	const char* metrics_filename;
+	const char* event_log_filename;
+	size_t metrics_port;
+	const char* api_url;
+	const char** resolve;
+	size_t resolve_count;
+};
+
+int options_parse(struct Options* const obj, const int argc, char* const argv[]);
+void options_usage(FILE* const stream, const char* const program);
+void options_free(struct Options* const obj);
+
+#pragma once
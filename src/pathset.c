@@ -0,0 +1,254 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "pathset.h"
+#include "symbols.h"
+#include "utils.h"
+#include "memory.h"
+
+/* Number of slots allocated the first time an item is added */
+#define PATHSET_INITIAL_SIZE 256
+
+static uint64_t pathset_hash(const char* const path) {
+	/*
+	FNV-1a
+	*/
+	
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	
+	for (const unsigned char* ch = (const unsigned char*) path; *ch != '\0'; ch++) {
+		hash ^= *ch;
+		hash *= 0x100000001b3ULL;
+	}
+	
+	return hash;
+	
+}
+
+static char** pathset_find(char** const items, const size_t size, const char* const path) {
+	/*
+	Returns the slot holding "path", or the empty slot where it would be inserted.
+	*/
+	
+	size_t index = (size_t) pathset_hash(path) & (size - 1);
+	
+	while (items[index] != NULL && strcmp(items[index], path) != 0) {
+		index = (index + 1) & (size - 1);
+	}
+	
+	return &items[index];
+	
+}
+
+static int pathset_grow(struct PathSet* const obj) {
+	
+	const size_t size = obj->size == 0 ? PATHSET_INITIAL_SIZE : obj->size * 2;
+	char** const items = memory_calloc(MEMORY_PATHS, size, sizeof(*items));
+	
+	if (items == NULL) {
+		return 0;
+	}
+	
+	for (size_t index = 0; index < obj->size; index++) {
+		char* const item = obj->items[index];
+		
+		if (item != NULL) {
+			*pathset_find(items, size, item) = item;
+		}
+	}
+	
+	memory_free(obj->items);
+	
+	obj->items = items;
+	obj->size = size;
+	
+	return 1;
+	
+}
+
+int pathset_add(struct PathSet* const obj, const char* const path) {
+	
+	if ((obj->offset + 1) * 2 > obj->size && !pathset_grow(obj)) {
+		return 0;
+	}
+	
+	char** const slot = pathset_find(obj->items, obj->size, path);
+	
+	if (*slot != NULL) {
+		return 1;
+	}
+	
+	*slot = memory_strdup(MEMORY_PATHS, path);
+	
+	if (*slot == NULL) {
+		return 0;
+	}
+	obj->offset++;
+	
+	return 1;
+	
+}
+
+int pathset_contains(const struct PathSet* const obj, const char* const path) {
+	
+	if (obj->size == 0) {
+		return 0;
+	}
+	
+	return *pathset_find(obj->items, obj->size, path) != NULL;
+	
+}
+
+#ifdef _WIN32
+	static int pathset_scan_level(
+		struct PathSet* const obj,
+		const char* const directory,
+		const char* const prefix,
+		const size_t depth
+	) {
+		
+		char pattern[strlen(directory) + strlen(PATH_SEPARATOR) + 2];
+		strcpy(pattern, directory);
+		strcat(pattern, PATH_SEPARATOR);
+		strcat(pattern, "*");
+		
+		struct WalkDir walkdir = {0};
+		
+		/* An empty directory is not an error; one that cannot be listed is */
+		if (!walk_dir_init(&walkdir, pattern)) {
+			return GetLastError() == ERROR_FILE_NOT_FOUND;
+		}
+		
+		while (1) {
+			const char* const name = walk_dir(&walkdir);
+			
+			if (name == NULL) {
+				break;
+			}
+			
+			if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+				continue;
+			}
+			
+			const int is_directory = (walkdir.data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+			
+			if (is_directory != (depth > 1)) {
+				continue;
+			}
+			
+			char path[strlen(prefix) + strlen(PATH_SEPARATOR) + strlen(name) + 1];
+			strcpy(path, prefix);
+			
+			if (*prefix != '\0') {
+				strcat(path, PATH_SEPARATOR);
+			}
+			
+			strcat(path, name);
+			
+			if (depth > 1) {
+				char subdirectory[strlen(directory) + strlen(PATH_SEPARATOR) + strlen(name) + 1];
+				strcpy(subdirectory, directory);
+				strcat(subdirectory, PATH_SEPARATOR);
+				strcat(subdirectory, name);
+				
+				if (!pathset_scan_level(obj, subdirectory, path, depth - 1)) {
+					FindClose(walkdir.handle);
+					memory_free(walkdir.last_path);
+					
+					return 0;
+				}
+			} else if (!pathset_add(obj, path)) {
+				FindClose(walkdir.handle);
+				memory_free(walkdir.last_path);
+				
+				return 0;
+			}
+		}
+		
+		return 1;
+		
+	}
+#endif
+
+int pathset_scan(struct PathSet* const obj, const char* const directory, const size_t depth) {
+	/*
+	Adds every regular file found exactly "depth" levels below "directory", keyed by its path
+	relative to it. On POSIX systems the whole tree is listed by a single glob() call.
+	*/
+	
+	#ifdef _WIN32
+		return pathset_scan_level(obj, directory, "", depth);
+	#else
+		/* The directory is matched literally, so glob metacharacters in it are escaped */
+		char pattern[strlen(directory) * 2 + depth * 2 + 1];
+		char* ptr = pattern;
+		
+		for (const char* ch = directory; *ch != '\0'; ch++) {
+			if (strchr("\\*?[", *ch) != NULL) {
+				*ptr++ = '\\';
+			}
+			
+			*ptr++ = *ch;
+		}
+		
+		for (size_t index = 0; index < depth; index++) {
+			*ptr++ = *PATH_SEPARATOR;
+			*ptr++ = '*';
+		}
+		
+		*ptr = '\0';
+		
+		/*
+		glob() is called directly rather than through walk_dir_init(), so that a tree with nothing
+		in it can be told apart from one that could not be read.
+		*/
+		struct WalkDir walkdir = {0};
+		
+		switch (glob(pattern, GLOB_MARK | GLOB_NOSORT | GLOB_ERR, NULL, &walkdir.data)) {
+			case 0:
+				break;
+			case GLOB_NOMATCH:
+				return 1;
+			default:
+				return 0;
+		}
+		
+		while (1) {
+			const char* const path = walk_dir(&walkdir);
+			
+			if (path == NULL) {
+				break;
+			}
+			
+			/* Directories are marked with a trailing separator */
+			if (*(strchr(path, '\0') - 1) == *PATH_SEPARATOR) {
+				continue;
+			}
+			
+			if (!pathset_add(obj, path + strlen(directory) + strlen(PATH_SEPARATOR))) {
+				globfree(&walkdir.data);
+				memory_free(walkdir.last_path);
+				
+				return 0;
+			}
+		}
+		
+		return 1;
+	#endif
+	
+}
+
+void pathset_free(struct PathSet* const obj) {
+	
+	for (size_t index = 0; index < obj->size; index++) {
+		memory_free(obj->items[index]);
+	}
+	
+	memory_free(obj->items);
+	
+	obj->items = NULL;
+	obj->size = 0;
+	obj->offset = 0;
+	
+}
@@ -0,0 +1,14 @@
+#include <stdlib.h>
+
+struct PathSet {
+	char** items;
+	size_t size;
+	size_t offset;
+};
+
+int pathset_add(struct PathSet* const obj, const char* const path);
+int pathset_contains(const struct PathSet* const obj, const char* const path);
+int pathset_scan(struct PathSet* const obj, const char* const directory, const size_t depth);
+void pathset_free(struct PathSet* const obj);
+
+#pragma once
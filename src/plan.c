@@ -0,0 +1,129 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "plan.h"
+
+/* Width of the label column, in characters */
+#define PLAN_LABEL_WIDTH 22
+
+static void counts_merge(struct PlanCounts* const dst, const struct PlanCounts* const src) {
+	
+	dst->pages += src->pages;
+	dst->medias += src->medias;
+	dst->segments += src->segments;
+	dst->keys += src->keys;
+	dst->duration += src->duration;
+	dst->media_bytes += src->media_bytes;
+	dst->attachments += src->attachments;
+	dst->attachment_bytes += src->attachment_bytes;
+	dst->unsized += src->unsized;
+	
+}
+
+static size_t counts_requests(const struct PlanCounts* const counts) {
+	/*
+	Requests a download of these outputs makes: two playlists per video, then its segments and
+	keys, and one request per attachment.
+	*/
+	
+	return counts->medias * 2 + counts->segments + counts->keys + counts->attachments;
+	
+}
+
+static void format_time(char* const dst, const size_t size, const double seconds) {
+	
+	const uint64_t value = (uint64_t) (seconds + 0.5);
+	
+	snprintf(dst, size, "%llu:%02u:%02u", (unsigned long long) (value / 3600), (unsigned int) (value / 60 % 60), (unsigned int) (value % 60));
+	
+}
+
+static void format_size(char* const dst, const size_t size, const uint64_t bytes) {
+	
+	if (bytes >= 1024ULL * 1024 * 1024) {
+		snprintf(dst, size, "%.2f GB", (double) bytes / (1024 * 1024 * 1024));
+	} else {
+		snprintf(dst, size, "%.2f MB", (double) bytes / (1024 * 1024));
+	}
+	
+}
+
+static void print_row(FILE* const stream, const char* const label, const char* const total, const char* const missing) {
+	
+	/* Padding is counted in characters, not bytes, since labels carry accented letters */
+	size_t width = 0;
+	
+	for (const char* ch = label; *ch != '\0'; ch++) {
+		if (((unsigned char) *ch & 0xC0) != 0x80) {
+			width++;
+		}
+	}
+	
+	fprintf(stream, "  %s%*s %14s %14s\r\n", label, (int) (width < PLAN_LABEL_WIDTH ? PLAN_LABEL_WIDTH - width : 0), "", total, missing);
+	
+}
+
+static void print_count(FILE* const stream, const char* const label, const size_t total, const size_t missing) {
+	
+	char total_value[32];
+	snprintf(total_value, sizeof(total_value), "%zu", total);
+	
+	char missing_value[32];
+	snprintf(missing_value, sizeof(missing_value), "%zu", missing);
+	
+	print_row(stream, label, total_value, missing_value);
+	
+}
+
+static void print_size(FILE* const stream, const char* const label, const uint64_t total, const uint64_t missing) {
+	
+	char total_value[32];
+	format_size(total_value, sizeof(total_value), total);
+	
+	char missing_value[32];
+	format_size(missing_value, sizeof(missing_value), missing);
+	
+	print_row(stream, label, total_value, missing_value);
+	
+}
+
+void plan_merge(struct Plan* const dst, const struct Plan* const src) {
+	
+	counts_merge(&dst->total, &src->total);
+	counts_merge(&dst->missing, &src->missing);
+	
+}
+
+void plan_print(FILE* const stream, const char* const title, const struct Plan* const plan) {
+	
+	const struct PlanCounts* const total = &plan->total;
+	const struct PlanCounts* const missing = &plan->missing;
+	
+	fprintf(stream, "+ %s:\r\n", title);
+	print_row(stream, "", "total", "a baixar");
+	
+	print_count(stream, "aulas", total->pages, missing->pages);
+	print_count(stream, "vídeos", total->medias, missing->medias);
+	print_count(stream, "segmentos", total->segments, missing->segments);
+	
+	char total_duration[32];
+	format_time(total_duration, sizeof(total_duration), total->duration);
+	
+	char missing_duration[32];
+	format_time(missing_duration, sizeof(missing_duration), missing->duration);
+	
+	print_row(stream, "duração", total_duration, missing_duration);
+	print_size(stream, "tamanho dos vídeos", total->media_bytes, missing->media_bytes);
+	print_count(stream, "anexos", total->attachments, missing->attachments);
+	print_size(stream, "tamanho dos anexos", total->attachment_bytes, missing->attachment_bytes);
+	print_count(stream, "requisições", counts_requests(total), counts_requests(missing));
+	
+	if (total->unsized > 0) {
+		fprintf(stream, "- O tamanho de %zu arquivo(s) não pôde ser estimado e não está incluído acima\r\n", total->unsized);
+	}
+	
+	fprintf(stream, "\r\n");
+	
+}
@@ -0,0 +1,26 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+/* Sizes are estimates: BANDWIDTH times duration for videos, Content-Length for attachments */
+struct PlanCounts {
+	size_t pages;
+	size_t medias;
+	size_t segments;
+	size_t keys;
+	double duration;
+	uint64_t media_bytes;
+	size_t attachments;
+	uint64_t attachment_bytes;
+	size_t unsized;
+};
+
+struct Plan {
+	struct PlanCounts total;
+	struct PlanCounts missing;
+};
+
+void plan_merge(struct Plan* const dst, const struct Plan* const src);
+void plan_print(FILE* const stream, const char* const title, const struct Plan* const plan);
+
+#pragma once
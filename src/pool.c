@@ -0,0 +1,596 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "pool.h"
+#include "remux.h"
+#include "decrypt.h"
+#include "sha256.h"
+#include "errors.h"
+#include "utils.h"
+#include "trace.h"
+#include "metrics.h"
+#include "eventlog.h"
+
+/* Segments waiting for a worker may not take more memory than this, unless the queue is empty */
+#define REMUX_POOL_MAX_QUEUED (1024 * 1024 * 256)
+
+/* Appended to the output's staging name for the copy of the MPEG-TS stream kept with --remux-spool */
+static const char SPOOL_FILE_EXTENSION[] = ".ts";
+
+struct RemuxOutput {
+	const char* filename;
+	const char* destination;
+	FILE* stream;
+	struct Remuxer remuxer;
+	int remux;
+	char* spool_filename;
+	FILE* spool;
+	struct Process ffmpeg;
+	size_t segments;
+};
+
+static void segment_free(struct RemuxSegment* const segment) {
+	
+	string_free(&segment->data);
+	free(segment);
+	
+}
+
+static struct RemuxSegment* job_next_segment(struct RemuxPool* const obj, struct RemuxJob* const job) {
+	/*
+	Waits for the next segment of the job. Returns NULL once the downloader has closed the
+	job and every segment has been taken.
+	*/
+	
+	pthread_mutex_lock(&obj->lock);
+	
+	while (job->head == NULL && !job->closed && !obj->stopping) {
+		pthread_cond_wait(&obj->cond, &obj->lock);
+	}
+	
+	struct RemuxSegment* const segment = job->head;
+	
+	if (segment != NULL) {
+		job->head = segment->next;
+		
+		if (job->head == NULL) {
+			job->tail = NULL;
+		}
+		
+		obj->queued -= segment->data.slength;
+		metrics_gauge_set(GAUGE_REMUX_QUEUE_BYTES, (int64_t) obj->queued);
+		
+		pthread_cond_broadcast(&obj->cond);
+	} else if (!job->closed) {
+		/* Shutting down while the downloader still owns the job */
+		job->closed = 1;
+		job->aborted = 1;
+	}
+	
+	pthread_mutex_unlock(&obj->lock);
+	
+	return segment;
+	
+}
+
+static int output_ffmpeg_start(struct RemuxOutput* const output, const char* const input) {
+	
+	fprintf(stderr, "- Não foi possível converter '%s' diretamente, usando o FFmpeg\r\n", output->destination);
+	
+	const char* const argv[] = {
+		"ffmpeg",
+		"-nostdin",
+		"-loglevel", "error",
+		"-f", "mpegts",
+		"-i", input,
+		"-c", "copy",
+		"-movflags", "+faststart",
+		"-map_metadata", "-1",
+		"-f", "mp4",
+		output->filename,
+		NULL
+	};
+	
+	return process_spawn(&output->ffmpeg, argv);
+	
+}
+
+static void output_abandon_remux(struct RemuxOutput* const output) {
+	/*
+	Throws away what the in-process remuxer wrote; FFmpeg converts the spooled stream instead.
+	*/
+	
+	output->remux = 0;
+	
+	remuxer_free(&output->remuxer);
+	fclose(output->stream);
+	output->stream = NULL;
+	
+	remove_file(output->filename);
+	
+}
+
+static int output_write(struct RemuxOutput* const output, const struct String* const data) {
+	/*
+	Hands a segment to the in-process remuxer, or to FFmpeg when the remuxer could not be set up.
+	FFmpeg can take over from a remuxer that gives up halfway through only if the stream was
+	spooled to disk; otherwise, only while it is still on the first segment.
+	*/
+	
+	if (output->spool != NULL && fwrite(data->s, 1, data->slength, output->spool) != data->slength) {
+		return UERR_FILE_WRITE_FAILURE;
+	}
+	
+	if (output->remux) {
+		const int code = remuxer_feed(&output->remuxer, (unsigned char*) data->s, data->slength);
+		
+		if (code != UERR_SUCCESS && output->spool == NULL && output->segments > 0) {
+			fprintf(stderr, "- Não foi possível converter '%s' diretamente, e o início da aula não foi guardado para o FFmpeg\r\n", output->destination);
+			return code;
+		}
+		
+		if (code != UERR_SUCCESS) {
+			output_abandon_remux(output);
+		}
+	}
+	
+	if (!output->remux && output->spool == NULL) {
+		if (output->ffmpeg.input == NULL && !output_ffmpeg_start(output, "pipe:0")) {
+			return UERR_FILE_WRITE_FAILURE;
+		}
+		
+		if (fwrite(data->s, 1, data->slength, output->ffmpeg.input) != data->slength) {
+			return UERR_FILE_WRITE_FAILURE;
+		}
+	}
+	
+	output->segments++;
+	
+	return UERR_SUCCESS;
+	
+}
+
+static int output_finish(struct RemuxOutput* const output, int status) {
+	/*
+	Completes the output, falling back to FFmpeg on the spooled stream, if any, when the remuxer
+	fails to finish it, and removes the spool.
+	*/
+	
+	if (output->remux && status == UERR_SUCCESS) {
+		const int code = remuxer_finish(&output->remuxer);
+		
+		if (code != UERR_SUCCESS && output->spool == NULL) {
+			status = code;
+		} else if (code != UERR_SUCCESS) {
+			output_abandon_remux(output);
+		}
+	}
+	
+	remuxer_free(&output->remuxer);
+	
+	if (output->stream != NULL) {
+		fclose(output->stream);
+		output->stream = NULL;
+	}
+	
+	if (output->spool != NULL) {
+		if (fclose(output->spool) != 0 && status == UERR_SUCCESS) {
+			status = UERR_FILE_WRITE_FAILURE;
+		}
+		
+		output->spool = NULL;
+		
+		if (status == UERR_SUCCESS && !output->remux && !output_ffmpeg_start(output, output->spool_filename)) {
+			status = UERR_FILE_WRITE_FAILURE;
+		}
+	}
+	
+	if (output->ffmpeg.input != NULL && process_wait(&output->ffmpeg) != 0 && status == UERR_SUCCESS) {
+		status = UERR_FILE_WRITE_FAILURE;
+	}
+	
+	if (output->spool_filename != NULL) {
+		remove_file(output->spool_filename);
+		
+		free(output->spool_filename);
+		output->spool_filename = NULL;
+	}
+	
+	return status;
+	
+}
+
+static int job_run(struct RemuxPool* const obj, struct RemuxJob* const job) {
+	
+	TRACE_BEGIN(start);
+	const uint64_t started = eventlog_now();
+	
+	struct RemuxOutput output = {
+		.filename = job->filename,
+		.destination = job->destination
+	};
+	
+	output.stream = fopen(job->filename, "wb");
+	
+	if (output.stream != NULL && remuxer_init(&output.remuxer, output.stream, job->duration) != UERR_SUCCESS) {
+		fclose(output.stream);
+		output.stream = NULL;
+		
+		remove_file(job->filename);
+	}
+	
+	output.remux = output.stream != NULL;
+	
+	if (output.remux && obj->spool) {
+		output.spool_filename = malloc(strlen(job->filename) + strlen(SPOOL_FILE_EXTENSION) + 1);
+		
+		if (output.spool_filename != NULL) {
+			strcpy(output.spool_filename, job->filename);
+			strcat(output.spool_filename, SPOOL_FILE_EXTENSION);
+			
+			output.spool = fopen(output.spool_filename, "wb");
+		}
+	}
+	
+	int status = output.remux && obj->spool && output.spool == NULL ? UERR_FILE_WRITE_FAILURE : UERR_SUCCESS;
+	
+	struct RemuxSegment* segment = NULL;
+	
+	/* Segments keep being taken after a failure, so that the downloader is never left waiting */
+	while ((segment = job_next_segment(obj, job)) != NULL) {
+		if (status == UERR_SUCCESS && segment->encrypted) {
+			status = decrypt_segment(segment->key, segment->iv, (unsigned char*) segment->data.s, &segment->data.slength);
+		}
+		
+		if (status == UERR_SUCCESS) {
+			status = output_write(&output, &segment->data);
+		}
+		
+		segment_free(segment);
+	}
+	
+	pthread_mutex_lock(&obj->lock);
+	const int aborted = job->aborted;
+	pthread_mutex_unlock(&obj->lock);
+	
+	if (status == UERR_SUCCESS && aborted) {
+		status = UERR_CURL_FAILURE;
+	}
+	
+	if (status == UERR_SUCCESS && output.segments == 0) {
+		status = UERR_REMUX_INVALID_STREAM;
+	}
+	
+	status = output_finish(&output, status);
+	
+	/*
+	The muxer seeks back to fill in its headers, so the digest is taken once the file is complete,
+	while it is still in the page cache.
+	*/
+	char sha256[SHA256_HEX_SIZE];
+	uint64_t size = 0;
+	
+	if (status == UERR_SUCCESS && obj->manifest != NULL && !sha256_file(job->filename, sha256, &size)) {
+		status = UERR_FILE_READ_FAILURE;
+	}
+	
+	if (status == UERR_SUCCESS && !publish_file(job->filename, job->destination)) {
+		status = UERR_FILE_WRITE_FAILURE;
+	}
+	
+	if (status == UERR_SUCCESS && obj->manifest != NULL) {
+		manifest_deduplicate(obj->manifest, job->destination, size, sha256);
+		status = manifest_record(obj->manifest, job->destination, size, sha256, job->source);
+	}
+	
+	if (status != UERR_SUCCESS) {
+		remove_file(job->filename);
+		
+		if (!aborted) {
+			fprintf(stderr, "- Ocorreu uma falha ao converter '%s'!\r\n", job->destination);
+		}
+	}
+	
+	TRACE_END(start, "remux", job->destination);
+	
+	eventlog_emit(
+		"remux",
+		"{s:s, s:I, s:I, s:b, s:b, s:i, s:f}",
+		"file", job->destination,
+		"segments", (json_int_t) output.segments,
+		"bytes", (json_int_t) size,
+		"ffmpeg", !output.remux,
+		"aborted", aborted,
+		"status", status,
+		"duration", eventlog_elapsed(started)
+	);
+	
+	return status;
+	
+}
+
+static void* remux_pool_worker(void* ptr) {
+	
+	struct RemuxPool* const obj = (struct RemuxPool*) ptr;
+	
+	/* Remuxing must not slow down the downloads it is running next to */
+	lower_thread_priority();
+	
+	while (1) {
+		pthread_mutex_lock(&obj->lock);
+		
+		while (obj->head == NULL && !obj->stopping) {
+			pthread_cond_wait(&obj->cond, &obj->lock);
+		}
+		
+		struct RemuxJob* const job = obj->head;
+		
+		if (job == NULL) {
+			pthread_mutex_unlock(&obj->lock);
+			break;
+		}
+		
+		obj->head = job->next;
+		
+		if (obj->head == NULL) {
+			obj->tail = NULL;
+		}
+		
+		pthread_mutex_unlock(&obj->lock);
+		
+		const int status = job_run(obj, job);
+		
+		free(job->filename);
+		free(job->destination);
+		free(job->source);
+		free(job);
+		
+		pthread_mutex_lock(&obj->lock);
+		
+		if (status != UERR_SUCCESS) {
+			obj->failures++;
+		}
+		
+		obj->pending--;
+		metrics_gauge_set(GAUGE_REMUX_QUEUE_JOBS, (int64_t) obj->pending);
+		
+		pthread_cond_broadcast(&obj->cond);
+		pthread_mutex_unlock(&obj->lock);
+	}
+	
+	return NULL;
+	
+}
+
+int remux_pool_init(struct RemuxPool* const obj, const size_t workers, struct Manifest* const manifest, const int spool) {
+	/*
+	Starts the workers that turn downloaded segments into media files. At most twice as many
+	lectures as there are workers are accepted before remux_pool_submit() waits for one to finish.
+	Finished files are recorded in "manifest", if given. With "spool", the MPEG-TS stream of each
+	lecture is also kept on disk until it is converted.
+	*/
+	
+	memset(obj, 0, sizeof(*obj));
+	
+	obj->threads = malloc(sizeof(*obj->threads) * workers);
+	
+	if (obj->threads == NULL) {
+		return UERR_MEMORY_ALLOCATE_FAILURE;
+	}
+	
+	obj->max_pending = workers * 2;
+	obj->manifest = manifest;
+	obj->spool = spool;
+	
+	pthread_mutex_init(&obj->lock, NULL);
+	pthread_cond_init(&obj->cond, NULL);
+	
+	for (size_t index = 0; index < workers; index++) {
+		if (pthread_create(&obj->threads[index], NULL, remux_pool_worker, obj) != 0) {
+			remux_pool_free(obj);
+			return UERR_PTHREAD_FAILURE;
+		}
+		
+		obj->threads_count++;
+	}
+	
+	return UERR_SUCCESS;
+	
+}
+
+struct RemuxJob* remux_pool_submit(
+	struct RemuxPool* const obj,
+	const char* const filename,
+	const char* const destination,
+	const char* const source,
+	const double duration
+) {
+	/*
+	Queues a lecture that is written to "filename" and published as "destination" once complete.
+	"source" identifies where it came from in the manifest.
+	*/
+	
+	struct RemuxJob* const job = malloc(sizeof(*job));
+	
+	if (job == NULL) {
+		return NULL;
+	}
+	
+	memset(job, 0, sizeof(*job));
+	
+	job->filename = malloc(strlen(filename) + 1);
+	job->destination = malloc(strlen(destination) + 1);
+	job->source = malloc(strlen(source) + 1);
+	
+	if (job->filename == NULL || job->destination == NULL || job->source == NULL) {
+		free(job->filename);
+		free(job->destination);
+		free(job->source);
+		free(job);
+		
+		return NULL;
+	}
+	
+	strcpy(job->filename, filename);
+	strcpy(job->destination, destination);
+	strcpy(job->source, source);
+	job->duration = duration;
+	
+	pthread_mutex_lock(&obj->lock);
+	
+	while (obj->pending >= obj->max_pending) {
+		pthread_cond_wait(&obj->cond, &obj->lock);
+	}
+	
+	if (obj->tail == NULL) {
+		obj->head = job;
+	} else {
+		obj->tail->next = job;
+	}
+	
+	obj->tail = job;
+	obj->pending++;
+	metrics_gauge_set(GAUGE_REMUX_QUEUE_JOBS, (int64_t) obj->pending);
+	
+	pthread_cond_broadcast(&obj->cond);
+	pthread_mutex_unlock(&obj->lock);
+	
+	return job;
+	
+}
+
+int remux_job_push(
+	struct RemuxPool* const obj,
+	struct RemuxJob* const job,
+	struct String* const data,
+	const unsigned char* const key,
+	const unsigned char* const iv
+) {
+	/*
+	Queues the next segment of the job, taking ownership of its data. Segments must be pushed
+	in playlist order; they are decrypted on the worker when a key is given.
+	*/
+	
+	struct RemuxSegment* const segment = malloc(sizeof(*segment));
+	
+	if (segment == NULL) {
+		return UERR_MEMORY_ALLOCATE_FAILURE;
+	}
+	
+	memset(segment, 0, sizeof(*segment));
+	
+	segment->data = *data;
+	memset(data, 0, sizeof(*data));
+	
+	if (key != NULL) {
+		segment->encrypted = 1;
+		memcpy(segment->key, key, sizeof(segment->key));
+		memcpy(segment->iv, iv, sizeof(segment->iv));
+	}
+	
+	pthread_mutex_lock(&obj->lock);
+	
+	while (obj->queued > 0 && obj->queued + segment->data.slength > REMUX_POOL_MAX_QUEUED) {
+		pthread_cond_wait(&obj->cond, &obj->lock);
+	}
+	
+	if (job->tail == NULL) {
+		job->head = segment;
+	} else {
+		job->tail->next = segment;
+	}
+	
+	job->tail = segment;
+	obj->queued += segment->data.slength;
+	metrics_gauge_set(GAUGE_REMUX_QUEUE_BYTES, (int64_t) obj->queued);
+	
+	pthread_cond_broadcast(&obj->cond);
+	pthread_mutex_unlock(&obj->lock);
+	
+	return UERR_SUCCESS;
+	
+}
+
+void remux_job_close(struct RemuxPool* const obj, struct RemuxJob* const job, const int aborted) {
+	/*
+	Tells the worker that no more segments will follow. The job belongs to the pool afterwards.
+	*/
+	
+	pthread_mutex_lock(&obj->lock);
+	
+	job->closed = 1;
+	job->aborted = aborted;
+	
+	pthread_cond_broadcast(&obj->cond);
+	pthread_mutex_unlock(&obj->lock);
+	
+}
+
+size_t remux_pool_wait(struct RemuxPool* const obj) {
+	/*
+	Waits until every submitted job has finished, and returns how many of them failed.
+	*/
+	
+	pthread_mutex_lock(&obj->lock);
+	
+	while (obj->pending > 0) {
+		pthread_cond_wait(&obj->cond, &obj->lock);
+	}
+	
+	const size_t failures = obj->failures;
+	
+	pthread_mutex_unlock(&obj->lock);
+	
+	return failures;
+	
+}
+
+void remux_pool_free(struct RemuxPool* const obj) {
+	/*
+	Stops the workers once the jobs they already took are done. Jobs still open are aborted.
+	*/
+	
+	pthread_mutex_lock(&obj->lock);
+	
+	obj->stopping = 1;
+	
+	pthread_cond_broadcast(&obj->cond);
+	pthread_mutex_unlock(&obj->lock);
+	
+	for (size_t index = 0; index < obj->threads_count; index++) {
+		pthread_join(obj->threads[index], NULL);
+	}
+	
+	struct RemuxJob* job = obj->head;
+	
+	while (job != NULL) {
+		struct RemuxJob* const next = job->next;
+		struct RemuxSegment* segment = job->head;
+		
+		while (segment != NULL) {
+			struct RemuxSegment* const next_segment = segment->next;
+			segment_free(segment);
+			segment = next_segment;
+		}
+		
+		free(job->filename);
+		free(job->destination);
+		free(job->source);
+		free(job);
+		
+		job = next;
+	}
+	
+	obj->head = NULL;
+	obj->tail = NULL;
+	
+	pthread_cond_destroy(&obj->cond);
+	pthread_mutex_destroy(&obj->lock);
+	
+	free(obj->threads);
+	obj->threads = NULL;
+	obj->threads_count = 0;
+	
+}
@@ -0,0 +1,63 @@
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "types.h"
+#include "decrypt.h"
+#include "manifest.h"
+
+struct RemuxSegment {
+	struct String data;
+	int encrypted;
+	unsigned char key[AES_BLOCK_SIZE];
+	unsigned char iv[AES_BLOCK_SIZE];
+	struct RemuxSegment* next;
+};
+
+struct RemuxJob {
+	char* filename;
+	char* destination;
+	char* source;
+	double duration;
+	struct RemuxSegment* head;
+	struct RemuxSegment* tail;
+	int closed;
+	int aborted;
+	struct RemuxJob* next;
+};
+
+struct RemuxPool {
+	pthread_t* threads;
+	size_t threads_count;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct RemuxJob* head;
+	struct RemuxJob* tail;
+	size_t pending;
+	size_t max_pending;
+	size_t queued;
+	size_t failures;
+	int stopping;
+	struct Manifest* manifest;
+	int spool;
+};
+
+int remux_pool_init(struct RemuxPool* const obj, const size_t workers, struct Manifest* const manifest, const int spool);
+struct RemuxJob* remux_pool_submit(
+	struct RemuxPool* const obj,
+	const char* const filename,
+	const char* const destination,
+	const char* const source,
+	const double duration
+);
+int remux_job_push(
+	struct RemuxPool* const obj,
+	struct RemuxJob* const job,
+	struct String* const data,
+	const unsigned char* const key,
+	const unsigned char* const iv
+);
+void remux_job_close(struct RemuxPool* const obj, struct RemuxJob* const job, const int aborted);
+size_t remux_pool_wait(struct RemuxPool* const obj);
+void remux_pool_free(struct RemuxPool* const obj);
+
+#pragma once
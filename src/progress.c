@@ -0,0 +1,248 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+	#include <windows.h>
+	#include <io.h>
+#else
+	#include <unistd.h>
+	#include <time.h>
+#endif
+
+#include <curl/curl.h>
+
+#include "progress.h"
+
+/* The status line is redrawn at most this often, in milliseconds */
+#define PROGRESS_INTERVAL 250
+
+/* Weight given to the latest sample of the transfer rate */
+#define PROGRESS_RATE_WEIGHT 0.3
+
+static int enabled = 0;
+static int visible = 0;
+static int last_width = 0;
+
+static size_t pages_total = 0;
+static size_t pages_current = 0;
+
+static uint64_t drawn_at = 0;
+static uint64_t drawn_bytes = 0;
+static double rate = 0;
+
+static uint64_t bytes = 0;
+static uint64_t total_bytes = 0;
+
+/*
+Media playlists do not carry sizes, so their total is estimated from the EXTINF durations:
+the segments that have already finished tell how many bytes a second of media takes.
+*/
+static double total_duration = 0;
+static double completed_duration = 0;
+static uint64_t completed_bytes = 0;
+
+static uint64_t get_time(void) {
+	
+	#ifdef _WIN32
+		return (uint64_t) GetTickCount64();
+	#else
+		struct timespec ts = {0};
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		
+		return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+	#endif
+	
+}
+
+static int is_terminal(void) {
+	
+	#ifdef _WIN32
+		return _isatty(_fileno(stdout));
+	#else
+		return isatty(fileno(stdout));
+	#endif
+	
+}
+
+static void format_time(char* const dst, const size_t size, const double seconds) {
+	
+	const uint64_t value = (uint64_t) (seconds + 0.5);
+	
+	if (value >= 3600) {
+		snprintf(dst, size, "%llu:%02u:%02u", (unsigned long long) (value / 3600), (unsigned int) (value / 60 % 60), (unsigned int) (value % 60));
+	} else {
+		snprintf(dst, size, "%02u:%02u", (unsigned int) (value / 60), (unsigned int) (value % 60));
+	}
+	
+}
+
+void progress_init(void) {
+	enabled = is_terminal();
+}
+
+void progress_set_pages(const size_t total) {
+	
+	pages_total = total;
+	pages_current = 0;
+	
+}
+
+void progress_next_page(void) {
+	pages_current++;
+}
+
+void progress_begin(const uint64_t total, const double duration) {
+	
+	drawn_at = get_time();
+	drawn_bytes = 0;
+	rate = 0;
+	
+	bytes = 0;
+	total_bytes = total;
+	
+	total_duration = duration;
+	completed_duration = 0;
+	completed_bytes = 0;
+	
+}
+
+void progress_add(const uint64_t size) {
+	
+	bytes += size;
+	progress_draw(0);
+	
+}
+
+void progress_segment_done(const uint64_t size, const double duration) {
+	
+	completed_bytes += size;
+	completed_duration += duration;
+	
+}
+
+void progress_draw(const int force) {
+	
+	if (!enabled) {
+		return;
+	}
+	
+	const uint64_t now = get_time();
+	
+	if (!force && (now - drawn_at) < PROGRESS_INTERVAL) {
+		return;
+	}
+	
+	if (bytes < drawn_bytes) {
+		drawn_bytes = bytes;
+	}
+	
+	/* Forced redraws come too soon after the last one to give a meaningful rate */
+	if ((now - drawn_at) >= PROGRESS_INTERVAL) {
+		const double sample = (double) (bytes - drawn_bytes) * 1000 / (double) (now - drawn_at);
+		rate = rate == 0 ? sample : rate + (sample - rate) * PROGRESS_RATE_WEIGHT;
+		
+		drawn_at = now;
+		drawn_bytes = bytes;
+	}
+	
+	uint64_t total = total_bytes;
+	
+	if (total == 0 && completed_duration > 0 && total_duration > 0) {
+		total = (uint64_t) ((double) completed_bytes / completed_duration * total_duration);
+	}
+	
+	if (total > 0 && total < bytes) {
+		total = bytes;
+	}
+	
+	char eta[32] = "--:--";
+	
+	if (total > 0 && rate > 0) {
+		format_time(eta, sizeof(eta), (double) (total - bytes) / rate);
+	}
+	
+	char line[256];
+	int width = 0;
+	
+	if (total > 0) {
+		width = snprintf(
+			line,
+			sizeof(line),
+			"+ %.2f MB de %s%.2f MB (%u%%) a %.2f MB/s, faltam %s",
+			(double) bytes / (1024 * 1024),
+			total_bytes == 0 ? "~" : "",
+			(double) total / (1024 * 1024),
+			(unsigned int) (bytes * 100 / total),
+			rate / (1024 * 1024),
+			eta
+		);
+	} else {
+		width = snprintf(line, sizeof(line), "+ %.2f MB a %.2f MB/s", (double) bytes / (1024 * 1024), rate / (1024 * 1024));
+	}
+	
+	if (pages_total > 0 && width > 0 && (size_t) width < sizeof(line)) {
+		width += snprintf(line + width, sizeof(line) - (size_t) width, " | página %zu de %zu", pages_current, pages_total);
+	}
+	
+	if (width < 0) {
+		return;
+	}
+	
+	if ((size_t) width >= sizeof(line)) {
+		width = (int) sizeof(line) - 1;
+	}
+	
+	/* Leftovers of a longer previous line are blanked out */
+	printf("\r%s%*s", line, last_width > width ? last_width - width : 0, "");
+	fflush(stdout);
+	
+	last_width = width;
+	visible = 1;
+	
+}
+
+void progress_end(void) {
+	
+	if (!visible) {
+		return;
+	}
+	
+	progress_draw(1);
+	printf("\r\n");
+	
+	visible = 0;
+	last_width = 0;
+	
+}
+
+int progress_transfer_cb(void* clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) {
+	
+	(void) ultotal;
+	(void) ulnow;
+	
+	struct ProgressTransfer* const transfer = (struct ProgressTransfer*) clientp;
+	
+	if (transfer->sized && dltotal > 0 && total_bytes == 0) {
+		total_bytes = (uint64_t) dltotal;
+	}
+	
+	const uint64_t received = dlnow < 0 ? 0 : (uint64_t) dlnow;
+	
+	/* A transfer that restarted (e.g. after a redirect) gives back what it had counted */
+	if (received < transfer->received) {
+		bytes -= transfer->received - received;
+		transfer->received = received;
+		return 0;
+	}
+	
+	const uint64_t size = received - transfer->received;
+	transfer->received = received;
+	
+	if (size > 0) {
+		progress_add(size);
+	}
+	
+	return 0;
+	
+}
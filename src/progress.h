@@ -0,0 +1,22 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <curl/curl.h>
+
+/* Per-transfer state for progress_transfer_cb */
+struct ProgressTransfer {
+	uint64_t received;
+	int sized;
+};
+
+void progress_init(void);
+void progress_set_pages(const size_t total);
+void progress_next_page(void);
+void progress_begin(const uint64_t total, const double duration);
+void progress_add(const uint64_t bytes);
+void progress_segment_done(const uint64_t bytes, const double duration);
+void progress_draw(const int force);
+void progress_end(void);
+int progress_transfer_cb(void* clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow);
+
+#pragma once
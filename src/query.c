@@ -4,19 +4,27 @@
 #include "query.h"
 #include "symbols.h"
 #include "errors.h"
+#include "memory.h"
+
+#define QUERY_MIN_CAPACITY 8
 
 static int put_parameter(struct Query* obj, const struct Parameter parameter) {
 	
-	const size_t size = obj->size + sizeof(struct Parameter) * 1;
-	struct Parameter* parameters = realloc(obj->parameters, size);
-	
-	if (parameters == NULL) {
-		return UERR_MEMORY_ALLOCATE_FAILURE;
+	/* The array grows geometrically instead of by one item per parameter */
+	if (sizeof(struct Parameter) * (obj->position + 1) > obj->size) {
+		const size_t capacity = obj->size == 0 ? QUERY_MIN_CAPACITY : (obj->size / sizeof(struct Parameter)) * 2;
+		const size_t size = sizeof(struct Parameter) * capacity;
+		
+		struct Parameter* parameters = memory_realloc(MEMORY_QUERY, obj->parameters, size);
+		
+		if (parameters == NULL) {
+			return UERR_MEMORY_ALLOCATE_FAILURE;
+		}
+		
+		obj->size = size;
+		obj->parameters = parameters;
 	}
 	
-	obj->size = size;
-	obj->parameters = parameters;
-	
 	obj->parameters[obj->position++] = parameter;
 	
 	if (obj->slength > 0) {
@@ -33,7 +41,7 @@ static int put_parameter(struct Query* obj, const struct Parameter parameter) {
 		obj->slength += strlen(parameter.value);
 	}
 	
-	return UERR_MEMORY_ALLOCATE_FAILURE;
+	return UERR_SUCCESS;
 	
 }
 
@@ -44,59 +52,77 @@ int add_parameter(struct Query* obj, const char* key, const char* value) {
 	const size_t key_size = strlen(key);
 	
 	if (key_size > 0) {
-		parameter.key = malloc(key_size + 1);
+		parameter.key = memory_strdup(MEMORY_QUERY, key);
 		
 		if (parameter.key == NULL) {
 			return UERR_MEMORY_ALLOCATE_FAILURE;
 		}
-		
-		strcpy(parameter.key, key);
 	}
 	
 	const size_t value_size = strlen(value);
 	
 	if (value_size > 0) {
-		parameter.value = malloc(value_size + 1);
+		parameter.value = memory_strdup(MEMORY_QUERY, value);
 		
 		if (parameter.value == NULL) {
+			memory_free(parameter.key);
 			return UERR_MEMORY_ALLOCATE_FAILURE;
 		}
-		
-		strcpy(parameter.value, value);
 	}
 	
-	return put_parameter(obj, parameter);
+	const int code = put_parameter(obj, parameter);
+	
+	if (code != UERR_SUCCESS) {
+		memory_free(parameter.key);
+		memory_free(parameter.value);
+	}
+	
+	return code;
+	
+}
+
+static char* append(char* const dst, const char* const src) {
+	
+	const size_t size = strlen(src);
+	memcpy(dst, src, size);
+	
+	return dst + size;
 	
 }
 
 int query_stringify(const struct Query obj, char** dst) {
+	/*
+	slength already holds the exact size of the result, so it is written in a single pass
+	instead of searching for the end of the buffer before every append.
+	*/
 	
-	char* buffer = malloc(obj.slength + 500);
+	char* const buffer = memory_alloc(MEMORY_QUERY, obj.slength + 1);
 	
 	if (buffer == NULL) {
 		return UERR_MEMORY_ALLOCATE_FAILURE;
 	}
 	
-	memset(buffer, '\0', 1);
+	char* end = buffer;
 	
 	for (size_t index = 0; index < obj.position; index++) {
 		const struct Parameter parameter = obj.parameters[index];
 		
-		if (*buffer != '\0') {
-			strcat(buffer, AND);
+		if (index > 0) {
+			end = append(end, AND);
 		}
 		
 		if (parameter.key != NULL) {
-			strcat(buffer, parameter.key);
+			end = append(end, parameter.key);
 		}
 		
-		strcat(buffer, EQUAL);
+		end = append(end, EQUAL);
 		
 		if (parameter.value != NULL) {
-			strcat(buffer, parameter.value);
+			end = append(end, parameter.value);
 		}
 	}
 	
+	*end = '\0';
 	*dst = buffer;
 	
 	return UERR_SUCCESS;
@@ -109,19 +135,19 @@ void query_free(struct Query* obj) {
 		struct Parameter* parameter = &obj->parameters[index];
 		
 		if (parameter->key != NULL) {
-			free(parameter->key);
+			memory_free(parameter->key);
 			parameter->key = NULL;
 		}
 		
 		if (parameter->value != NULL) {
-			free(parameter->value);
+			memory_free(parameter->value);
 		}
 	}
 	
 	obj->size = 0;
 	obj->position = 0;
 	
-	free(obj->parameters);
+	memory_free(obj->parameters);
 	obj->parameters = NULL;
 	
 }
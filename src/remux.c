@@ -0,0 +1,1603 @@
+#define _FILE_OFFSET_BITS 64
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "remux.h"
+#include "errors.h"
+#include "types.h"
+
+#ifdef _WIN32
+	#define fseeko _fseeki64
+#endif
+
+#define TS_PACKET_SIZE 188
+#define TS_SYNC_BYTE 0x47
+
+#define TS_STREAM_TYPE_MPEG1_AUDIO 0x03
+#define TS_STREAM_TYPE_MPEG2_AUDIO 0x04
+#define TS_STREAM_TYPE_AAC 0x0F
+#define TS_STREAM_TYPE_H264 0x1B
+#define TS_STREAM_TYPE_HEVC 0x24
+#define TS_STREAM_TYPE_AC3 0x81
+
+#define H264_NAL_IDR 5
+#define H264_NAL_SPS 7
+#define H264_NAL_PPS 8
+#define H264_NAL_AUD 9
+
+#define TIMESTAMP_WRAP (1LL << 33)
+#define VIDEO_TIMESCALE 90000
+#define MOVIE_TIMESCALE 1000
+#define AAC_FRAME_SAMPLES 1024
+
+/* Samples of a track are written together until they span a second or grow past this size */
+#define CHUNK_MAX_SIZE (1024 * 1024)
+
+/* Room kept in front of the media data so that the moov box can be placed there at the end */
+#define MOOV_RESERVED_BASE (1024 * 64)
+#define MOOV_RESERVED_PER_SECOND 1024
+#define MOOV_RESERVED_DEFAULT (1024 * 1024)
+
+static const int AAC_SAMPLE_RATES[] = {
+	96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350
+};
+
+static const uint32_t UNITY_MATRIX[] = {
+	0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000
+};
+
+struct MP4Writer {
+	struct String data;
+	int failed;
+};
+
+static void put(struct MP4Writer* const writer, const void* const data, const size_t size) {
+	
+	if (writer->failed) {
+		return;
+	}
+	
+	struct String* const buffer = &writer->data;
+	
+	if (buffer->slength + size > buffer->size) {
+		size_t capacity = buffer->size < 4096 ? 4096 : buffer->size;
+		
+		while (capacity < buffer->slength + size) {
+			capacity *= 2;
+		}
+		
+		if (!string_reserve(buffer, capacity)) {
+			writer->failed = 1;
+			return;
+		}
+	}
+	
+	memcpy(buffer->s + buffer->slength, data, size);
+	buffer->slength += size;
+	
+}
+
+static void put_u8(struct MP4Writer* const writer, const uint8_t value) {
+	put(writer, &value, sizeof(value));
+}
+
+static void put_u16(struct MP4Writer* const writer, const uint16_t value) {
+	
+	const uint8_t bytes[] = {
+		(uint8_t) (value >> 8),
+		(uint8_t) value
+	};
+	
+	put(writer, bytes, sizeof(bytes));
+	
+}
+
+static void put_u32(struct MP4Writer* const writer, const uint32_t value) {
+	
+	const uint8_t bytes[] = {
+		(uint8_t) (value >> 24),
+		(uint8_t) (value >> 16),
+		(uint8_t) (value >> 8),
+		(uint8_t) value
+	};
+	
+	put(writer, bytes, sizeof(bytes));
+	
+}
+
+static void put_u64(struct MP4Writer* const writer, const uint64_t value) {
+	
+	put_u32(writer, (uint32_t) (value >> 32));
+	put_u32(writer, (uint32_t) value);
+	
+}
+
+static void put_zeros(struct MP4Writer* const writer, const size_t size) {
+	
+	for (size_t index = 0; index < size; index++) {
+		put_u8(writer, 0);
+	}
+	
+}
+
+static size_t box_open(struct MP4Writer* const writer, const char* const type) {
+	
+	const size_t offset = writer->data.slength;
+	
+	put_u32(writer, 0);
+	put(writer, type, 4);
+	
+	return offset;
+	
+}
+
+static size_t full_box_open(struct MP4Writer* const writer, const char* const type, const uint8_t version, const uint32_t flags) {
+	
+	const size_t offset = box_open(writer, type);
+	
+	put_u32(writer, ((uint32_t) version << 24) | (flags & 0x00FFFFFF));
+	
+	return offset;
+	
+}
+
+static void box_close(struct MP4Writer* const writer, const size_t offset) {
+	
+	if (writer->failed) {
+		return;
+	}
+	
+	const uint32_t size = (uint32_t) (writer->data.slength - offset);
+	unsigned char* const start = (unsigned char*) writer->data.s + offset;
+	
+	start[0] = (unsigned char) (size >> 24);
+	start[1] = (unsigned char) (size >> 16);
+	start[2] = (unsigned char) (size >> 8);
+	start[3] = (unsigned char) size;
+	
+}
+
+static uint64_t rescale(const int64_t value, const uint32_t from, const uint32_t to) {
+	
+	if (value <= 0) {
+		return 0;
+	}
+	
+	return (uint64_t) (((long double) value * to) / from);
+	
+}
+
+static int file_write(struct Remuxer* const obj, const void* const data, const size_t size) {
+	
+	if (size > 0 && fwrite(data, 1, size, obj->stream) != size) {
+		return UERR_FILE_WRITE_FAILURE;
+	}
+	
+	obj->position += size;
+	
+	return UERR_SUCCESS;
+	
+}
+
+static int samples_append(struct RemuxSamples* const samples, const struct RemuxSample sample) {
+	
+	if ((samples->offset + 1) * sizeof(*samples->items) > samples->size) {
+		const size_t size = samples->size == 0 ? sizeof(*samples->items) * 1024 : samples->size * 2;
+		struct RemuxSample* const items = realloc(samples->items, size);
+		
+		if (items == NULL) {
+			return UERR_MEMORY_ALLOCATE_FAILURE;
+		}
+		
+		samples->items = items;
+		samples->size = size;
+	}
+	
+	samples->items[samples->offset++] = sample;
+	
+	return UERR_SUCCESS;
+	
+}
+
+static int chunks_append(struct RemuxChunks* const chunks, const struct RemuxChunk chunk) {
+	
+	if ((chunks->offset + 1) * sizeof(*chunks->items) > chunks->size) {
+		const size_t size = chunks->size == 0 ? sizeof(*chunks->items) * 256 : chunks->size * 2;
+		struct RemuxChunk* const items = realloc(chunks->items, size);
+		
+		if (items == NULL) {
+			return UERR_MEMORY_ALLOCATE_FAILURE;
+		}
+		
+		chunks->items = items;
+		chunks->size = size;
+	}
+	
+	chunks->items[chunks->offset++] = chunk;
+	
+	return UERR_SUCCESS;
+	
+}
+
+static int string_append(struct String* const string, const void* const data, const size_t size) {
+	
+	if (string->slength + size + 1 > string->size) {
+		size_t capacity = string->size < 4096 ? 4096 : string->size;
+		
+		while (capacity < string->slength + size + 1) {
+			capacity *= 2;
+		}
+		
+		if (!string_reserve(string, capacity)) {
+			return UERR_MEMORY_ALLOCATE_FAILURE;
+		}
+	}
+	
+	memcpy(string->s + string->slength, data, size);
+	string->slength += size;
+	
+	return UERR_SUCCESS;
+	
+}
+
+static int string_assign(struct String* const string, const void* const data, const size_t size) {
+	
+	string->slength = 0;
+	
+	return string_append(string, data, size);
+	
+}
+
+static int64_t unwrap_timestamp(struct RemuxTrack* const track, const int64_t value) {
+	/*
+	Turns the 33-bit transport stream clock into a monotonic one, so that timestamps
+	keep growing across the wrap-around that happens every ~26.5 hours.
+	*/
+	
+	if (!track->has_timestamp) {
+		track->has_timestamp = 1;
+		track->last_timestamp = value;
+		
+		return value;
+	}
+	
+	int64_t timestamp = value + (track->last_timestamp - (track->last_timestamp % TIMESTAMP_WRAP));
+	
+	if (timestamp < track->last_timestamp - TIMESTAMP_WRAP / 2) {
+		timestamp += TIMESTAMP_WRAP;
+	} else if (timestamp > track->last_timestamp + TIMESTAMP_WRAP / 2) {
+		timestamp -= TIMESTAMP_WRAP;
+	}
+	
+	track->last_timestamp = timestamp;
+	
+	return timestamp;
+	
+}
+
+static int64_t read_timestamp(const unsigned char* const data) {
+	
+	return (
+		((int64_t) ((data[0] >> 1) & 0x07) << 30) |
+		((int64_t) data[1] << 22) |
+		((int64_t) (data[2] >> 1) << 15) |
+		((int64_t) data[3] << 7) |
+		((int64_t) data[4] >> 1)
+	);
+	
+}
+
+struct BitReader {
+	const unsigned char* data;
+	size_t size;
+	size_t position;
+	int invalid;
+};
+
+static unsigned int read_bit(struct BitReader* const reader) {
+	
+	if (reader->position >= reader->size * 8) {
+		reader->position++;
+		return 0;
+	}
+	
+	const unsigned int bit = (reader->data[reader->position / 8] >> (7 - (reader->position % 8))) & 0x01;
+	reader->position++;
+	
+	return bit;
+	
+}
+
+static unsigned int read_bits(struct BitReader* const reader, const int count) {
+	
+	unsigned int value = 0;
+	
+	for (int index = 0; index < count; index++) {
+		value = (value << 1) | read_bit(reader);
+	}
+	
+	return value;
+	
+}
+
+static unsigned int read_ue(struct BitReader* const reader) {
+	
+	int zeros = 0;
+	
+	while (read_bit(reader) == 0) {
+		if (reader->position > reader->size * 8) {
+			return 0;
+		}
+		
+		zeros++;
+		
+		/* No Exp-Golomb code used by H.264 is this long; its value would not fit either */
+		if (zeros >= 32) {
+			reader->invalid = 1;
+			return 0;
+		}
+	}
+	
+	if (zeros == 0) {
+		return 0;
+	}
+	
+	return ((1U << zeros) - 1) + read_bits(reader, zeros);
+	
+}
+
+static int read_se(struct BitReader* const reader) {
+	
+	const unsigned int value = read_ue(reader);
+	
+	return (value & 0x01) ? (int) ((value + 1) / 2) : -(int) (value / 2);
+	
+}
+
+static int parse_sps(struct RemuxTrack* const track) {
+	/*
+	Extracts the picture dimensions from the sequence parameter set. They are left unknown
+	when the parameter set is cut short.
+	*/
+	
+	const unsigned char* const sps = (const unsigned char*) track->sps.s;
+	const size_t size = track->sps.slength;
+	
+	unsigned char rbsp[size];
+	size_t rbsp_size = 0;
+	
+	for (size_t index = 1; index < size; index++) {
+		if (index + 2 < size && sps[index] == 0x00 && sps[index + 1] == 0x00 && sps[index + 2] == 0x03) {
+			rbsp[rbsp_size++] = 0x00;
+			rbsp[rbsp_size++] = 0x00;
+			index += 2;
+			continue;
+		}
+		
+		rbsp[rbsp_size++] = sps[index];
+	}
+	
+	struct BitReader reader = {
+		.data = rbsp,
+		.size = rbsp_size
+	};
+	
+	const unsigned int profile_idc = read_bits(&reader, 8);
+	read_bits(&reader, 16);
+	read_ue(&reader);
+	
+	unsigned int chroma_format_idc = 1;
+	
+	if (profile_idc == 100 || profile_idc == 110 || profile_idc == 122 || profile_idc == 244 || profile_idc == 44 ||
+		profile_idc == 83 || profile_idc == 86 || profile_idc == 118 || profile_idc == 128 || profile_idc == 138 ||
+		profile_idc == 139 || profile_idc == 134 || profile_idc == 135) {
+		chroma_format_idc = read_ue(&reader);
+		
+		if (chroma_format_idc == 3) {
+			read_bit(&reader);
+		}
+		
+		read_ue(&reader);
+		read_ue(&reader);
+		read_bit(&reader);
+		
+		if (read_bit(&reader)) {
+			for (int index = 0; index < (chroma_format_idc != 3 ? 8 : 12); index++) {
+				if (!read_bit(&reader)) {
+					continue;
+				}
+				
+				const int list_size = index < 6 ? 16 : 64;
+				int last_scale = 8;
+				int next_scale = 8;
+				
+				for (int position = 0; position < list_size; position++) {
+					if (next_scale != 0) {
+						next_scale = (last_scale + read_se(&reader) + 256) % 256;
+					}
+					
+					last_scale = next_scale == 0 ? last_scale : next_scale;
+				}
+			}
+		}
+	}
+	
+	read_ue(&reader);
+	
+	const unsigned int pic_order_cnt_type = read_ue(&reader);
+	
+	if (pic_order_cnt_type == 0) {
+		read_ue(&reader);
+	} else if (pic_order_cnt_type == 1) {
+		read_bit(&reader);
+		read_se(&reader);
+		read_se(&reader);
+		
+		const unsigned int cycle = read_ue(&reader);
+		
+		for (unsigned int index = 0; index < cycle && index < 256; index++) {
+			read_se(&reader);
+		}
+	}
+	
+	read_ue(&reader);
+	read_bit(&reader);
+	
+	const unsigned int width_in_mbs = read_ue(&reader) + 1;
+	const unsigned int height_in_map_units = read_ue(&reader) + 1;
+	const unsigned int frame_mbs_only = read_bit(&reader);
+	
+	if (!frame_mbs_only) {
+		read_bit(&reader);
+	}
+	
+	read_bit(&reader);
+	
+	unsigned int crop_left = 0;
+	unsigned int crop_right = 0;
+	unsigned int crop_top = 0;
+	unsigned int crop_bottom = 0;
+	
+	if (read_bit(&reader)) {
+		crop_left = read_ue(&reader);
+		crop_right = read_ue(&reader);
+		crop_top = read_ue(&reader);
+		crop_bottom = read_ue(&reader);
+	}
+	
+	if (reader.invalid) {
+		return UERR_REMUX_INVALID_STREAM;
+	}
+	
+	if (reader.position > reader.size * 8) {
+		return UERR_SUCCESS;
+	}
+	
+	const unsigned int crop_unit_x = (chroma_format_idc == 1 || chroma_format_idc == 2) ? 2 : 1;
+	const unsigned int crop_unit_y = (chroma_format_idc == 1 ? 2 : 1) * (2 - frame_mbs_only);
+	
+	track->width = (int) (width_in_mbs * 16 - crop_unit_x * (crop_left + crop_right));
+	track->height = (int) ((2 - frame_mbs_only) * height_in_map_units * 16 - crop_unit_y * (crop_top + crop_bottom));
+	
+	return UERR_SUCCESS;
+	
+}
+
+static int flush_chunk(struct Remuxer* const obj, struct RemuxTrack* const track) {
+	
+	if (track->pending_samples == 0) {
+		return UERR_SUCCESS;
+	}
+	
+	const struct RemuxChunk chunk = {
+		.offset = obj->position,
+		.samples = (uint32_t) track->pending_samples
+	};
+	
+	int code = file_write(obj, track->pending.s, track->pending.slength);
+	
+	if (code != UERR_SUCCESS) {
+		return code;
+	}
+	
+	code = chunks_append(&track->chunks, chunk);
+	
+	if (code != UERR_SUCCESS) {
+		return code;
+	}
+	
+	track->pending.slength = 0;
+	track->pending_samples = 0;
+	
+	return UERR_SUCCESS;
+	
+}
+
+static int add_sample(
+	struct Remuxer* const obj,
+	struct RemuxTrack* const track,
+	const struct RemuxSample sample
+) {
+	
+	if (track->pending_samples == 0) {
+		track->pending_start = sample.dts;
+	}
+	
+	int code = samples_append(&track->samples, sample);
+	
+	if (code != UERR_SUCCESS) {
+		return code;
+	}
+	
+	track->pending_samples++;
+	
+	if (sample.dts - track->pending_start >= (int64_t) track->timescale || track->pending.slength >= CHUNK_MAX_SIZE) {
+		code = flush_chunk(obj, track);
+	}
+	
+	return code;
+	
+}
+
+static const unsigned char* find_start_code(const unsigned char* start, const unsigned char* const end) {
+	
+	while (start + 3 <= end) {
+		if (start[0] == 0x00 && start[1] == 0x00 && start[2] == 0x01) {
+			return start;
+		}
+		
+		start++;
+	}
+	
+	return end;
+	
+}
+
+static int video_access_unit(
+	struct Remuxer* const obj,
+	const unsigned char* const data,
+	const size_t size,
+	const int64_t pts,
+	const int64_t dts
+) {
+	/*
+	Converts an Annex B access unit into a length-prefixed sample. Parameter sets are
+	moved into the sample description and access unit delimiters are dropped.
+	*/
+	
+	struct RemuxTrack* const track = &obj->video;
+	
+	const unsigned char* const end = data + size;
+	const unsigned char* nal = find_start_code(data, end);
+	
+	const size_t pending_size = track->pending.slength;
+	int keyframe = 0;
+	
+	while (nal < end) {
+		nal += 3;
+		
+		const unsigned char* next = find_start_code(nal, end);
+		const unsigned char* nal_end = next;
+		
+		while (nal_end > nal && *(nal_end - 1) == 0x00) {
+			nal_end--;
+		}
+		
+		const size_t nal_size = (size_t) (nal_end - nal);
+		
+		if (nal_size > 0) {
+			const int type = *nal & 0x1F;
+			int code = UERR_SUCCESS;
+			
+			switch (type) {
+				case H264_NAL_AUD:
+					break;
+				case H264_NAL_SPS:
+					if (track->sps.slength == 0) {
+						code = string_assign(&track->sps, nal, nal_size);
+						
+						if (code == UERR_SUCCESS) {
+							code = parse_sps(track);
+						}
+					}
+					
+					break;
+				case H264_NAL_PPS:
+					if (track->pps.slength == 0) {
+						code = string_assign(&track->pps, nal, nal_size);
+					}
+					
+					break;
+				default: {
+					if (type == H264_NAL_IDR) {
+						keyframe = 1;
+					}
+					
+					const unsigned char length[] = {
+						(unsigned char) (nal_size >> 24),
+						(unsigned char) (nal_size >> 16),
+						(unsigned char) (nal_size >> 8),
+						(unsigned char) nal_size
+					};
+					
+					code = string_append(&track->pending, length, sizeof(length));
+					
+					if (code == UERR_SUCCESS) {
+						code = string_append(&track->pending, nal, nal_size);
+					}
+					
+					break;
+				}
+			}
+			
+			if (code != UERR_SUCCESS) {
+				return code;
+			}
+		}
+		
+		nal = next;
+	}
+	
+	const size_t sample_size = track->pending.slength - pending_size;
+	
+	/* Nothing can be decoded before the first keyframe and its parameter sets */
+	if (sample_size == 0 || (track->samples.offset == 0 && (!keyframe || track->sps.slength == 0 || track->pps.slength == 0))) {
+		track->pending.slength = pending_size;
+		return UERR_SUCCESS;
+	}
+	
+	if (!track->has_first_pts) {
+		track->has_first_pts = 1;
+		track->first_pts = pts;
+	}
+	
+	const struct RemuxSample sample = {
+		.size = (uint32_t) sample_size,
+		.cts = (int32_t) (pts - dts),
+		.dts = dts,
+		.keyframe = keyframe
+	};
+	
+	return add_sample(obj, track, sample);
+	
+}
+
+static int audio_frames(
+	struct Remuxer* const obj,
+	const unsigned char* const payload,
+	const size_t payload_size,
+	const int64_t pts
+) {
+	/*
+	Splits ADTS frames into raw AAC samples. Bytes of a frame that continues in the
+	next PES packet are carried over.
+	*/
+	
+	struct RemuxTrack* const track = &obj->audio;
+	
+	int code = string_append(&track->carry, payload, payload_size);
+	
+	if (code != UERR_SUCCESS) {
+		return code;
+	}
+	
+	const unsigned char* data = (const unsigned char*) track->carry.s;
+	size_t size = track->carry.slength;
+	
+	int frame_index = 0;
+	
+	while (size >= 7) {
+		if (data[0] != 0xFF || (data[1] & 0xF6) != 0xF0) {
+			data++;
+			size--;
+			continue;
+		}
+		
+		const int protection_absent = data[1] & 0x01;
+		const int object_type = ((data[2] >> 6) & 0x03) + 1;
+		const int frequency_index = (data[2] >> 2) & 0x0F;
+		const int channels = ((data[2] & 0x01) << 2) | ((data[3] >> 6) & 0x03);
+		const size_t frame_size = ((size_t) (data[3] & 0x03) << 11) | ((size_t) data[4] << 3) | ((size_t) data[5] >> 5);
+		const int raw_blocks = data[6] & 0x03;
+		const size_t header_size = protection_absent ? 7 : 9;
+		
+		if (frame_size < header_size || frequency_index >= (int) (sizeof(AAC_SAMPLE_RATES) / sizeof(*AAC_SAMPLE_RATES))) {
+			return UERR_REMUX_INVALID_STREAM;
+		}
+		
+		if (raw_blocks != 0) {
+			return UERR_REMUX_UNSUPPORTED_STREAM;
+		}
+		
+		if (frame_size > size) {
+			break;
+		}
+		
+		if (track->timescale == 0) {
+			track->object_type = object_type;
+			track->frequency_index = frequency_index;
+			track->channels = channels;
+			track->timescale = (uint32_t) AAC_SAMPLE_RATES[frequency_index];
+		}
+		
+		if (!track->has_first_pts) {
+			track->has_first_pts = 1;
+			track->first_pts = pts + ((int64_t) frame_index * AAC_FRAME_SAMPLES * VIDEO_TIMESCALE) / track->timescale;
+		}
+		
+		const size_t sample_size = frame_size - header_size;
+		
+		code = string_append(&track->pending, data + header_size, sample_size);
+		
+		if (code != UERR_SUCCESS) {
+			return code;
+		}
+		
+		const struct RemuxSample sample = {
+			.size = (uint32_t) sample_size,
+			.dts = (int64_t) track->samples.offset * AAC_FRAME_SAMPLES,
+			.keyframe = 1
+		};
+		
+		code = add_sample(obj, track, sample);
+		
+		if (code != UERR_SUCCESS) {
+			return code;
+		}
+		
+		data += frame_size;
+		size -= frame_size;
+		
+		frame_index++;
+	}
+	
+	memmove(track->carry.s, data, size);
+	track->carry.slength = size;
+	
+	return UERR_SUCCESS;
+	
+}
+
+static int flush_pes(struct Remuxer* const obj, struct RemuxTrack* const track) {
+	
+	const unsigned char* const data = (const unsigned char*) track->pes.s;
+	const size_t size = track->pes.slength;
+	
+	track->pes.slength = 0;
+	
+	if (size < 9 || data[0] != 0x00 || data[1] != 0x00 || data[2] != 0x01) {
+		return UERR_SUCCESS;
+	}
+	
+	const int flags = data[7];
+	const size_t header_size = 9 + (size_t) data[8];
+	
+	if (header_size > size || (flags & 0x80) == 0 || (flags & 0x40 && header_size < 19) || header_size < 14) {
+		return UERR_REMUX_INVALID_STREAM;
+	}
+	
+	const int64_t raw_pts = read_timestamp(data + 9);
+	const int64_t raw_dts = (flags & 0x40) ? read_timestamp(data + 14) : raw_pts;
+	
+	const int64_t dts = unwrap_timestamp(track, raw_dts);
+	const int64_t pts = dts + ((raw_pts - raw_dts + TIMESTAMP_WRAP) % TIMESTAMP_WRAP);
+	
+	if (track == &obj->video) {
+		return video_access_unit(obj, data + header_size, size - header_size, pts, dts);
+	}
+	
+	return audio_frames(obj, data + header_size, size - header_size, pts);
+	
+}
+
+static int parse_pat(struct Remuxer* const obj, const unsigned char* const payload, const size_t size) {
+	
+	const size_t pointer = payload[0];
+	
+	if (1 + pointer + 8 > size) {
+		return UERR_REMUX_INVALID_STREAM;
+	}
+	
+	const unsigned char* const section = payload + 1 + pointer;
+	const size_t section_length = ((size_t) (section[1] & 0x0F) << 8) | section[2];
+	
+	if (section_length < 9 || 1 + pointer + 3 + section_length > size) {
+		return UERR_REMUX_INVALID_STREAM;
+	}
+	
+	const unsigned char* program = section + 8;
+	const unsigned char* const end = section + 3 + section_length - 4;
+	
+	while (program + 4 <= end) {
+		const int number = (program[0] << 8) | program[1];
+		const int pid = ((program[2] & 0x1F) << 8) | program[3];
+		
+		if (number != 0) {
+			obj->pmt_pid = pid;
+			break;
+		}
+		
+		program += 4;
+	}
+	
+	return UERR_SUCCESS;
+	
+}
+
+static int parse_pmt(struct Remuxer* const obj, const unsigned char* const payload, const size_t size) {
+	
+	const size_t pointer = payload[0];
+	
+	if (1 + pointer + 12 > size) {
+		return UERR_REMUX_INVALID_STREAM;
+	}
+	
+	const unsigned char* const section = payload + 1 + pointer;
+	const size_t section_length = ((size_t) (section[1] & 0x0F) << 8) | section[2];
+	const size_t program_info_length = ((size_t) (section[10] & 0x0F) << 8) | section[11];
+	
+	if (section_length < 13 || 1 + pointer + 3 + section_length > size) {
+		return UERR_REMUX_INVALID_STREAM;
+	}
+	
+	const unsigned char* stream = section + 12 + program_info_length;
+	const unsigned char* const end = section + 3 + section_length - 4;
+	
+	while (stream + 5 <= end) {
+		const int type = stream[0];
+		const int pid = ((stream[1] & 0x1F) << 8) | stream[2];
+		const size_t info_length = ((size_t) (stream[3] & 0x0F) << 8) | stream[4];
+		
+		switch (type) {
+			case TS_STREAM_TYPE_H264:
+				if (obj->video.pid == 0) {
+					obj->video.pid = pid;
+				}
+				
+				break;
+			case TS_STREAM_TYPE_AAC:
+				if (obj->audio.pid == 0) {
+					obj->audio.pid = pid;
+				}
+				
+				break;
+			case TS_STREAM_TYPE_HEVC:
+			case TS_STREAM_TYPE_MPEG1_AUDIO:
+			case TS_STREAM_TYPE_MPEG2_AUDIO:
+			case TS_STREAM_TYPE_AC3:
+				return UERR_REMUX_UNSUPPORTED_STREAM;
+			default:
+				break;
+		}
+		
+		stream += 5 + info_length;
+	}
+	
+	if (obj->video.pid == 0 && obj->audio.pid == 0) {
+		return UERR_REMUX_UNSUPPORTED_STREAM;
+	}
+	
+	return UERR_SUCCESS;
+	
+}
+
+static int parse_packet(struct Remuxer* const obj, const unsigned char* const packet) {
+	
+	if (packet[0] != TS_SYNC_BYTE) {
+		return UERR_REMUX_INVALID_STREAM;
+	}
+	
+	const int unit_start = packet[1] & 0x40;
+	const int pid = ((packet[1] & 0x1F) << 8) | packet[2];
+	const int adaptation_field_control = (packet[3] >> 4) & 0x03;
+	
+	size_t offset = 4;
+	
+	if (adaptation_field_control & 0x02) {
+		offset += 1 + (size_t) packet[4];
+	}
+	
+	if ((adaptation_field_control & 0x01) == 0 || offset >= TS_PACKET_SIZE) {
+		return UERR_SUCCESS;
+	}
+	
+	const unsigned char* const payload = packet + offset;
+	const size_t size = TS_PACKET_SIZE - offset;
+	
+	if (pid == 0) {
+		return unit_start ? parse_pat(obj, payload, size) : UERR_SUCCESS;
+	}
+	
+	if (pid == obj->pmt_pid) {
+		return (unit_start && obj->video.pid == 0 && obj->audio.pid == 0) ? parse_pmt(obj, payload, size) : UERR_SUCCESS;
+	}
+	
+	struct RemuxTrack* track = NULL;
+	
+	if (pid == obj->video.pid) {
+		track = &obj->video;
+	} else if (pid == obj->audio.pid) {
+		track = &obj->audio;
+	} else {
+		return UERR_SUCCESS;
+	}
+	
+	if (unit_start) {
+		const int code = flush_pes(obj, track);
+		
+		if (code != UERR_SUCCESS) {
+			return code;
+		}
+	} else if (track->pes.slength == 0) {
+		return UERR_SUCCESS;
+	}
+	
+	return string_append(&track->pes, payload, size);
+	
+}
+
+int remuxer_init(struct Remuxer* const obj, FILE* const stream, const double duration) {
+	/*
+	Prepares an MP4 file for the transport stream of a lecture with the given duration in seconds.
+	Space for the moov box is reserved right after ftyp, so the finished file can be played
+	while it is still being downloaded without a second pass over the media data.
+	*/
+	
+	memset(obj, 0, sizeof(*obj));
+	
+	obj->stream = stream;
+	obj->video.id = 1;
+	obj->video.timescale = VIDEO_TIMESCALE;
+	obj->audio.id = 2;
+	
+	obj->reserved_size = duration > 0 ? MOOV_RESERVED_BASE + (uint64_t) (duration * MOOV_RESERVED_PER_SECOND) : MOOV_RESERVED_DEFAULT;
+	
+	struct MP4Writer writer = {0};
+	
+	const size_t ftyp = box_open(&writer, "ftyp");
+	put(&writer, "isom", 4);
+	put_u32(&writer, 512);
+	put(&writer, "isomiso2avc1mp41", 16);
+	box_close(&writer, ftyp);
+	
+	put_u32(&writer, (uint32_t) obj->reserved_size);
+	put(&writer, "free", 4);
+	
+	if (writer.failed) {
+		string_free(&writer.data);
+		return UERR_MEMORY_ALLOCATE_FAILURE;
+	}
+	
+	obj->reserved_offset = ftyp + 32;
+	
+	int code = file_write(obj, writer.data.s, writer.data.slength);
+	string_free(&writer.data);
+	
+	if (code != UERR_SUCCESS) {
+		return code;
+	}
+	
+	obj->mdat_offset = obj->reserved_offset + obj->reserved_size;
+	
+	if (fseeko(obj->stream, (off_t) obj->mdat_offset, SEEK_SET) != 0) {
+		return UERR_FILE_WRITE_FAILURE;
+	}
+	
+	obj->position = obj->mdat_offset;
+	
+	const unsigned char mdat[] = {
+		0x00, 0x00, 0x00, 0x01, 'm', 'd', 'a', 't',
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+	};
+	
+	code = file_write(obj, mdat, sizeof(mdat));
+	
+	return code;
+	
+}
+
+int remuxer_feed(struct Remuxer* const obj, const unsigned char* data, size_t size) {
+	/*
+	Consumes the next bytes of the transport stream. Segments may be fed in arbitrary slices,
+	as long as they are fed in playlist order.
+	*/
+	
+	if (obj->packet_size > 0) {
+		const size_t missing = TS_PACKET_SIZE - obj->packet_size;
+		const size_t available = size < missing ? size : missing;
+		
+		memcpy(obj->packet + obj->packet_size, data, available);
+		obj->packet_size += available;
+		
+		data += available;
+		size -= available;
+		
+		if (obj->packet_size < TS_PACKET_SIZE) {
+			return UERR_SUCCESS;
+		}
+		
+		obj->packet_size = 0;
+		
+		const int code = parse_packet(obj, obj->packet);
+		
+		if (code != UERR_SUCCESS) {
+			return code;
+		}
+	}
+	
+	while (size >= TS_PACKET_SIZE) {
+		const int code = parse_packet(obj, data);
+		
+		if (code != UERR_SUCCESS) {
+			return code;
+		}
+		
+		data += TS_PACKET_SIZE;
+		size -= TS_PACKET_SIZE;
+	}
+	
+	memcpy(obj->packet, data, size);
+	obj->packet_size = size;
+	
+	return UERR_SUCCESS;
+	
+}
+
+static uint32_t sample_duration(const struct RemuxTrack* const track, const size_t index) {
+	
+	const struct RemuxSamples* const samples = &track->samples;
+	
+	if (index + 1 < samples->offset) {
+		const int64_t duration = samples->items[index + 1].dts - samples->items[index].dts;
+		return duration > 0 ? (uint32_t) duration : 0;
+	}
+	
+	if (index > 0) {
+		return sample_duration(track, index - 1);
+	}
+	
+	return track->timescale == VIDEO_TIMESCALE ? 3000 : AAC_FRAME_SAMPLES;
+	
+}
+
+static int64_t track_duration(const struct RemuxTrack* const track) {
+	
+	const struct RemuxSamples* const samples = &track->samples;
+	
+	if (samples->offset == 0) {
+		return 0;
+	}
+	
+	return samples->items[samples->offset - 1].dts - samples->items[0].dts + sample_duration(track, samples->offset - 1);
+	
+}
+
+static void write_sample_description(struct MP4Writer* const writer, const struct RemuxTrack* const track, const int is_video) {
+	
+	const size_t stsd = full_box_open(writer, "stsd", 0, 0);
+	put_u32(writer, 1);
+	
+	if (is_video) {
+		const size_t avc1 = box_open(writer, "avc1");
+		put_zeros(writer, 6);
+		put_u16(writer, 1);
+		put_zeros(writer, 16);
+		put_u16(writer, (uint16_t) track->width);
+		put_u16(writer, (uint16_t) track->height);
+		put_u32(writer, 0x00480000);
+		put_u32(writer, 0x00480000);
+		put_u32(writer, 0);
+		put_u16(writer, 1);
+		put_zeros(writer, 32);
+		put_u16(writer, 0x0018);
+		put_u16(writer, 0xFFFF);
+		
+		const unsigned char* const sps = (const unsigned char*) track->sps.s;
+		
+		const size_t avcc = box_open(writer, "avcC");
+		put_u8(writer, 1);
+		put_u8(writer, sps[1]);
+		put_u8(writer, sps[2]);
+		put_u8(writer, sps[3]);
+		put_u8(writer, 0xFF);
+		put_u8(writer, 0xE1);
+		put_u16(writer, (uint16_t) track->sps.slength);
+		put(writer, track->sps.s, track->sps.slength);
+		put_u8(writer, 1);
+		put_u16(writer, (uint16_t) track->pps.slength);
+		put(writer, track->pps.s, track->pps.slength);
+		box_close(writer, avcc);
+		
+		box_close(writer, avc1);
+	} else {
+		const size_t mp4a = box_open(writer, "mp4a");
+		put_zeros(writer, 6);
+		put_u16(writer, 1);
+		put_zeros(writer, 8);
+		put_u16(writer, (uint16_t) (track->channels == 0 ? 2 : track->channels));
+		put_u16(writer, 16);
+		put_u32(writer, 0);
+		put_u32(writer, track->timescale << 16);
+		
+		const uint16_t config = (uint16_t) ((track->object_type << 11) | (track->frequency_index << 7) | (track->channels << 3));
+		
+		const size_t esds = full_box_open(writer, "esds", 0, 0);
+		put_u8(writer, 0x03);
+		put_u8(writer, 3 + 2 + 13 + 2 + 2 + 3);
+		put_u16(writer, 0);
+		put_u8(writer, 0);
+		put_u8(writer, 0x04);
+		put_u8(writer, 13 + 2 + 2);
+		put_u8(writer, 0x40);
+		put_u8(writer, 0x15);
+		put_u8(writer, 0);
+		put_u16(writer, 0);
+		put_u32(writer, 0);
+		put_u32(writer, 0);
+		put_u8(writer, 0x05);
+		put_u8(writer, 2);
+		put_u16(writer, config);
+		put_u8(writer, 0x06);
+		put_u8(writer, 1);
+		put_u8(writer, 0x02);
+		box_close(writer, esds);
+		
+		box_close(writer, mp4a);
+	}
+	
+	box_close(writer, stsd);
+	
+}
+
+static void write_sample_table(struct MP4Writer* const writer, const struct RemuxTrack* const track, const int is_video) {
+	
+	const struct RemuxSamples* const samples = &track->samples;
+	const struct RemuxChunks* const chunks = &track->chunks;
+	
+	const size_t stbl = box_open(writer, "stbl");
+	
+	write_sample_description(writer, track, is_video);
+	
+	/* Decoding time to sample, run-length encoded */
+	size_t stts = full_box_open(writer, "stts", 0, 0);
+	size_t count_offset = writer->data.slength;
+	put_u32(writer, 0);
+	
+	uint32_t entries = 0;
+	
+	for (size_t index = 0; index < samples->offset; ) {
+		const uint32_t duration = sample_duration(track, index);
+		uint32_t count = 0;
+		
+		while (index < samples->offset && sample_duration(track, index) == duration) {
+			count++;
+			index++;
+		}
+		
+		put_u32(writer, count);
+		put_u32(writer, duration);
+		
+		entries++;
+	}
+	
+	if (!writer->failed) {
+		unsigned char* const start = (unsigned char*) writer->data.s + count_offset;
+		start[0] = (unsigned char) (entries >> 24);
+		start[1] = (unsigned char) (entries >> 16);
+		start[2] = (unsigned char) (entries >> 8);
+		start[3] = (unsigned char) entries;
+	}
+	
+	box_close(writer, stts);
+	
+	/* Composition offsets, only when frames are reordered */
+	int has_cts = 0;
+	
+	for (size_t index = 0; index < samples->offset; index++) {
+		if (samples->items[index].cts != 0) {
+			has_cts = 1;
+			break;
+		}
+	}
+	
+	if (has_cts) {
+		const size_t ctts = full_box_open(writer, "ctts", 0, 0);
+		count_offset = writer->data.slength;
+		put_u32(writer, 0);
+		
+		entries = 0;
+		
+		for (size_t index = 0; index < samples->offset; ) {
+			const int32_t cts = samples->items[index].cts;
+			uint32_t count = 0;
+			
+			while (index < samples->offset && samples->items[index].cts == cts) {
+				count++;
+				index++;
+			}
+			
+			put_u32(writer, count);
+			put_u32(writer, (uint32_t) (cts < 0 ? 0 : cts));
+			
+			entries++;
+		}
+		
+		if (!writer->failed) {
+			unsigned char* const start = (unsigned char*) writer->data.s + count_offset;
+			start[0] = (unsigned char) (entries >> 24);
+			start[1] = (unsigned char) (entries >> 16);
+			start[2] = (unsigned char) (entries >> 8);
+			start[3] = (unsigned char) entries;
+		}
+		
+		box_close(writer, ctts);
+	}
+	
+	/* Sync samples, omitted when every sample is one */
+	size_t keyframes = 0;
+	
+	for (size_t index = 0; index < samples->offset; index++) {
+		keyframes += samples->items[index].keyframe != 0;
+	}
+	
+	if (keyframes != samples->offset) {
+		const size_t stss = full_box_open(writer, "stss", 0, 0);
+		put_u32(writer, (uint32_t) keyframes);
+		
+		for (size_t index = 0; index < samples->offset; index++) {
+			if (samples->items[index].keyframe) {
+				put_u32(writer, (uint32_t) (index + 1));
+			}
+		}
+		
+		box_close(writer, stss);
+	}
+	
+	/* Sample to chunk, one entry per run of equally sized chunks */
+	const size_t stsc = full_box_open(writer, "stsc", 0, 0);
+	count_offset = writer->data.slength;
+	put_u32(writer, 0);
+	
+	entries = 0;
+	
+	for (size_t index = 0; index < chunks->offset; index++) {
+		if (index > 0 && chunks->items[index].samples == chunks->items[index - 1].samples) {
+			continue;
+		}
+		
+		put_u32(writer, (uint32_t) (index + 1));
+		put_u32(writer, chunks->items[index].samples);
+		put_u32(writer, 1);
+		
+		entries++;
+	}
+	
+	if (!writer->failed) {
+		unsigned char* const start = (unsigned char*) writer->data.s + count_offset;
+		start[0] = (unsigned char) (entries >> 24);
+		start[1] = (unsigned char) (entries >> 16);
+		start[2] = (unsigned char) (entries >> 8);
+		start[3] = (unsigned char) entries;
+	}
+	
+	box_close(writer, stsc);
+	
+	const size_t stsz = full_box_open(writer, "stsz", 0, 0);
+	put_u32(writer, 0);
+	put_u32(writer, (uint32_t) samples->offset);
+	
+	for (size_t index = 0; index < samples->offset; index++) {
+		put_u32(writer, samples->items[index].size);
+	}
+	
+	box_close(writer, stsz);
+	
+	const size_t co64 = full_box_open(writer, "co64", 0, 0);
+	put_u32(writer, (uint32_t) chunks->offset);
+	
+	for (size_t index = 0; index < chunks->offset; index++) {
+		put_u64(writer, chunks->items[index].offset);
+	}
+	
+	box_close(writer, co64);
+	
+	box_close(writer, stbl);
+	
+}
+
+static void write_track(
+	struct MP4Writer* const writer,
+	const struct RemuxTrack* const track,
+	const int is_video,
+	const int64_t start_pts
+) {
+	
+	const int64_t duration = track_duration(track);
+	const uint64_t movie_duration = rescale(duration, track->timescale, MOVIE_TIMESCALE);
+	
+	/* Presentation of this track begins this late relative to the earliest one */
+	const uint64_t delay = rescale(track->first_pts - start_pts, VIDEO_TIMESCALE, MOVIE_TIMESCALE);
+	const int32_t media_time = is_video ? track->samples.items[0].cts : 0;
+	
+	const size_t trak = box_open(writer, "trak");
+	
+	const size_t tkhd = full_box_open(writer, "tkhd", 0, 0x000003);
+	put_u32(writer, 0);
+	put_u32(writer, 0);
+	put_u32(writer, track->id);
+	put_u32(writer, 0);
+	put_u32(writer, (uint32_t) (movie_duration + delay));
+	put_zeros(writer, 8);
+	put_u16(writer, 0);
+	put_u16(writer, is_video ? 0 : 1);
+	put_u16(writer, is_video ? 0 : 0x0100);
+	put_u16(writer, 0);
+	
+	for (size_t index = 0; index < sizeof(UNITY_MATRIX) / sizeof(*UNITY_MATRIX); index++) {
+		put_u32(writer, UNITY_MATRIX[index]);
+	}
+	
+	put_u32(writer, is_video ? (uint32_t) track->width << 16 : 0);
+	put_u32(writer, is_video ? (uint32_t) track->height << 16 : 0);
+	box_close(writer, tkhd);
+	
+	const size_t edts = box_open(writer, "edts");
+	const size_t elst = full_box_open(writer, "elst", 0, 0);
+	put_u32(writer, delay > 0 ? 2 : 1);
+	
+	if (delay > 0) {
+		put_u32(writer, (uint32_t) delay);
+		put_u32(writer, 0xFFFFFFFF);
+		put_u16(writer, 1);
+		put_u16(writer, 0);
+	}
+	
+	put_u32(writer, (uint32_t) movie_duration);
+	put_u32(writer, (uint32_t) media_time);
+	put_u16(writer, 1);
+	put_u16(writer, 0);
+	box_close(writer, elst);
+	box_close(writer, edts);
+	
+	const size_t mdia = box_open(writer, "mdia");
+	
+	const size_t mdhd = full_box_open(writer, "mdhd", 0, 0);
+	put_u32(writer, 0);
+	put_u32(writer, 0);
+	put_u32(writer, track->timescale);
+	put_u32(writer, (uint32_t) duration);
+	put_u16(writer, 0x55C4);
+	put_u16(writer, 0);
+	box_close(writer, mdhd);
+	
+	const size_t hdlr = full_box_open(writer, "hdlr", 0, 0);
+	put_u32(writer, 0);
+	put(writer, is_video ? "vide" : "soun", 4);
+	put_zeros(writer, 12);
+	
+	const char* const name = is_video ? "VideoHandler" : "SoundHandler";
+	put(writer, name, strlen(name) + 1);
+	box_close(writer, hdlr);
+	
+	const size_t minf = box_open(writer, "minf");
+	
+	if (is_video) {
+		const size_t vmhd = full_box_open(writer, "vmhd", 0, 1);
+		put_zeros(writer, 8);
+		box_close(writer, vmhd);
+	} else {
+		const size_t smhd = full_box_open(writer, "smhd", 0, 0);
+		put_zeros(writer, 4);
+		box_close(writer, smhd);
+	}
+	
+	const size_t dinf = box_open(writer, "dinf");
+	const size_t dref = full_box_open(writer, "dref", 0, 0);
+	put_u32(writer, 1);
+	const size_t url = full_box_open(writer, "url ", 0, 1);
+	box_close(writer, url);
+	box_close(writer, dref);
+	box_close(writer, dinf);
+	
+	write_sample_table(writer, track, is_video);
+	
+	box_close(writer, minf);
+	box_close(writer, mdia);
+	box_close(writer, trak);
+	
+}
+
+int remuxer_finish(struct Remuxer* const obj) {
+	/*
+	Writes out the pending media data and the moov box. The moov box goes into the space
+	reserved at the beginning of the file when it fits, and after the media data otherwise.
+	*/
+	
+	struct RemuxTrack* const tracks[] = {&obj->video, &obj->audio};
+	
+	for (size_t index = 0; index < sizeof(tracks) / sizeof(*tracks); index++) {
+		int code = flush_pes(obj, tracks[index]);
+		
+		if (code != UERR_SUCCESS) {
+			return code;
+		}
+		
+		code = flush_chunk(obj, tracks[index]);
+		
+		if (code != UERR_SUCCESS) {
+			return code;
+		}
+	}
+	
+	const int has_video = obj->video.samples.offset > 0;
+	const int has_audio = obj->audio.samples.offset > 0;
+	
+	if (!has_video && !has_audio) {
+		return UERR_REMUX_INVALID_STREAM;
+	}
+	
+	int64_t start_pts = has_video ? obj->video.first_pts : obj->audio.first_pts;
+	
+	if (has_audio && obj->audio.first_pts < start_pts) {
+		start_pts = obj->audio.first_pts;
+	}
+	
+	uint64_t duration = 0;
+	
+	for (size_t index = 0; index < sizeof(tracks) / sizeof(*tracks); index++) {
+		const struct RemuxTrack* const track = tracks[index];
+		
+		if (track->samples.offset == 0) {
+			continue;
+		}
+		
+		const uint64_t track_end = (
+			rescale(track->first_pts - start_pts, VIDEO_TIMESCALE, MOVIE_TIMESCALE) +
+			rescale(track_duration(track), track->timescale, MOVIE_TIMESCALE)
+		);
+		
+		if (track_end > duration) {
+			duration = track_end;
+		}
+	}
+	
+	struct MP4Writer writer = {0};
+	
+	const size_t moov = box_open(&writer, "moov");
+	
+	const size_t mvhd = full_box_open(&writer, "mvhd", 0, 0);
+	put_u32(&writer, 0);
+	put_u32(&writer, 0);
+	put_u32(&writer, MOVIE_TIMESCALE);
+	put_u32(&writer, (uint32_t) duration);
+	put_u32(&writer, 0x00010000);
+	put_u16(&writer, 0x0100);
+	put_zeros(&writer, 10);
+	
+	for (size_t index = 0; index < sizeof(UNITY_MATRIX) / sizeof(*UNITY_MATRIX); index++) {
+		put_u32(&writer, UNITY_MATRIX[index]);
+	}
+	
+	put_zeros(&writer, 24);
+	put_u32(&writer, 3);
+	box_close(&writer, mvhd);
+	
+	if (has_video) {
+		write_track(&writer, &obj->video, 1, start_pts);
+	}
+	
+	if (has_audio) {
+		write_track(&writer, &obj->audio, 0, start_pts);
+	}
+	
+	box_close(&writer, moov);
+	
+	if (writer.failed) {
+		string_free(&writer.data);
+		return UERR_MEMORY_ALLOCATE_FAILURE;
+	}
+	
+	const uint64_t mdat_size = obj->position - obj->mdat_offset;
+	const uint64_t moov_size = writer.data.slength;
+	
+	const int fits = moov_size == obj->reserved_size || moov_size + 8 <= obj->reserved_size;
+	
+	int code = UERR_SUCCESS;
+	
+	if (fits) {
+		if (fseeko(obj->stream, (off_t) obj->reserved_offset, SEEK_SET) != 0) {
+			code = UERR_FILE_WRITE_FAILURE;
+		}
+		
+		if (code == UERR_SUCCESS && fwrite(writer.data.s, 1, writer.data.slength, obj->stream) != writer.data.slength) {
+			code = UERR_FILE_WRITE_FAILURE;
+		}
+		
+		if (code == UERR_SUCCESS && moov_size != obj->reserved_size) {
+			const uint32_t free_size = (uint32_t) (obj->reserved_size - moov_size);
+			
+			const unsigned char free[] = {
+				(unsigned char) (free_size >> 24),
+				(unsigned char) (free_size >> 16),
+				(unsigned char) (free_size >> 8),
+				(unsigned char) free_size,
+				'f', 'r', 'e', 'e'
+			};
+			
+			if (fwrite(free, 1, sizeof(free), obj->stream) != sizeof(free)) {
+				code = UERR_FILE_WRITE_FAILURE;
+			}
+		}
+	} else {
+		if (fseeko(obj->stream, (off_t) obj->position, SEEK_SET) != 0) {
+			code = UERR_FILE_WRITE_FAILURE;
+		}
+		
+		if (code == UERR_SUCCESS && fwrite(writer.data.s, 1, writer.data.slength, obj->stream) != writer.data.slength) {
+			code = UERR_FILE_WRITE_FAILURE;
+		}
+	}
+	
+	string_free(&writer.data);
+	
+	if (code != UERR_SUCCESS) {
+		return code;
+	}
+	
+	const unsigned char largesize[] = {
+		(unsigned char) (mdat_size >> 56),
+		(unsigned char) (mdat_size >> 48),
+		(unsigned char) (mdat_size >> 40),
+		(unsigned char) (mdat_size >> 32),
+		(unsigned char) (mdat_size >> 24),
+		(unsigned char) (mdat_size >> 16),
+		(unsigned char) (mdat_size >> 8),
+		(unsigned char) mdat_size
+	};
+	
+	if (fseeko(obj->stream, (off_t) (obj->mdat_offset + 8), SEEK_SET) != 0) {
+		return UERR_FILE_WRITE_FAILURE;
+	}
+	
+	if (fwrite(largesize, 1, sizeof(largesize), obj->stream) != sizeof(largesize)) {
+		return UERR_FILE_WRITE_FAILURE;
+	}
+	
+	if (fflush(obj->stream) != 0) {
+		return UERR_FILE_WRITE_FAILURE;
+	}
+	
+	return UERR_SUCCESS;
+	
+}
+
+void remuxer_free(struct Remuxer* const obj) {
+	
+	struct RemuxTrack* const tracks[] = {&obj->video, &obj->audio};
+	
+	for (size_t index = 0; index < sizeof(tracks) / sizeof(*tracks); index++) {
+		struct RemuxTrack* const track = tracks[index];
+		
+		string_free(&track->pes);
+		string_free(&track->pending);
+		string_free(&track->sps);
+		string_free(&track->pps);
+		string_free(&track->carry);
+		
+		free(track->samples.items);
+		track->samples.items = NULL;
+		track->samples.offset = 0;
+		track->samples.size = 0;
+		
+		free(track->chunks.items);
+		track->chunks.items = NULL;
+		track->chunks.offset = 0;
+		track->chunks.size = 0;
+	}
+	
+	obj->stream = NULL;
+	
+}
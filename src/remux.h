@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#include "types.h"
+
+struct RemuxSample {
+	uint32_t size;
+	int32_t cts;
+	int64_t dts;
+	int keyframe;
+};
+
+struct RemuxSamples {
+	size_t offset;
+	size_t size;
+	struct RemuxSample* items;
+};
+
+struct RemuxChunk {
+	uint64_t offset;
+	uint32_t samples;
+};
+
+struct RemuxChunks {
+	size_t offset;
+	size_t size;
+	struct RemuxChunk* items;
+};
+
+struct RemuxTrack {
+	int pid;
+	uint32_t id;
+	uint32_t timescale;
+	int64_t last_timestamp;
+	int has_timestamp;
+	int64_t first_pts;
+	int has_first_pts;
+	struct String pes;
+	struct String pending;
+	size_t pending_samples;
+	int64_t pending_start;
+	struct RemuxSamples samples;
+	struct RemuxChunks chunks;
+	struct String sps;
+	struct String pps;
+	int width;
+	int height;
+	struct String carry;
+	int object_type;
+	int frequency_index;
+	int channels;
+};
+
+struct Remuxer {
+	FILE* stream;
+	uint64_t position;
+	uint64_t reserved_offset;
+	uint64_t reserved_size;
+	uint64_t mdat_offset;
+	int pmt_pid;
+	unsigned char packet[188];
+	size_t packet_size;
+	struct RemuxTrack video;
+	struct RemuxTrack audio;
+};
+
+int remuxer_init(struct Remuxer* const obj, FILE* const stream, const double duration);
+int remuxer_feed(struct Remuxer* const obj, const unsigned char* data, size_t size);
+int remuxer_finish(struct Remuxer* const obj);
+void remuxer_free(struct Remuxer* const obj);
+
+#pragma once
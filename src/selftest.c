@@ -0,0 +1,447 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+	#include <windows.h>
+#endif
+
+#include <bearssl.h>
+
+#include "selftest.h"
+#include "callbacks.h"
+#include "decrypt.h"
+#include "m3u8.h"
+#include "types.h"
+#include "errors.h"
+#include "symbols.h"
+#include "utils.h"
+#include "memory.h"
+
+/* Each stage is repeated until it has run for at least this long, in microseconds */
+#define SELFTEST_MIN_TIME 2000000ULL
+
+/* Data is pushed through every stage one segment at a time */
+#define SELFTEST_SEGMENT_SIZE (1024 * 1024 * 2)
+
+/* The file stages start over in a new file once this much has been written to one */
+#define SELFTEST_FILE_SIZE (1024ULL * 1024 * 256)
+
+/* Segments listed in the synthetic playlist */
+#define SELFTEST_PLAYLIST_SEGMENTS 2000
+
+static const char SELFTEST_FILENAME[] = "sparklec-selftest.part";
+
+struct Selftest {
+	size_t chunk_size;
+	unsigned char* segment;
+	unsigned char* ciphertext;
+	unsigned char* plaintext;
+	size_t ciphertext_size;
+	unsigned char key[AES_BLOCK_SIZE];
+	unsigned char iv[AES_BLOCK_SIZE];
+	struct String string;
+	br_sha256_context context;
+	char* filename;
+	FILE* stream;
+	char* stream_buffer;
+	struct FileDownload download;
+	int downloading;
+	uint64_t written;
+	char* playlist;
+	size_t playlist_size;
+};
+
+struct SelftestStage {
+	const char* name;
+	int (*run)(struct Selftest* const obj, uint64_t* const bytes);
+};
+
+static uint64_t get_time(void) {
+	
+	#ifdef _WIN32
+		static LARGE_INTEGER frequency = {0};
+		LARGE_INTEGER counter = {0};
+		
+		if (frequency.QuadPart == 0) {
+			QueryPerformanceFrequency(&frequency);
+		}
+		
+		QueryPerformanceCounter(&counter);
+		
+		return (uint64_t) (counter.QuadPart / frequency.QuadPart) * 1000000 + (uint64_t) (counter.QuadPart % frequency.QuadPart) * 1000000 / (uint64_t) frequency.QuadPart;
+	#else
+		struct timespec ts = {0};
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		
+		return (uint64_t) ts.tv_sec * 1000000 + (uint64_t) ts.tv_nsec / 1000;
+	#endif
+	
+}
+
+static void fill_random(unsigned char* const data, const size_t size) {
+	/*
+	Media segments are already compressed, so the synthetic ones are made incompressible too.
+	*/
+	
+	uint64_t state = 0x9E3779B97F4A7C15ULL;
+	
+	for (size_t index = 0; index < size; index++) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		
+		data[index] = (unsigned char) state;
+	}
+	
+}
+
+static int stage_write_callback(struct Selftest* const obj, uint64_t* const bytes) {
+	/*
+	curl_write_cb() into a reused buffer, as segments are received.
+	*/
+	
+	obj->string.slength = 0;
+	
+	for (size_t offset = 0; offset < SELFTEST_SEGMENT_SIZE; offset += obj->chunk_size) {
+		const size_t size = SELFTEST_SEGMENT_SIZE - offset < obj->chunk_size ? SELFTEST_SEGMENT_SIZE - offset : obj->chunk_size;
+		
+		if (curl_write_cb((char*) obj->segment + offset, 1, size, &obj->string) != size) {
+			return UERR_MEMORY_ALLOCATE_FAILURE;
+		}
+	}
+	
+	*bytes += SELFTEST_SEGMENT_SIZE;
+	
+	return UERR_SUCCESS;
+	
+}
+
+static int stage_sha256(struct Selftest* const obj, uint64_t* const bytes) {
+	
+	for (size_t offset = 0; offset < SELFTEST_SEGMENT_SIZE; offset += obj->chunk_size) {
+		const size_t size = SELFTEST_SEGMENT_SIZE - offset < obj->chunk_size ? SELFTEST_SEGMENT_SIZE - offset : obj->chunk_size;
+		br_sha256_update(&obj->context, obj->segment + offset, size);
+	}
+	
+	*bytes += SELFTEST_SEGMENT_SIZE;
+	
+	return UERR_SUCCESS;
+	
+}
+
+static void file_close(struct Selftest* const obj) {
+	
+	if (obj->downloading) {
+		file_download_finish(&obj->download);
+		obj->downloading = 0;
+	}
+	
+	if (obj->stream != NULL) {
+		fclose(obj->stream);
+		obj->stream = NULL;
+	}
+	
+	memory_free(obj->stream_buffer);
+	obj->stream_buffer = NULL;
+	
+	remove_file(obj->filename);
+	obj->written = 0;
+	
+}
+
+static int file_open(struct Selftest* const obj, const int hashed) {
+	/*
+	Opens the file the same way downloads are: through a FileDownload when the content is
+	hashed, or through a stdio buffer of the same size otherwise.
+	*/
+	
+	FILE* const stream = open_file(obj->filename, "wb");
+	
+	if (stream == NULL) {
+		return UERR_FILE_WRITE_FAILURE;
+	}
+	
+	if (hashed) {
+		if (!file_download_init(&obj->download, stream)) {
+			return UERR_MEMORY_ALLOCATE_FAILURE;
+		}
+		
+		obj->downloading = 1;
+		
+		return UERR_SUCCESS;
+	}
+	
+	obj->stream = stream;
+	obj->stream_buffer = memory_alloc(MEMORY_HTTP, FILE_WRITE_BUFFER_SIZE);
+	
+	if (obj->stream_buffer == NULL || setvbuf(stream, obj->stream_buffer, _IOFBF, FILE_WRITE_BUFFER_SIZE) != 0) {
+		file_close(obj);
+		return UERR_MEMORY_ALLOCATE_FAILURE;
+	}
+	
+	return UERR_SUCCESS;
+	
+}
+
+static int file_stage(struct Selftest* const obj, uint64_t* const bytes, const int hashed) {
+	
+	if (obj->written >= SELFTEST_FILE_SIZE) {
+		file_close(obj);
+	}
+	
+	if (!obj->downloading && obj->stream == NULL) {
+		const int status = file_open(obj, hashed);
+		
+		if (status != UERR_SUCCESS) {
+			return status;
+		}
+	}
+	
+	for (size_t offset = 0; offset < SELFTEST_SEGMENT_SIZE; offset += obj->chunk_size) {
+		const size_t size = SELFTEST_SEGMENT_SIZE - offset < obj->chunk_size ? SELFTEST_SEGMENT_SIZE - offset : obj->chunk_size;
+		char* const chunk = (char*) obj->segment + offset;
+		
+		const size_t count = hashed ? curl_write_download_cb(chunk, 1, size, &obj->download) : curl_write_file_cb(chunk, 1, size, obj->stream);
+		
+		if (count != size) {
+			return UERR_FILE_WRITE_FAILURE;
+		}
+	}
+	
+	obj->written += SELFTEST_SEGMENT_SIZE;
+	*bytes += SELFTEST_SEGMENT_SIZE;
+	
+	return UERR_SUCCESS;
+	
+}
+
+static int stage_file(struct Selftest* const obj, uint64_t* const bytes) {
+	/*
+	curl_write_file_cb() into a file, with no hashing.
+	*/
+	
+	return file_stage(obj, bytes, 0);
+	
+}
+
+static int stage_file_sha256(struct Selftest* const obj, uint64_t* const bytes) {
+	/*
+	curl_write_download_cb(), which attachments are written through: file and digest together.
+	*/
+	
+	return file_stage(obj, bytes, 1);
+	
+}
+
+static int stage_decrypt(struct Selftest* const obj, uint64_t* const bytes) {
+	/*
+	decrypt_segment() on an AES-128 encrypted segment, including the copy the remux worker
+	would otherwise not need.
+	*/
+	
+	size_t size = obj->ciphertext_size;
+	memcpy(obj->plaintext, obj->ciphertext, size);
+	
+	const int status = decrypt_segment(obj->key, obj->iv, obj->plaintext, &size);
+	
+	if (status != UERR_SUCCESS) {
+		return status;
+	}
+	
+	*bytes += obj->ciphertext_size;
+	
+	return UERR_SUCCESS;
+	
+}
+
+static int stage_playlist(struct Selftest* const obj, uint64_t* const bytes) {
+	/*
+	m3u8_parse() of a media playlist, as done for every lecture before its segments are fetched.
+	*/
+	
+	struct Tags tags = {0};
+	
+	const int status = m3u8_parse(&tags, obj->playlist);
+	m3u8_free(&tags);
+	
+	*bytes += obj->playlist_size;
+	
+	return status;
+	
+}
+
+static const struct SelftestStage STAGES[] = {
+	{"callback de escrita", stage_write_callback},
+	{"sha256", stage_sha256},
+	{"gravação em arquivo", stage_file},
+	{"gravação + sha256", stage_file_sha256},
+	{"decifragem AES-128", stage_decrypt},
+	{"leitura de playlist", stage_playlist}
+};
+
+static int selftest_init(struct Selftest* const obj, const char* const directory, const size_t chunk_size) {
+	
+	memset(obj, 0, sizeof(*obj));
+	
+	obj->chunk_size = chunk_size;
+	
+	obj->filename = memory_alloc(MEMORY_PATHS, strlen(directory) + strlen(PATH_SEPARATOR) + strlen(SELFTEST_FILENAME) + 1);
+	
+	if (obj->filename == NULL) {
+		return UERR_MEMORY_ALLOCATE_FAILURE;
+	}
+	
+	strcpy(obj->filename, directory);
+	strcat(obj->filename, PATH_SEPARATOR);
+	strcat(obj->filename, SELFTEST_FILENAME);
+	
+	/* Room for the PKCS#7 padding, which is a whole block when the size is already aligned */
+	obj->ciphertext_size = SELFTEST_SEGMENT_SIZE + AES_BLOCK_SIZE;
+	
+	obj->segment = malloc(SELFTEST_SEGMENT_SIZE);
+	obj->ciphertext = malloc(obj->ciphertext_size);
+	obj->plaintext = malloc(obj->ciphertext_size);
+	
+	if (obj->segment == NULL || obj->ciphertext == NULL || obj->plaintext == NULL) {
+		return UERR_MEMORY_ALLOCATE_FAILURE;
+	}
+	
+	fill_random(obj->segment, SELFTEST_SEGMENT_SIZE);
+	fill_random(obj->key, sizeof(obj->key));
+	fill_random(obj->iv, sizeof(obj->iv));
+	
+	memcpy(obj->ciphertext, obj->segment, SELFTEST_SEGMENT_SIZE);
+	memset(obj->ciphertext + SELFTEST_SEGMENT_SIZE, AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+	
+	br_aes_ct_cbcenc_keys context;
+	br_aes_ct_cbcenc_init(&context, obj->key, sizeof(obj->key));
+	
+	unsigned char chain[AES_BLOCK_SIZE];
+	memcpy(chain, obj->iv, sizeof(chain));
+	
+	br_aes_ct_cbcenc_run(&context, chain, obj->ciphertext, obj->ciphertext_size);
+	
+	br_sha256_init(&obj->context);
+	
+	/* A typical media playlist: absolute segment URLs carrying a signed query string */
+	static const char header[] = "#EXTM3U\n#EXT-X-VERSION:3\n#EXT-X-TARGETDURATION:6\n#EXT-X-MEDIA-SEQUENCE:0\n#EXT-X-KEY:METHOD=AES-128,URI=\"https://cdn.example.com/key.bin\",IV=0x00000000000000000000000000000001\n";
+	static const char segment[] = "#EXTINF:6.006,\nhttps://cdn.example.com/hls/0123456789abcdef/720p/segment-%05zu.ts?token=6f1e2d3c4b5a69788796a5b4c3d2e1f0&expires=1700000000\n";
+	static const char footer[] = "#EXT-X-ENDLIST\n";
+	
+	const size_t size = sizeof(header) + (sizeof(segment) + 8) * SELFTEST_PLAYLIST_SEGMENTS + sizeof(footer);
+	
+	obj->playlist = malloc(size);
+	
+	if (obj->playlist == NULL) {
+		return UERR_MEMORY_ALLOCATE_FAILURE;
+	}
+	
+	size_t offset = (size_t) snprintf(obj->playlist, size, "%s", header);
+	
+	for (size_t index = 0; index < SELFTEST_PLAYLIST_SEGMENTS; index++) {
+		offset += (size_t) snprintf(obj->playlist + offset, size - offset, segment, index);
+	}
+	
+	offset += (size_t) snprintf(obj->playlist + offset, size - offset, "%s", footer);
+	
+	obj->playlist_size = offset;
+	
+	return UERR_SUCCESS;
+	
+}
+
+static void selftest_free(struct Selftest* const obj) {
+	
+	if (obj->filename != NULL) {
+		file_close(obj);
+	}
+	
+	string_free(&obj->string);
+	
+	memory_free(obj->filename);
+	free(obj->segment);
+	free(obj->ciphertext);
+	free(obj->plaintext);
+	free(obj->playlist);
+	
+	memset(obj, 0, sizeof(*obj));
+	
+}
+
+int selftest_throughput(FILE* const stream, const char* const directory, const size_t chunk_size) {
+	/*
+	Pushes synthetic segments through each stage of the download path as fast as it will take
+	them, with no network involved, and reports the throughput of each. The file stages write
+	to a scratch file in "directory", through the page cache as downloads do; "chunk_size"
+	is the size of the pieces curl would hand over, CURLOPT_BUFFERSIZE.
+	*/
+	
+	struct Selftest obj = {0};
+	int status = selftest_init(&obj, directory, chunk_size);
+	
+	if (status != UERR_SUCCESS) {
+		selftest_free(&obj);
+		return status;
+	}
+	
+	fprintf(stream, "+ Vazão máxima de cada etapa, sem rede (blocos de %zu bytes):\r\n", chunk_size);
+	/* The widths count bytes, and "vazão" has a character that takes two bytes */
+	fprintf(stream, "  %-24s %13s\r\n", "etapa", "vazão (GB/s)");
+	
+	const struct SelftestStage* slowest = NULL;
+	double slowest_rate = 0;
+	
+	for (size_t index = 0; index < sizeof(STAGES) / sizeof(*STAGES) && status == UERR_SUCCESS; index++) {
+		const struct SelftestStage* const stage = &STAGES[index];
+		
+		uint64_t bytes = 0;
+		uint64_t elapsed = 0;
+		
+		const uint64_t start = get_time();
+		
+		while (status == UERR_SUCCESS && elapsed < SELFTEST_MIN_TIME) {
+			status = stage->run(&obj, &bytes);
+			elapsed = get_time() - start;
+		}
+		
+		/* What is still buffered or in flight counts towards the file stages */
+		if (obj.downloading || obj.stream != NULL) {
+			file_close(&obj);
+			elapsed = get_time() - start;
+		}
+		
+		if (status != UERR_SUCCESS) {
+			break;
+		}
+		
+		const double rate = (double) bytes / (1024.0 * 1024 * 1024) / ((double) elapsed / 1e6);
+		
+		/* Padding is counted in characters, not bytes, since names carry accented letters */
+		size_t width = 0;
+		
+		for (const char* ch = stage->name; *ch != '\0'; ch++) {
+			if (((unsigned char) *ch & 0xC0) != 0x80) {
+				width++;
+			}
+		}
+		
+		fprintf(stream, "  %s%*s %12.2f\r\n", stage->name, (int) (width < 24 ? 24 - width : 0), "", rate);
+		
+		if (slowest == NULL || rate < slowest_rate) {
+			slowest = stage;
+			slowest_rate = rate;
+		}
+	}
+	
+	if (status == UERR_SUCCESS && slowest != NULL) {
+		fprintf(stream, "+ Etapa mais lenta: %s (%.2f GB/s)\r\n", slowest->name, slowest_rate);
+	}
+	
+	selftest_free(&obj);
+	
+	return status;
+	
+}
@@ -0,0 +1,5 @@
+#include <stdio.h>
+
+int selftest_throughput(FILE* const stream, const char* const directory, const size_t chunk_size);
+
+#pragma once
@@ -1,22 +1,21 @@
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 
 #include <bearssl.h>
 
+#include "sha256.h"
 #include "utils.h"
 
-void sha256_digest(const char* const s, char* dst) {
-	
-	br_sha256_context context = {0};
-	br_sha256_init(&context);
-	br_sha256_update(&context, s, strlen(s));
+void sha256_hexdigest(const br_sha256_context* const context, char* dst) {
 	
-	char sha256[br_sha256_SIZE];
-	br_sha256_out(&context, sha256);
+	unsigned char sha256[br_sha256_SIZE];
+	br_sha256_out(context, sha256);
 	
 	size_t dst_offset = 0;
 	
 	for (size_t index = 0; index < sizeof(sha256); index++) {
-		const char ch = sha256[index];
+		const unsigned char ch = sha256[index];
 		
 		dst[dst_offset++] = to_hex((ch & 0xF0) >> 4);
 		dst[dst_offset++] = to_hex((ch & 0x0F) >> 0);
@@ -25,3 +24,61 @@ void sha256_digest(const char* const s, char* dst) {
 	dst[dst_offset] = '\0';
 	
 }
+
+void sha256_digest(const char* const s, char* dst) {
+	
+	br_sha256_context context = {0};
+	br_sha256_init(&context);
+	br_sha256_update(&context, s, strlen(s));
+	
+	sha256_hexdigest(&context, dst);
+	
+}
+
+int sha256_file(const char* const filename, char* dst, uint64_t* const size) {
+	/*
+	Hashes the whole file, also reporting how many bytes it holds.
+	*/
+	
+	FILE* const stream = open_file(filename, "rb");
+	
+	if (stream == NULL) {
+		return 0;
+	}
+	
+	const size_t buffer_size = 1024 * 1024;
+	char* const buffer = malloc(buffer_size);
+	
+	if (buffer == NULL) {
+		fclose(stream);
+		return 0;
+	}
+	
+	br_sha256_context context = {0};
+	br_sha256_init(&context);
+	
+	*size = 0;
+	
+	while (1) {
+		const size_t count = fread(buffer, 1, buffer_size, stream);
+		
+		if (count == 0) {
+			break;
+		}
+		
+		br_sha256_update(&context, buffer, count);
+		*size += count;
+	}
+	
+	const int ok = !ferror(stream);
+	
+	free(buffer);
+	fclose(stream);
+	
+	if (ok) {
+		sha256_hexdigest(&context, dst);
+	}
+	
+	return ok;
+	
+}
@@ -1 +1,13 @@
-void sha256_digest(const char* const s, char* dst);
\ No newline at end of file
+#include <stdio.h>
+#include <stdint.h>
+
+#include <bearssl.h>
+
+/* Size of a hex encoded digest, including the terminator */
+#define SHA256_HEX_SIZE (br_sha256_SIZE * 2 + 1)
+
+void sha256_digest(const char* const s, char* dst);
+void sha256_hexdigest(const br_sha256_context* const context, char* dst);
+int sha256_file(const char* const filename, char* dst, uint64_t* const size);
+
+#pragma once
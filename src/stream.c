@@ -0,0 +1,165 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <curl/curl.h>
+#include <jansson.h>
+
+#include "stream.h"
+#include "errors.h"
+#include "memory.h"
+
+/* Large enough for the biggest chunk curl delivers by default (CURL_MAX_WRITE_SIZE) */
+#define JSON_STREAM_MIN_CAPACITY (1024 * 16)
+
+static size_t json_stream_write_cb(char* chunk, size_t size, size_t nmemb, void* ptr) {
+	/*
+	Queues the received chunk until the JSON decoder asks for more input.
+	*/
+	
+	struct JSONStream* const stream = (struct JSONStream*) ptr;
+	
+	const size_t chunk_size = size * nmemb;
+	
+	if (stream->offset > 0) {
+		memmove(stream->buffer, stream->buffer + stream->offset, stream->size - stream->offset);
+		stream->size -= stream->offset;
+		stream->offset = 0;
+	}
+	
+	if (stream->size + chunk_size > stream->capacity) {
+		/* Doubled, so that chunks piling up ahead of the decoder are not copied again on every one */
+		size_t capacity = stream->capacity == 0 ? JSON_STREAM_MIN_CAPACITY : stream->capacity;
+		
+		while (capacity < stream->size + chunk_size) {
+			capacity *= 2;
+		}
+		
+		char* const buffer = memory_realloc(MEMORY_HTTP, stream->buffer, capacity);
+		
+		if (buffer == NULL) {
+			return 0;
+		}
+		
+		stream->buffer = buffer;
+		stream->capacity = capacity;
+	}
+	
+	memcpy(stream->buffer + stream->size, chunk, chunk_size);
+	stream->size += chunk_size;
+	
+	return chunk_size;
+	
+}
+
+static size_t json_stream_read_cb(void* buffer, size_t buflen, void* data) {
+	/*
+	Hands queued bytes to jansson, driving the transfer forward whenever the queue runs dry.
+	Returns 0 at the end of the body and (size_t) -1 if the transfer failed.
+	*/
+	
+	struct JSONStream* const stream = (struct JSONStream*) data;
+	
+	while (stream->offset == stream->size) {
+		stream->offset = 0;
+		stream->size = 0;
+		
+		if (!stream->running) {
+			return stream->code == CURLE_OK ? 0 : (size_t) -1;
+		}
+		
+		int still_running = 0;
+		CURLMcode mc = curl_multi_perform(stream->multi, &still_running);
+		
+		if (mc != CURLM_OK) {
+			stream->code = CURLE_RECV_ERROR;
+			stream->running = 0;
+			return (size_t) -1;
+		}
+		
+		CURLMsg* msg = NULL;
+		int msgs_left = 0;
+		
+		while ((msg = curl_multi_info_read(stream->multi, &msgs_left))) {
+			if (msg->msg == CURLMSG_DONE && msg->easy_handle == stream->handle) {
+				stream->code = msg->data.result;
+				stream->running = 0;
+			}
+		}
+		
+		if (stream->running && stream->size == 0) {
+			mc = curl_multi_poll(stream->multi, NULL, 0, 1000, NULL);
+			
+			if (mc != CURLM_OK) {
+				stream->code = CURLE_RECV_ERROR;
+				stream->running = 0;
+				return (size_t) -1;
+			}
+		}
+	}
+	
+	const size_t available = stream->size - stream->offset;
+	const size_t size = available < buflen ? available : buflen;
+	
+	if (size > 0) {
+		memcpy(buffer, stream->buffer + stream->offset, size);
+		stream->offset += size;
+	}
+	
+	return size;
+	
+}
+
+int json_stream_load(CURLM* const multi, CURL* const handle, json_t** const tree) {
+	/*
+	Performs the request configured on the handle and decodes the response body as it arrives,
+	so that the raw text is never held in memory as a whole. "multi" must be reserved for these
+	requests: completion messages for any other transfer on it would be read and lost.
+	*/
+	
+	struct JSONStream stream = {
+		.multi = multi,
+		.handle = handle,
+		.running = 1,
+		.code = CURLE_OK
+	};
+	
+	curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, json_stream_write_cb);
+	curl_easy_setopt(handle, CURLOPT_WRITEDATA, &stream);
+	
+	if (curl_multi_add_handle(multi, handle) != CURLM_OK) {
+		/* The handle must not be left pointing at this stack frame */
+		curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, NULL);
+		curl_easy_setopt(handle, CURLOPT_WRITEDATA, NULL);
+		
+		return UERR_CURL_FAILURE;
+	}
+	
+	*tree = json_loadcb(json_stream_read_cb, &stream, 0, NULL);
+	
+	/* Drain whatever the decoder left unread so the connection can be reused */
+	while (stream.running) {
+		stream.offset = stream.size;
+		json_stream_read_cb(NULL, 0, &stream);
+	}
+	
+	curl_multi_remove_handle(multi, handle);
+	
+	curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, NULL);
+	curl_easy_setopt(handle, CURLOPT_WRITEDATA, NULL);
+	
+	memory_free(stream.buffer);
+	
+	if (stream.code != CURLE_OK) {
+		json_decref(*tree);
+		*tree = NULL;
+		
+		return UERR_CURL_FAILURE;
+	}
+	
+	if (*tree == NULL) {
+		return UERR_JSON_CANNOT_PARSE;
+	}
+	
+	return UERR_SUCCESS;
+	
+}
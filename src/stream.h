@@ -0,0 +1,17 @@
+#include <curl/curl.h>
+#include <jansson.h>
+
+struct JSONStream {
+	CURLM* multi;
+	CURL* handle;
+	int running;
+	CURLcode code;
+	char* buffer;
+	size_t offset;
+	size_t size;
+	size_t capacity;
+};
+
+int json_stream_load(CURLM* const multi, CURL* const handle, json_t** const tree);
+
+#pragma once
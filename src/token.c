@@ -0,0 +1,384 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <curl/curl.h>
+#include <jansson.h>
+
+#include "token.h"
+#include "query.h"
+#include "stream.h"
+#include "errors.h"
+#include "metrics.h"
+#include "eventlog.h"
+#include "trace.h"
+#include "memory.h"
+
+/* Refresh this many seconds before the access token lapses */
+#define TOKEN_REFRESH_MARGIN 300
+
+/* Wait this many seconds before trying again after a failed refresh */
+#define TOKEN_RETRY_INTERVAL 30
+
+static void charpp_free(char** ptr) {
+	free(*ptr);
+}
+
+static void curlcharpp_free(char** ptr) {
+	curl_free(*ptr);
+}
+
+static void memorycharpp_free(char** ptr) {
+	memory_free(*ptr);
+}
+
+int credentials_parse(const json_t* const tree, struct Credentials* const credentials) {
+	/*
+	Fills the credentials from an OAuth token response. The refresh token is kept as is
+	when the response does not rotate it.
+	*/
+	
+	const json_t* obj = json_object_get(tree, "access_token");
+	
+	if (obj == NULL) {
+		return UERR_JSON_MISSING_REQUIRED_KEY;
+	}
+	
+	if (!json_is_string(obj)) {
+		return UERR_JSON_NON_MATCHING_TYPE;
+	}
+	
+	const char* const access_token = json_string_value(obj);
+	
+	obj = json_object_get(tree, "refresh_token");
+	
+	if (obj == NULL && credentials->refresh_token == NULL) {
+		return UERR_JSON_MISSING_REQUIRED_KEY;
+	}
+	
+	if (obj != NULL && !json_is_string(obj)) {
+		return UERR_JSON_NON_MATCHING_TYPE;
+	}
+	
+	const char* const refresh_token = obj == NULL ? NULL : json_string_value(obj);
+	
+	obj = json_object_get(tree, "expires_in");
+	
+	if (obj == NULL) {
+		return UERR_JSON_MISSING_REQUIRED_KEY;
+	}
+	
+	if (!json_is_integer(obj)) {
+		return UERR_JSON_NON_MATCHING_TYPE;
+	}
+	
+	const int expires_in = json_integer_value(obj);
+	
+	char* const new_access_token = malloc(strlen(access_token) + 1);
+	
+	if (new_access_token == NULL) {
+		return UERR_MEMORY_ALLOCATE_FAILURE;
+	}
+	
+	strcpy(new_access_token, access_token);
+	
+	if (refresh_token != NULL) {
+		char* const new_refresh_token = malloc(strlen(refresh_token) + 1);
+		
+		if (new_refresh_token == NULL) {
+			free(new_access_token);
+			return UERR_MEMORY_ALLOCATE_FAILURE;
+		}
+		
+		strcpy(new_refresh_token, refresh_token);
+		
+		free(credentials->refresh_token);
+		credentials->refresh_token = new_refresh_token;
+	}
+	
+	free(credentials->access_token);
+	credentials->access_token = new_access_token;
+	
+	credentials->expires_in = expires_in;
+	credentials->expires_at = time(NULL) + expires_in;
+	
+	return UERR_SUCCESS;
+	
+}
+
+static time_t token_refresh_time(const struct Credentials* const credentials) {
+	
+	time_t margin = TOKEN_REFRESH_MARGIN;
+	
+	if (credentials->expires_in > 0 && credentials->expires_in / 2 < margin) {
+		margin = credentials->expires_in / 2;
+	}
+	
+	return credentials->expires_at - margin;
+	
+}
+
+int token_refresh(struct TokenRefresher* const obj, const char* const stale_token) {
+	/*
+	Exchanges the refresh token for a new access token. When "stale_token" is given and another
+	caller has already replaced it in the meantime, nothing is requested.
+	*/
+	
+	pthread_mutex_lock(&obj->refresh_lock);
+	pthread_mutex_lock(&obj->lock);
+	
+	if (stale_token != NULL && strcmp(stale_token, obj->credentials->access_token) != 0) {
+		pthread_mutex_unlock(&obj->lock);
+		pthread_mutex_unlock(&obj->refresh_lock);
+		
+		return UERR_SUCCESS;
+	}
+	
+	struct Credentials credentials = {
+		.username = obj->credentials->username,
+		.refresh_token = malloc(strlen(obj->credentials->refresh_token) + 1)
+	};
+	
+	if (credentials.refresh_token != NULL) {
+		strcpy(credentials.refresh_token, obj->credentials->refresh_token);
+	}
+	
+	pthread_mutex_unlock(&obj->lock);
+	
+	if (credentials.refresh_token == NULL) {
+		pthread_mutex_unlock(&obj->refresh_lock);
+		return UERR_MEMORY_ALLOCATE_FAILURE;
+	}
+	
+	int code = UERR_SUCCESS;
+	
+	char* refresh_token __attribute__((__cleanup__(curlcharpp_free))) = curl_easy_escape(NULL, credentials.refresh_token, 0);
+	
+	if (refresh_token == NULL) {
+		code = UERR_CURL_FAILURE;
+	}
+	
+	struct Query query __attribute__((__cleanup__(query_free))) = {0};
+	char* post_fields __attribute__((__cleanup__(memorycharpp_free))) = NULL;
+	
+	if (code == UERR_SUCCESS) {
+		add_parameter(&query, "grant_type", "refresh_token");
+		add_parameter(&query, "refresh_token", refresh_token);
+		
+		code = query_stringify(query, &post_fields);
+	}
+	
+	json_auto_t* tree = NULL;
+	
+	if (code == UERR_SUCCESS) {
+		curl_easy_setopt(obj->handle, CURLOPT_COPYPOSTFIELDS, post_fields);
+		curl_easy_setopt(obj->handle, CURLOPT_URL, obj->endpoint);
+		
+		code = json_stream_load(obj->multi, obj->handle, &tree);
+		metrics_record(obj->handle, TRANSFER_AUTH);
+		TRACE_TRANSFER(obj->handle, "auth");
+	}
+	
+	if (code == UERR_SUCCESS) {
+		code = credentials_parse(tree, &credentials);
+	}
+	
+	long response_code = 0;
+	curl_easy_getinfo(obj->handle, CURLINFO_RESPONSE_CODE, &response_code);
+	
+	eventlog_emit("token_refresh", "{s:i, s:i}", "status", code, "http_status", (int) response_code);
+	
+	if (code == UERR_SUCCESS) {
+		pthread_mutex_lock(&obj->lock);
+		
+		free(obj->credentials->access_token);
+		free(obj->credentials->refresh_token);
+		
+		obj->credentials->access_token = credentials.access_token;
+		obj->credentials->refresh_token = credentials.refresh_token;
+		obj->credentials->expires_in = credentials.expires_in;
+		obj->credentials->expires_at = credentials.expires_at;
+		
+		pthread_cond_broadcast(&obj->cond);
+		pthread_mutex_unlock(&obj->lock);
+		
+		metrics_count(COUNTER_TOKEN_REFRESHES);
+		
+		if (obj->callback != NULL) {
+			obj->callback(obj->credentials, obj->data);
+		}
+	} else {
+		free(credentials.access_token);
+		free(credentials.refresh_token);
+	}
+	
+	pthread_mutex_unlock(&obj->refresh_lock);
+	
+	return code;
+	
+}
+
+static void* token_refresher_loop(void* ptr) {
+	
+	struct TokenRefresher* const obj = (struct TokenRefresher*) ptr;
+	
+	pthread_mutex_lock(&obj->lock);
+	
+	while (obj->running) {
+		if (obj->credentials->expires_at == 0) {
+			pthread_cond_wait(&obj->cond, &obj->lock);
+			continue;
+		}
+		
+		const time_t refresh_at = token_refresh_time(obj->credentials);
+		
+		if (time(NULL) < refresh_at) {
+			const struct timespec deadline = {
+				.tv_sec = refresh_at
+			};
+			
+			pthread_cond_timedwait(&obj->cond, &obj->lock, &deadline);
+			continue;
+		}
+		
+		pthread_mutex_unlock(&obj->lock);
+		
+		const int code = token_refresh(obj, NULL);
+		
+		pthread_mutex_lock(&obj->lock);
+		
+		if (code != UERR_SUCCESS && obj->running) {
+			const struct timespec deadline = {
+				.tv_sec = time(NULL) + TOKEN_RETRY_INTERVAL
+			};
+			
+			pthread_cond_timedwait(&obj->cond, &obj->lock, &deadline);
+		}
+	}
+	
+	pthread_mutex_unlock(&obj->lock);
+	
+	return NULL;
+	
+}
+
+int token_refresher_init(
+	struct TokenRefresher* const obj,
+	struct Credentials* const credentials,
+	CURL* const handle,
+	const char* const endpoint,
+	const token_callback_t callback,
+	void* const data
+) {
+	
+	if (handle == NULL) {
+		return UERR_CURL_FAILURE;
+	}
+	
+	obj->multi = curl_multi_init();
+	
+	if (obj->multi == NULL) {
+		curl_easy_cleanup(handle);
+		return UERR_CURL_FAILURE;
+	}
+	
+	obj->credentials = credentials;
+	obj->endpoint = endpoint;
+	obj->handle = handle;
+	obj->callback = callback;
+	obj->data = data;
+	obj->running = 0;
+	
+	pthread_mutex_init(&obj->lock, NULL);
+	pthread_mutex_init(&obj->refresh_lock, NULL);
+	pthread_cond_init(&obj->cond, NULL);
+	
+	return UERR_SUCCESS;
+	
+}
+
+int token_refresher_start(struct TokenRefresher* const obj) {
+	
+	obj->running = 1;
+	
+	if (pthread_create(&obj->thread, NULL, token_refresher_loop, obj) != 0) {
+		obj->running = 0;
+		return UERR_PTHREAD_FAILURE;
+	}
+	
+	return UERR_SUCCESS;
+	
+}
+
+void token_refresher_free(struct TokenRefresher* const obj) {
+	
+	/* Never initialized, or already freed */
+	if (obj->multi == NULL) {
+		return;
+	}
+	
+	pthread_mutex_lock(&obj->lock);
+	
+	const int running = obj->running;
+	obj->running = 0;
+	
+	pthread_cond_broadcast(&obj->cond);
+	pthread_mutex_unlock(&obj->lock);
+	
+	if (running) {
+		pthread_join(obj->thread, NULL);
+	}
+	
+	pthread_cond_destroy(&obj->cond);
+	pthread_mutex_destroy(&obj->refresh_lock);
+	pthread_mutex_destroy(&obj->lock);
+	
+	curl_easy_cleanup(obj->handle);
+	obj->handle = NULL;
+	
+	curl_multi_cleanup(obj->multi);
+	obj->multi = NULL;
+	
+}
+
+int token_is_expired(struct TokenRefresher* const obj) {
+	
+	pthread_mutex_lock(&obj->lock);
+	
+	const time_t expires_at = obj->credentials->expires_at;
+	const int expired = expires_at != 0 && time(NULL) >= token_refresh_time(obj->credentials);
+	
+	pthread_mutex_unlock(&obj->lock);
+	
+	return expired;
+	
+}
+
+time_t token_get_expires_at(struct TokenRefresher* const obj) {
+	
+	pthread_mutex_lock(&obj->lock);
+	const time_t expires_at = obj->credentials->expires_at;
+	pthread_mutex_unlock(&obj->lock);
+	
+	return expires_at;
+	
+}
+
+char* token_get_access_token(struct TokenRefresher* const obj) {
+	/*
+	Returns a copy of the current access token; the caller owns it.
+	*/
+	
+	pthread_mutex_lock(&obj->lock);
+	
+	char* const access_token = malloc(strlen(obj->credentials->access_token) + 1);
+	
+	if (access_token != NULL) {
+		strcpy(access_token, obj->credentials->access_token);
+	}
+	
+	pthread_mutex_unlock(&obj->lock);
+	
+	return access_token;
+	
+}
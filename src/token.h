@@ -0,0 +1,42 @@
+#include <pthread.h>
+
+#include <curl/curl.h>
+#include <jansson.h>
+
+#include "types.h"
+
+typedef void (*token_callback_t)(const struct Credentials* const credentials, void* const data);
+
+struct TokenRefresher {
+	struct Credentials* credentials;
+	const char* endpoint;
+	CURL* handle;
+	CURLM* multi;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_mutex_t refresh_lock;
+	pthread_cond_t cond;
+	int running;
+	token_callback_t callback;
+	void* data;
+};
+
+int credentials_parse(const json_t* const tree, struct Credentials* const credentials);
+
+int token_refresher_init(
+	struct TokenRefresher* const obj,
+	struct Credentials* const credentials,
+	CURL* const handle,
+	const char* const endpoint,
+	const token_callback_t callback,
+	void* const data
+);
+int token_refresher_start(struct TokenRefresher* const obj);
+void token_refresher_free(struct TokenRefresher* const obj);
+
+int token_refresh(struct TokenRefresher* const obj, const char* const stale_token);
+int token_is_expired(struct TokenRefresher* const obj);
+time_t token_get_expires_at(struct TokenRefresher* const obj);
+char* token_get_access_token(struct TokenRefresher* const obj);
+
+#pragma once
@@ -0,0 +1,263 @@
+#ifdef SPARKLEC_ENABLE_TRACE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <time.h>
+#endif
+
+#include <curl/curl.h>
+#include <jansson.h>
+
+#include "trace.h"
+#include "errors.h"
+#include "utils.h"
+
+/*
+Events are written in the Chrome trace-event format, which both chrome://tracing and Perfetto load.
+Spans run on lanes: each thread gets its own, and transfers are placed on a lane per connection,
+keyed by the local port of the socket they ran on.
+*/
+#define TRACE_PROCESS_ID 1
+#define TRACE_CONNECTION_LANE 100000
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE* stream = NULL;
+static uint64_t started_at = 0;
+
+static uint64_t threads_count = 0;
+static __thread uint64_t thread_lane = 0;
+
+static unsigned char connections[(UINT16_MAX + 1) / 8] = {0};
+
+static uint64_t get_time(void) {
+	
+	#ifdef _WIN32
+		static LARGE_INTEGER frequency = {0};
+		LARGE_INTEGER counter = {0};
+		
+		if (frequency.QuadPart == 0) {
+			QueryPerformanceFrequency(&frequency);
+		}
+		
+		QueryPerformanceCounter(&counter);
+		
+		return (uint64_t) (counter.QuadPart / frequency.QuadPart) * 1000000 + (uint64_t) (counter.QuadPart % frequency.QuadPart) * 1000000 / (uint64_t) frequency.QuadPart;
+	#else
+		struct timespec ts = {0};
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		
+		return (uint64_t) ts.tv_sec * 1000000 + (uint64_t) ts.tv_nsec / 1000;
+	#endif
+	
+}
+
+static void write_event(json_t* const event) {
+	/*
+	Must be called with the lock held.
+	*/
+	
+	if (event == NULL) {
+		return;
+	}
+	
+	json_dumpf(event, stream, JSON_COMPACT);
+	fputs(",\n", stream);
+	
+	json_decref(event);
+	
+}
+
+static void write_lane_name(const uint64_t lane, const char* const name) {
+	
+	write_event(json_pack(
+		"{s:s, s:s, s:i, s:I, s:{s:s}}",
+		"name", "thread_name",
+		"ph", "M",
+		"pid", TRACE_PROCESS_ID,
+		"tid", (json_int_t) lane,
+		"args",
+			"name", name
+	));
+	
+}
+
+static uint64_t get_thread_lane(void) {
+	/*
+	Must be called with the lock held.
+	*/
+	
+	if (thread_lane == 0) {
+		thread_lane = ++threads_count;
+		
+		char name[32];
+		snprintf(name, sizeof(name), "thread %llu", (unsigned long long) thread_lane);
+		
+		write_lane_name(thread_lane, name);
+	}
+	
+	return thread_lane;
+	
+}
+
+static void write_span(
+	const char* const name,
+	const char* const category,
+	const uint64_t lane,
+	const uint64_t start,
+	const uint64_t end,
+	json_t* const args
+) {
+	/*
+	Must be called with the lock held. Takes ownership of args.
+	*/
+	
+	write_event(json_pack(
+		"{s:s, s:s, s:s, s:I, s:I, s:i, s:I, s:o}",
+		"name", name,
+		"cat", category,
+		"ph", "X",
+		"ts", (json_int_t) (start < started_at ? 0 : start - started_at),
+		"dur", (json_int_t) (end < start ? 0 : end - start),
+		"pid", TRACE_PROCESS_ID,
+		"tid", (json_int_t) lane,
+		"args", args == NULL ? json_object() : args
+	));
+	
+}
+
+int trace_open(const char* const filename) {
+	
+	stream = open_file(filename, "wb");
+	
+	if (stream == NULL) {
+		return UERR_FILE_WRITE_FAILURE;
+	}
+	
+	started_at = get_time();
+	
+	fputs("[\n", stream);
+	
+	return UERR_SUCCESS;
+	
+}
+
+void trace_close(void) {
+	
+	pthread_mutex_lock(&lock);
+	
+	if (stream != NULL) {
+		/* The metadata event doubles as the last element, so no trailing comma is left behind */
+		json_t* const event = json_pack(
+			"{s:s, s:s, s:i, s:{s:s}}",
+			"name", "process_name",
+			"ph", "M",
+			"pid", TRACE_PROCESS_ID,
+			"args",
+				"name", "sparklec"
+		);
+		
+		if (event != NULL) {
+			json_dumpf(event, stream, JSON_COMPACT);
+			json_decref(event);
+		}
+		
+		fputs("\n]\n", stream);
+		fclose(stream);
+		
+		stream = NULL;
+	}
+	
+	pthread_mutex_unlock(&lock);
+	
+}
+
+uint64_t trace_now(void) {
+	return stream == NULL ? 0 : get_time();
+}
+
+void trace_span(const char* const name, const char* const detail, const uint64_t start) {
+	
+	if (stream == NULL || start == 0) {
+		return;
+	}
+	
+	const uint64_t end = get_time();
+	
+	pthread_mutex_lock(&lock);
+	
+	if (stream != NULL) {
+		json_t* const args = detail == NULL ? NULL : json_pack("{s:s}", "detail", detail);
+		write_span(name, "stage", get_thread_lane(), start, end, args);
+	}
+	
+	pthread_mutex_unlock(&lock);
+	
+}
+
+void trace_transfer(CURL* const handle, const char* const name) {
+	
+	if (stream == NULL) {
+		return;
+	}
+	
+	const uint64_t end = get_time();
+	
+	curl_off_t total = 0;
+	curl_off_t starttransfer = 0;
+	curl_off_t size = 0;
+	long port = 0;
+	const char* url = NULL;
+	
+	curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME_T, &total);
+	curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME_T, &starttransfer);
+	curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD_T, &size);
+	curl_easy_getinfo(handle, CURLINFO_LOCAL_PORT, &port);
+	curl_easy_getinfo(handle, CURLINFO_EFFECTIVE_URL, &url);
+	
+	const uint64_t start = end - ((uint64_t) total > end ? end : (uint64_t) total);
+	
+	/* Query strings may carry access tokens */
+	const size_t url_size = url == NULL ? 0 : strcspn(url, "?");
+	
+	pthread_mutex_lock(&lock);
+	
+	if (stream != NULL) {
+		uint64_t lane = 0;
+		
+		if (port > 0 && port <= UINT16_MAX) {
+			lane = TRACE_CONNECTION_LANE + (uint64_t) port;
+			
+			if (!(connections[port / 8] & (1 << (port % 8)))) {
+				connections[port / 8] |= (unsigned char) (1 << (port % 8));
+				
+				char lane_name[32];
+				snprintf(lane_name, sizeof(lane_name), "connection :%li", port);
+				
+				write_lane_name(lane, lane_name);
+			}
+		} else {
+			lane = get_thread_lane();
+		}
+		
+		json_t* const args = json_pack(
+			"{s:s%, s:I, s:I}",
+			"url", url == NULL ? "" : url, url_size,
+			"bytes", (json_int_t) size,
+			"starttransfer", (json_int_t) starttransfer
+		);
+		
+		write_span(name, "transfer", lane, start, end, args);
+	}
+	
+	pthread_mutex_unlock(&lock);
+	
+}
+
+#endif
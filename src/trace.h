@@ -0,0 +1,25 @@
+#include <stdint.h>
+
+#include <curl/curl.h>
+
+/*
+Spans are only recorded in builds configured with SPARKLEC_ENABLE_TRACE; otherwise every
+TRACE_* macro expands to nothing and its arguments are never evaluated.
+*/
+#ifdef SPARKLEC_ENABLE_TRACE
+	int trace_open(const char* const filename);
+	void trace_close(void);
+	uint64_t trace_now(void);
+	void trace_span(const char* const name, const char* const detail, const uint64_t start);
+	void trace_transfer(CURL* const handle, const char* const name);
+	
+	#define TRACE_BEGIN(start) const uint64_t start = trace_now()
+	#define TRACE_END(start, name, detail) trace_span(name, detail, start)
+	#define TRACE_TRANSFER(handle, name) trace_transfer(handle, name)
+#else
+	#define TRACE_BEGIN(start)
+	#define TRACE_END(start, name, detail)
+	#define TRACE_TRANSFER(handle, name)
+#endif
+
+#pragma once
@@ -1,12 +1,133 @@
 #include <stdlib.h>
+#include <pthread.h>
 
 #include "types.h"
+#include "memory.h"
+
+#define STRING_POOL_SIZE 4
+#define STRING_POOL_MAX_CAPACITY (1024 * 1024 * 4)
+
+struct StringPool {
+	size_t offset;
+	struct String items[STRING_POOL_SIZE];
+};
+
+/*
+Buffers released by string_free() are kept here and handed out again by string_reserve(),
+so that the responses of consecutive requests reuse the same allocations.
+*/
+static _Thread_local struct StringPool pool = {0};
+static _Thread_local int pool_registered = 0;
+
+/* Frees the buffers a thread pooled when it exits; segments are often released on a remux worker */
+static pthread_key_t pool_key;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static int pool_key_created = 0;
+
+static void string_pool_destroy(void* ptr) {
+	
+	struct StringPool* const items = (struct StringPool*) ptr;
+	
+	for (size_t index = 0; index < items->offset; index++) {
+		memory_free(items->items[index].s);
+	}
+	
+	items->offset = 0;
+	
+}
+
+static void string_pool_key_create(void) {
+	pool_key_created = pthread_key_create(&pool_key, string_pool_destroy) == 0;
+}
+
+static int string_pool_register(void) {
+	/*
+	Buffers are only pooled on threads that will release them on exit.
+	*/
+	
+	if (!pool_registered) {
+		pthread_once(&pool_once, string_pool_key_create);
+		pool_registered = pool_key_created && pthread_setspecific(pool_key, &pool) == 0;
+	}
+	
+	return pool_registered;
+	
+}
+
+static int string_pool_get(struct String* obj, const size_t size) {
+	
+	if (pool.offset == 0) {
+		return 0;
+	}
+	
+	size_t best = 0;
+	
+	for (size_t index = 1; index < pool.offset; index++) {
+		const struct String* const item = &pool.items[index];
+		const struct String* const current = &pool.items[best];
+		
+		if (current->size >= size && item->size >= size) {
+			if (item->size < current->size) {
+				best = index;
+			}
+		} else if (item->size > current->size) {
+			best = index;
+		}
+	}
+	
+	*obj = pool.items[best];
+	pool.items[best] = pool.items[--pool.offset];
+	
+	return 1;
+	
+}
+
+int string_reserve(struct String* obj, const size_t size) {
+	/*
+	Ensures the buffer can hold at least "size" bytes, including the null terminator.
+	*/
+	
+	if (obj->size >= size) {
+		return 1;
+	}
+	
+	if (obj->s == NULL) {
+		string_pool_get(obj, size);
+		obj->slength = 0;
+		
+		if (obj->s != NULL) {
+			*obj->s = '\0';
+		}
+		
+		if (obj->size >= size) {
+			return 1;
+		}
+	}
+	
+	char* const s = memory_realloc(MEMORY_HTTP, obj->s, size);
+	
+	if (s == NULL) {
+		return 0;
+	}
+	
+	obj->s = s;
+	obj->size = size;
+	
+	return 1;
+	
+}
 
 void string_free(struct String* obj) {
 	
-	free(obj->s);
+	if (obj->s != NULL && obj->size <= STRING_POOL_MAX_CAPACITY && pool.offset < STRING_POOL_SIZE && string_pool_register()) {
+		pool.items[pool.offset++] = *obj;
+	} else {
+		memory_free(obj->s);
+	}
+	
 	obj->s = NULL;
 	obj->slength = 0;
+	obj->size = 0;
 	
 }
 
@@ -19,5 +140,87 @@ void credentials_free(struct Credentials* obj) {
 	obj->refresh_token = NULL;
 	
 	obj->expires_in = 0;
+	obj->expires_at = 0;
+	
+}
+
+static void page_free(struct Page* obj) {
+	
+	memory_free(obj->id);
+	obj->id = NULL;
+	
+	memory_free(obj->name);
+	obj->name = NULL;
+	
+	for (size_t index = 0; index < obj->medias.offset; index++) {
+		memory_free(obj->medias.items[index].url);
+	}
+	
+	memory_free(obj->medias.items);
+	obj->medias = (struct Medias) {0};
+	
+	for (size_t index = 0; index < obj->attachments.offset; index++) {
+		struct Attachment* const attachment = &obj->attachments.items[index];
+		
+		memory_free(attachment->id);
+		memory_free(attachment->url);
+		memory_free(attachment->extension);
+	}
+	
+	memory_free(obj->attachments.items);
+	obj->attachments = (struct Attachments) {0};
+	
+}
+
+static void module_free(struct Module* obj) {
+	
+	memory_free(obj->id);
+	obj->id = NULL;
+	
+	memory_free(obj->name);
+	obj->name = NULL;
+	
+	memory_free(obj->download_location);
+	obj->download_location = NULL;
+	
+	for (size_t index = 0; index < obj->pages.offset; index++) {
+		page_free(&obj->pages.items[index]);
+	}
+	
+	memory_free(obj->pages.items);
+	obj->pages = (struct Pages) {0};
+	
+}
+
+void resources_free(struct Resources* obj) {
+	/*
+	Releases the whole catalog, down to the medias and attachments of every page.
+	*/
+	
+	for (size_t index = 0; index < obj->offset; index++) {
+		struct Resource* const resource = &obj->items[index];
+		
+		memory_free(resource->name);
+		resource->name = NULL;
+		
+		memory_free(resource->subdomain);
+		resource->subdomain = NULL;
+		
+		memory_free(resource->download_location);
+		resource->download_location = NULL;
+		
+		for (size_t index = 0; index < resource->modules.offset; index++) {
+			module_free(&resource->modules.items[index]);
+		}
+		
+		memory_free(resource->modules.items);
+		resource->modules = (struct Modules) {0};
+	}
+	
+	memory_free(obj->items);
+	obj->items = NULL;
+	
+	obj->offset = 0;
+	obj->size = 0;
 	
 }
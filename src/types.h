@@ -1,10 +1,12 @@
 #include <stdlib.h>
+#include <time.h>
 
 struct Credentials {
 	char* username;
 	char* access_token;
 	char* refresh_token;
 	int expires_in;
+	time_t expires_at;
 };
 
 struct Media {
@@ -18,6 +20,7 @@ struct Medias {
 };
 
 struct Attachment {
+	char* id;
 	char* url;
 	char* extension;
 };
@@ -71,9 +74,12 @@ struct Resources {
 struct String {
 	char *s;
 	size_t slength;
+	size_t size;
 };
 
+int string_reserve(struct String* obj, const size_t size);
 void string_free(struct String* obj);
 void credentials_free(struct Credentials* obj);
+void resources_free(struct Resources* obj);
 
 #pragma once
\ No newline at end of file
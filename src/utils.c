@@ -5,15 +5,39 @@
 
 #include "symbols.h"
 #include "utils.h"
+#include "memory.h"
 
 #ifdef _WIN32
 	#include <windows.h>
 	#include <fileapi.h>
+	#include <io.h>
 #else
 	#include <unistd.h>
 	#include <sys/stat.h>
 	#include <errno.h>
 	#include <glob.h>
+	#include <signal.h>
+	#include <fcntl.h>
+	#include <spawn.h>
+	#include <pthread.h>
+	#include <sys/wait.h>
+	#include <sys/resource.h>
+	
+	#ifdef __linux__
+		#include <sys/syscall.h>
+		#include <sys/ioctl.h>
+		#include <linux/fs.h>
+	#endif
+	
+	#ifdef __APPLE__
+		#include <sys/clonefile.h>
+	#endif
+	
+	extern char** environ;
+#endif
+
+#ifndef _WIN32
+	static pthread_mutex_t spawn_lock = PTHREAD_MUTEX_INITIALIZER;
 #endif
 
 static const char INVALID_FILENAME_CHARS[] = {
@@ -21,6 +45,10 @@ static const char INVALID_FILENAME_CHARS[] = {
 };
 
 int walk_dir_init(struct WalkDir* obj, const char* const pattern) {
+	/*
+	Starts listing the entries matching "pattern". On POSIX systems entries are full paths and
+	directories carry a trailing separator; on Windows only the last component is returned.
+	*/
 	
 	#ifdef _WIN32
 		#ifdef UNICODE
@@ -41,7 +69,7 @@ int walk_dir_init(struct WalkDir* obj, const char* const pattern) {
 			}
 		#endif
 	#else
-		if (glob(pattern, 0, NULL, &obj->data) != 0) {
+		if (glob(pattern, GLOB_MARK | GLOB_NOSORT, NULL, &obj->data) != 0) {
 			return 0;
 		}
 	#endif
@@ -53,16 +81,16 @@ int walk_dir_init(struct WalkDir* obj, const char* const pattern) {
 const char* walk_dir(struct WalkDir* obj) {
 	
 	if (obj->last_path != NULL) {
-		free(obj->last_path);
+		memory_free(obj->last_path);
 		obj->last_path = NULL;
 	}
 	
 	#ifdef _WIN32
 		#ifdef UNICODE
 			if (obj->index++ == 0) {
-				const int size = WideCharToMultiByte(CP_UTF8, 0, obj->data.cFileName, wcslen(obj->data.cFileName), NULL, 0, NULL, NULL);
+				const int size = WideCharToMultiByte(CP_UTF8, 0, obj->data.cFileName, -1, NULL, 0, NULL, NULL);
 				
-				obj->last_path = malloc(size);
+				obj->last_path = memory_alloc(MEMORY_PATHS, size);
 				
 				if (obj->last_path == NULL) {
 					return NULL;
@@ -75,9 +103,9 @@ const char* walk_dir(struct WalkDir* obj) {
 					return NULL;
 				}
 				
-				const int size = WideCharToMultiByte(CP_UTF8, 0, obj->data.cFileName, wcslen(obj->data.cFileName), NULL, 0, NULL, NULL);
+				const int size = WideCharToMultiByte(CP_UTF8, 0, obj->data.cFileName, -1, NULL, 0, NULL, NULL);
 				
-				obj->last_path = malloc(size);
+				obj->last_path = memory_alloc(MEMORY_PATHS, size);
 				
 				if (obj->last_path == NULL) {
 					return NULL;
@@ -87,7 +115,7 @@ const char* walk_dir(struct WalkDir* obj) {
 			}
 		#else
 			if (obj->index++ == 0) {
-				obj->last_path = malloc(strlen(obj->data.cFileName) + 1);
+				obj->last_path = memory_alloc(MEMORY_PATHS, strlen(obj->data.cFileName) + 1);
 				
 				if (obj->last_path == NULL) {
 					return NULL;
@@ -95,12 +123,12 @@ const char* walk_dir(struct WalkDir* obj) {
 				
 				strcpy(obj->last_path, obj->data.cFileName);
 			} else {
-				if (FindNextFileW(obj->handle, &obj->data) == 0) {
+				if (FindNextFileA(obj->handle, &obj->data) == 0) {
 					FindClose(obj->handle);
 					return NULL;
 				}
 				
-				obj->last_path = malloc(strlen(obj->data.cFileName) + 1);
+				obj->last_path = memory_alloc(MEMORY_PATHS, strlen(obj->data.cFileName) + 1);
 				
 				if (obj->last_path == NULL) {
 					return NULL;
@@ -117,7 +145,7 @@ const char* walk_dir(struct WalkDir* obj) {
 		
 		const char* const filename = obj->data.gl_pathv[obj->index++];
 		
-		obj->last_path = malloc(strlen(filename) + 1);
+		obj->last_path = memory_alloc(MEMORY_PATHS, strlen(filename) + 1);
 		
 		if (obj->last_path == NULL) {
 			return NULL;
@@ -214,6 +242,187 @@ int execute_shell_command(const char* const command) {
 	
 }
 
+int process_spawn(struct Process* const obj, const char* const argv[]) {
+	/*
+	Starts a program from the PATH with a pipe connected to its standard input. On POSIX
+	systems the arguments are handed over as they are, without going through a shell.
+	*/
+	
+	#ifdef _WIN32
+		size_t size = 1;
+		
+		for (size_t index = 0; argv[index] != NULL; index++) {
+			size += strlen(QUOTATION_MARK) * 2 + strlen(argv[index]) + strlen(SPACE);
+		}
+		
+		char command[size];
+		*command = '\0';
+		
+		/* The program name is left unquoted, as cmd.exe strips the outermost pair of quotes */
+		for (size_t index = 0; argv[index] != NULL; index++) {
+			if (index > 0) {
+				strcat(command, QUOTATION_MARK);
+			}
+			
+			strcat(command, argv[index]);
+			
+			if (index > 0) {
+				strcat(command, QUOTATION_MARK);
+			}
+			
+			strcat(command, SPACE);
+		}
+		
+		#ifdef UNICODE
+			const int wcsize = MultiByteToWideChar(CP_UTF8, 0, command, -1, NULL, 0);
+			wchar_t wcommand[wcsize];
+			MultiByteToWideChar(CP_UTF8, 0, command, -1, wcommand, wcsize);
+			
+			obj->input = _wpopen(wcommand, L"wb");
+		#else
+			obj->input = _popen(command, "wb");
+		#endif
+		
+		return obj->input != NULL;
+	#else
+		int fds[2];
+		
+		/*
+		Both ends must be marked close-on-exec before any other thread spawns a process, otherwise
+		that process inherits the write end and this one never sees the end of its input.
+		*/
+		pthread_mutex_lock(&spawn_lock);
+		
+		if (pipe(fds) != 0) {
+			pthread_mutex_unlock(&spawn_lock);
+			return 0;
+		}
+		
+		fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+		fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+		
+		posix_spawn_file_actions_t actions;
+		posix_spawn_file_actions_init(&actions);
+		posix_spawn_file_actions_adddup2(&actions, fds[0], STDIN_FILENO);
+		
+		/*
+		The program starts with nothing blocked and SIGPIPE at its default action, rather than
+		with the signals blocked or ignored here (SIGUSR1 for --memory-stats, SIGPIPE below).
+		*/
+		sigset_t mask;
+		sigemptyset(&mask);
+		
+		sigset_t defaults;
+		sigemptyset(&defaults);
+		sigaddset(&defaults, SIGPIPE);
+		
+		posix_spawnattr_t attributes;
+		posix_spawnattr_init(&attributes);
+		posix_spawnattr_setsigmask(&attributes, &mask);
+		posix_spawnattr_setsigdefault(&attributes, &defaults);
+		posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+		
+		const int code = posix_spawnp(&obj->pid, argv[0], &actions, &attributes, (char* const*) argv, environ);
+		
+		posix_spawnattr_destroy(&attributes);
+		posix_spawn_file_actions_destroy(&actions);
+		pthread_mutex_unlock(&spawn_lock);
+		
+		close(fds[0]);
+		
+		if (code != 0) {
+			close(fds[1]);
+			return 0;
+		}
+		
+		/* A program that exits early must not take us down with it */
+		signal(SIGPIPE, SIG_IGN);
+		
+		obj->input = fdopen(fds[1], "w");
+		
+		if (obj->input == NULL) {
+			close(fds[1]);
+			waitpid(obj->pid, NULL, 0);
+			
+			return 0;
+		}
+		
+		return 1;
+	#endif
+	
+}
+
+int process_wait(struct Process* const obj) {
+	/*
+	Closes the standard input of the program and waits for it to exit.
+	*/
+	
+	#ifdef _WIN32
+		const int exit_code = _pclose(obj->input);
+		obj->input = NULL;
+		
+		return exit_code;
+	#else
+		fclose(obj->input);
+		obj->input = NULL;
+		
+		int status = 0;
+		
+		while (waitpid(obj->pid, &status, 0) == -1) {
+			if (errno != EINTR) {
+				return -1;
+			}
+		}
+		
+		if (WIFSIGNALED(status)) {
+			return 128 + WTERMSIG(status);
+		}
+		
+		return WEXITSTATUS(status);
+	#endif
+	
+}
+
+size_t get_cpu_count(void) {
+	
+	#ifdef _WIN32
+		SYSTEM_INFO info = {0};
+		GetSystemInfo(&info);
+		
+		const long count = (long) info.dwNumberOfProcessors;
+	#else
+		const long count = sysconf(_SC_NPROCESSORS_ONLN);
+	#endif
+	
+	return count > 0 ? (size_t) count : 1;
+	
+}
+
+void lower_thread_priority(void) {
+	/*
+	Moves the calling thread to a lower CPU and I/O priority. On Linux, processes spawned
+	from this thread inherit both.
+	*/
+	
+	#if defined(_WIN32)
+		SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+	#elif defined(__APPLE__)
+		setpriority(PRIO_DARWIN_THREAD, 0, PRIO_DARWIN_BG);
+	#elif defined(__linux__)
+		const pid_t tid = (pid_t) syscall(SYS_gettid);
+		
+		setpriority(PRIO_PROCESS, (id_t) tid, 10);
+		
+		#ifdef SYS_ioprio_set
+			/* IOPRIO_WHO_PROCESS, best-effort class at its lowest level */
+			syscall(SYS_ioprio_set, 1, (int) tid, (2 << 13) | 7);
+		#endif
+	#else
+		setpriority(PRIO_PROCESS, 0, 10);
+	#endif
+	
+}
+
 char* get_configuration_directory(void) {
 	
 	#ifdef _WIN32
@@ -229,7 +438,7 @@ char* get_configuration_directory(void) {
 			const char* const config = ".config";
 			const char* const home = getenv("HOME");
 			
-			char* configuration_directory = malloc(strlen(home) + strlen(SLASH) + strlen(config) + strlen(SLASH) + 1);
+			char* configuration_directory = memory_alloc(MEMORY_PATHS, strlen(home) + strlen(SLASH) + strlen(config) + strlen(SLASH) + 1);
 			
 			if (configuration_directory == NULL) {
 				return NULL;
@@ -245,7 +454,7 @@ char* get_configuration_directory(void) {
 	#endif
 	
 	const int trailing_separator = strlen(directory) > 0 && *(strchr(directory, '\0') - 1) == *PATH_SEPARATOR;
-	char* configuration_directory = malloc(strlen(directory) + (trailing_separator ? 0 : strlen(PATH_SEPARATOR)) + 1);
+	char* configuration_directory = memory_alloc(MEMORY_PATHS, strlen(directory) + (trailing_separator ? 0 : strlen(PATH_SEPARATOR)) + 1);
 	
 	if (configuration_directory == NULL) {
 		return NULL;
@@ -315,10 +524,12 @@ int isnumeric(const char* const s) {
 	A string is numeric if all characters in the string are numeric and there is at least one character in the string.
 	*/
 	
-	for (size_t index = 0; index < strlen(s); index++) {
-		const char ch = s[index];
-		
-		if (!isdigit(ch)) {
+	if (*s == '\0') {
+		return 0;
+	}
+	
+	for (const char* ch = s; *ch != '\0'; ch++) {
+		if (!isdigit((unsigned char) *ch)) {
 			return 0;
 		}
 	}
@@ -413,6 +624,270 @@ int remove_file(const char* const filename) {
 	
 }
 
+int move_file(const char* const source, const char* const destination) {
+	/*
+	Renames the file, replacing the destination if it already exists.
+	*/
+	
+	#ifdef _WIN32
+		#ifdef UNICODE
+			int wcsize = 0;
+			
+			wcsize = MultiByteToWideChar(CP_UTF8, 0, source, -1, NULL, 0);
+			wchar_t wsource[wcsize];
+			MultiByteToWideChar(CP_UTF8, 0, source, -1, wsource, wcsize);
+			
+			wcsize = MultiByteToWideChar(CP_UTF8, 0, destination, -1, NULL, 0);
+			wchar_t wdestination[wcsize];
+			MultiByteToWideChar(CP_UTF8, 0, destination, -1, wdestination, wcsize);
+			
+			return MoveFileExW(wsource, wdestination, MOVEFILE_REPLACE_EXISTING) != 0;
+		#else
+			return MoveFileExA(source, destination, MOVEFILE_REPLACE_EXISTING) != 0;
+		#endif
+	#else
+		return rename(source, destination) == 0;
+	#endif
+	
+}
+
+FILE* open_file(const char* const filename, const char* const mode) {
+	/*
+	Same as fopen(), with the filename taken as UTF-8 on Windows.
+	*/
+	
+	#if defined(_WIN32) && defined(UNICODE)
+		int wcsize = 0;
+		
+		wcsize = MultiByteToWideChar(CP_UTF8, 0, filename, -1, NULL, 0);
+		wchar_t wfilename[wcsize];
+		MultiByteToWideChar(CP_UTF8, 0, filename, -1, wfilename, wcsize);
+		
+		wcsize = MultiByteToWideChar(CP_UTF8, 0, mode, -1, NULL, 0);
+		wchar_t wmode[wcsize];
+		MultiByteToWideChar(CP_UTF8, 0, mode, -1, wmode, wcsize);
+		
+		return _wfopen(wfilename, wmode);
+	#else
+		return fopen(filename, mode);
+	#endif
+	
+}
+
+int preallocate_file(FILE* const stream, const uint64_t size) {
+	/*
+	Reserves disk space for the whole file up front, so that it is not laid out in fragments
+	as it grows. This is only a hint; filesystems that cannot do it are left alone.
+	*/
+	
+	#if defined(_WIN32)
+		FILE_ALLOCATION_INFO info = {0};
+		info.AllocationSize.QuadPart = (LONGLONG) size;
+		
+		const HANDLE handle = (HANDLE) _get_osfhandle(_fileno(stream));
+		
+		return SetFileInformationByHandle(handle, FileAllocationInfo, &info, sizeof(info)) != 0;
+	#elif defined(__APPLE__)
+		fstore_t store = {
+			.fst_flags = F_ALLOCATECONTIG,
+			.fst_posmode = F_PEOFPOSMODE,
+			.fst_offset = 0,
+			.fst_length = (off_t) size
+		};
+		
+		if (fcntl(fileno(stream), F_PREALLOCATE, &store) == -1) {
+			store.fst_flags = F_ALLOCATEALL;
+			
+			if (fcntl(fileno(stream), F_PREALLOCATE, &store) == -1) {
+				return 0;
+			}
+		}
+		
+		return 1;
+	#else
+		return posix_fallocate(fileno(stream), 0, (off_t) size) == 0;
+	#endif
+	
+}
+
+int copy_file(const char* const source, const char* const destination) {
+	/*
+	Copies the file in large sequential blocks.
+	*/
+	
+	FILE* const input = open_file(source, "rb");
+	
+	if (input == NULL) {
+		return 0;
+	}
+	
+	FILE* const output = open_file(destination, "wb");
+	
+	if (output == NULL) {
+		fclose(input);
+		return 0;
+	}
+	
+	const size_t size = 1024 * 1024 * 4;
+	char* const buffer = malloc(size);
+	
+	int ok = buffer != NULL;
+	
+	while (ok) {
+		const size_t count = fread(buffer, 1, size, input);
+		
+		if (count == 0) {
+			ok = !ferror(input);
+			break;
+		}
+		
+		ok = fwrite(buffer, 1, count, output) == count;
+	}
+	
+	free(buffer);
+	fclose(input);
+	
+	if (fclose(output) != 0) {
+		ok = 0;
+	}
+	
+	if (!ok) {
+		remove_file(destination);
+	}
+	
+	return ok;
+	
+}
+
+static int clone_file(const char* const source, const char* const destination) {
+	/*
+	Creates "destination" as a copy-on-write clone of "source", on filesystems that support it.
+	*/
+	
+	#if defined(__linux__) && defined(FICLONE)
+		const int input = open(source, O_RDONLY | O_CLOEXEC);
+		
+		if (input == -1) {
+			return 0;
+		}
+		
+		const int output = open(destination, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+		
+		if (output == -1) {
+			close(input);
+			return 0;
+		}
+		
+		const int ok = ioctl(output, FICLONE, input) == 0;
+		
+		close(input);
+		
+		if (close(output) != 0 || !ok) {
+			unlink(destination);
+			return 0;
+		}
+		
+		return 1;
+	#elif defined(__APPLE__)
+		return clonefile(source, destination, 0) == 0;
+	#else
+		return 0;
+	#endif
+	
+}
+
+static int link_file(const char* const source, const char* const destination) {
+	
+	#ifdef _WIN32
+		#ifdef UNICODE
+			int wcsize = 0;
+			
+			wcsize = MultiByteToWideChar(CP_UTF8, 0, source, -1, NULL, 0);
+			wchar_t wsource[wcsize];
+			MultiByteToWideChar(CP_UTF8, 0, source, -1, wsource, wcsize);
+			
+			wcsize = MultiByteToWideChar(CP_UTF8, 0, destination, -1, NULL, 0);
+			wchar_t wdestination[wcsize];
+			MultiByteToWideChar(CP_UTF8, 0, destination, -1, wdestination, wcsize);
+			
+			return CreateHardLinkW(wdestination, wsource, NULL) != 0;
+		#else
+			return CreateHardLinkA(destination, source, NULL) != 0;
+		#endif
+	#else
+		return link(source, destination) == 0;
+	#endif
+	
+}
+
+int duplicate_file(const char* const source, const char* const destination) {
+	/*
+	Makes "destination" hold the same contents as "source" without copying them, if possible:
+	as a copy-on-write clone where the filesystem supports it, or else as a hard link. A plain
+	copy is the last resort. "destination" is replaced atomically.
+	*/
+	
+	char temporary[strlen(destination) + strlen(DOT) + strlen(PART_FILE_EXTENSION) + 1];
+	strcpy(temporary, destination);
+	strcat(temporary, DOT);
+	strcat(temporary, PART_FILE_EXTENSION);
+	
+	remove_file(temporary);
+	
+	if (!clone_file(source, temporary) && !link_file(source, temporary) && !copy_file(source, temporary)) {
+		return 0;
+	}
+	
+	if (!move_file(temporary, destination)) {
+		remove_file(temporary);
+		return 0;
+	}
+	
+	return 1;
+	
+}
+
+int publish_file(const char* const source, const char* const destination) {
+	/*
+	Moves a finished file to its final name. On the same filesystem this is a single rename.
+	Otherwise the file is first copied next to the destination and then renamed over it, so
+	that the destination never holds a partial file.
+	*/
+	
+	if (move_file(source, destination)) {
+		return 1;
+	}
+	
+	#ifdef _WIN32
+		if (GetLastError() != ERROR_NOT_SAME_DEVICE) {
+			return 0;
+		}
+	#else
+		if (errno != EXDEV) {
+			return 0;
+		}
+	#endif
+	
+	char temporary[strlen(destination) + strlen(DOT) + strlen(PART_FILE_EXTENSION) + 1];
+	strcpy(temporary, destination);
+	strcat(temporary, DOT);
+	strcat(temporary, PART_FILE_EXTENSION);
+	
+	if (!copy_file(source, temporary)) {
+		return 0;
+	}
+	
+	if (!move_file(temporary, destination)) {
+		remove_file(temporary);
+		return 0;
+	}
+	
+	remove_file(source);
+	
+	return 1;
+	
+}
+
 int directory_exists(const char* const directory) {
 	
 	#ifdef _WIN32
@@ -492,16 +967,25 @@ static int raw_create_dir(const char* const directory) {
 
 int create_directory(const char* const directory) {
 	
+	/* Most of the time the parent already exists, and a single call is enough */
+	if (raw_create_dir(directory)) {
+		return 1;
+	}
+	
 	int omit_next = 0;
 	
 	#ifdef _WIN32
 		omit_next = is_absolute(directory);
 	#endif
 	
-	const char* start = directory;
+	const size_t size = strlen(directory);
 	
-	for (size_t index = 1; index < strlen(directory) + 1; index++) {
-		const char* const ch = &directory[index];
+	/* Each parent is created by cutting a copy of the path short at its separator */
+	char path[size + 1];
+	strcpy(path, directory);
+	
+	for (size_t index = 1; index < size + 1; index++) {
+		char* const ch = &path[index];
 		
 		if (!(*ch == *PATH_SEPARATOR || (*ch == '\0' && index > 1 && *(ch - 1) != *PATH_SEPARATOR))) {
 			continue;
@@ -509,19 +993,282 @@ int create_directory(const char* const directory) {
 		
 		if (omit_next) {
 			omit_next = 0;
-		} else {
-			const size_t size = ch - start;
+			continue;
+		}
+		
+		const char separator = *ch;
+		*ch = '\0';
+		
+		const int created = raw_create_dir(path);
+		
+		*ch = separator;
+		
+		if (!created) {
+			return 0;
+		}
+	}
+	
+	return 1;
+	
+}
+
+char* directory_join(const struct Directory* const obj, const char* const name) {
+	
+	char* const path = memory_alloc(MEMORY_PATHS, strlen(obj->path) + strlen(PATH_SEPARATOR) + strlen(name) + 1);
+	
+	if (path == NULL) {
+		return NULL;
+	}
+	
+	strcpy(path, obj->path);
+	strcat(path, PATH_SEPARATOR);
+	strcat(path, name);
+	
+	return path;
+	
+}
+
+int directory_open(struct Directory* const obj, const char* const path) {
+	/*
+	Opens an existing directory. On POSIX systems the directory is held as a file descriptor,
+	so files below it are resolved relative to it instead of walking the full path again.
+	*/
+	
+	obj->path = memory_strdup(MEMORY_PATHS, path);
+	
+	if (obj->path == NULL) {
+		return 0;
+	}
+	
+	#ifndef _WIN32
+		obj->fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		
+		if (obj->fd == -1) {
+			memory_free(obj->path);
+			obj->path = NULL;
+			
+			return 0;
+		}
+	#endif
+	
+	return 1;
+	
+}
+
+int directory_open_child(
+	struct Directory* const obj,
+	const struct Directory* const parent,
+	const char* const name,
+	int* const created
+) {
+	/*
+	Opens the subdirectory "name" of "parent", creating it first if it does not exist.
+	"created" is set when the directory had to be created.
+	*/
+	
+	obj->path = directory_join(parent, name);
+	
+	if (obj->path == NULL) {
+		return 0;
+	}
+	
+	#ifdef _WIN32
+		*created = !directory_exists(obj->path);
+		
+		if (*created && !raw_create_dir(obj->path)) {
+			memory_free(obj->path);
+			obj->path = NULL;
+			
+			return 0;
+		}
+	#else
+		*created = mkdirat(parent->fd, name, 0777) == 0;
+		
+		if (!*created && errno != EEXIST) {
+			memory_free(obj->path);
+			obj->path = NULL;
+			
+			return 0;
+		}
+		
+		obj->fd = openat(parent->fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		
+		if (obj->fd == -1) {
+			memory_free(obj->path);
+			obj->path = NULL;
+			
+			return 0;
+		}
+	#endif
+	
+	return 1;
+	
+}
+
+int directory_has_file(const struct Directory* const obj, const char* const name) {
+	/*
+	Same as file_exists(), for a file inside the directory.
+	*/
+	
+	#ifdef _WIN32
+		char path[strlen(obj->path) + strlen(PATH_SEPARATOR) + strlen(name) + 1];
+		strcpy(path, obj->path);
+		strcat(path, PATH_SEPARATOR);
+		strcat(path, name);
+		
+		return file_exists(path);
+	#else
+		struct stat st = {0};
+		return (fstatat(obj->fd, name, &st, 0) == 0 && S_ISREG(st.st_mode));
+	#endif
+	
+}
+
+int get_file_size(const char* const filename, uint64_t* const size) {
+	
+	#ifdef _WIN32
+		#ifdef UNICODE
+			const int wcsize = MultiByteToWideChar(CP_UTF8, 0, filename, -1, NULL, 0);
+			wchar_t wfilename[wcsize];
+			MultiByteToWideChar(CP_UTF8, 0, filename, -1, wfilename, wcsize);
+			
+			WIN32_FILE_ATTRIBUTE_DATA data = {0};
 			
-			char directory[size + 1];
-			memcpy(directory, start, size);
-			directory[size] = '\0';
+			if (GetFileAttributesExW(wfilename, GetFileExInfoStandard, &data) == 0) {
+				return 0;
+			}
+		#else
+			WIN32_FILE_ATTRIBUTE_DATA data = {0};
 			
-			if (!raw_create_dir(directory)) {
+			if (GetFileAttributesExA(filename, GetFileExInfoStandard, &data) == 0) {
 				return 0;
 			}
+		#endif
+		
+		*size = ((uint64_t) data.nFileSizeHigh << 32) | data.nFileSizeLow;
+	#else
+		struct stat st = {0};
+		
+		if (stat(filename, &st) != 0) {
+			return 0;
 		}
-	}
+		
+		*size = (uint64_t) st.st_size;
+	#endif
 	
 	return 1;
 	
 }
+
+int directory_get_file_size(const struct Directory* const obj, const char* const name, uint64_t* const size) {
+	
+	#ifdef _WIN32
+		char path[strlen(obj->path) + strlen(PATH_SEPARATOR) + strlen(name) + 1];
+		strcpy(path, obj->path);
+		strcat(path, PATH_SEPARATOR);
+		strcat(path, name);
+		
+		return get_file_size(path, size);
+	#else
+		struct stat st = {0};
+		
+		if (fstatat(obj->fd, name, &st, 0) != 0) {
+			return 0;
+		}
+		
+		*size = (uint64_t) st.st_size;
+	#endif
+	
+	return 1;
+	
+}
+
+FILE* directory_create_file(const struct Directory* const obj, const char* const name) {
+	/*
+	Creates (or truncates) a file inside the directory and opens it for writing in binary mode.
+	*/
+	
+	#ifdef _WIN32
+		char path[strlen(obj->path) + strlen(PATH_SEPARATOR) + strlen(name) + 1];
+		strcpy(path, obj->path);
+		strcat(path, PATH_SEPARATOR);
+		strcat(path, name);
+		
+		return open_file(path, "wb");
+	#else
+		const int fd = openat(obj->fd, name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+		
+		if (fd == -1) {
+			return NULL;
+		}
+		
+		FILE* const stream = fdopen(fd, "wb");
+		
+		if (stream == NULL) {
+			close(fd);
+		}
+		
+		return stream;
+	#endif
+	
+}
+
+int directory_remove_file(const struct Directory* const obj, const char* const name) {
+	
+	#ifdef _WIN32
+		char path[strlen(obj->path) + strlen(PATH_SEPARATOR) + strlen(name) + 1];
+		strcpy(path, obj->path);
+		strcat(path, PATH_SEPARATOR);
+		strcat(path, name);
+		
+		return remove_file(path);
+	#else
+		return unlinkat(obj->fd, name, 0) == 0;
+	#endif
+	
+}
+
+int directory_publish_file(
+	const struct Directory* const source_directory,
+	const char* const source,
+	const struct Directory* const destination_directory,
+	const char* const destination
+) {
+	/*
+	Same as publish_file(), with both names resolved relative to their directories.
+	*/
+	
+	#ifndef _WIN32
+		if (renameat(source_directory->fd, source, destination_directory->fd, destination) == 0) {
+			return 1;
+		}
+		
+		if (errno != EXDEV) {
+			return 0;
+		}
+	#endif
+	
+	char* const source_path = directory_join(source_directory, source);
+	char* const destination_path = directory_join(destination_directory, destination);
+	
+	const int ok = source_path != NULL && destination_path != NULL && publish_file(source_path, destination_path);
+	
+	memory_free(source_path);
+	memory_free(destination_path);
+	
+	return ok;
+	
+}
+
+void directory_close(struct Directory* const obj) {
+	
+	#ifndef _WIN32
+		if (obj->path != NULL) {
+			close(obj->fd);
+		}
+	#endif
+	
+	memory_free(obj->path);
+	obj->path = NULL;
+	
+}
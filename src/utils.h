@@ -1,4 +1,9 @@
 #include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+/* Suffix of files that are still being written */
+static const char PART_FILE_EXTENSION[] = "part";
 
 #ifdef _WIN32
 	#include <windows.h>
@@ -29,10 +34,62 @@
 	};
 #endif
 
+#ifdef _WIN32
+	struct Process {
+		FILE* input;
+	};
+#else
+	#include <sys/types.h>
+	
+	struct Process {
+		FILE* input;
+		pid_t pid;
+	};
+#endif
+
+#ifdef _WIN32
+	struct Directory {
+		char* path;
+	};
+#else
+	struct Directory {
+		char* path;
+		int fd;
+	};
+#endif
+
+int walk_dir_init(struct WalkDir* obj, const char* const pattern);
+const char* walk_dir(struct WalkDir* obj);
 int directory_exists(const char* const directory);
 int file_exists(const char* const filename);
 int create_directory(const char* const directory);
 int remove_file(const char* const filename);
+int move_file(const char* const source, const char* const destination);
+FILE* open_file(const char* const filename, const char* const mode);
+int preallocate_file(FILE* const stream, const uint64_t size);
+int copy_file(const char* const source, const char* const destination);
+int publish_file(const char* const source, const char* const destination);
+int duplicate_file(const char* const source, const char* const destination);
+int get_file_size(const char* const filename, uint64_t* const size);
+char* directory_join(const struct Directory* const obj, const char* const name);
+int directory_open(struct Directory* const obj, const char* const path);
+int directory_open_child(
+	struct Directory* const obj,
+	const struct Directory* const parent,
+	const char* const name,
+	int* const created
+);
+int directory_has_file(const struct Directory* const obj, const char* const name);
+int directory_get_file_size(const struct Directory* const obj, const char* const name, uint64_t* const size);
+FILE* directory_create_file(const struct Directory* const obj, const char* const name);
+int directory_remove_file(const struct Directory* const obj, const char* const name);
+int directory_publish_file(
+	const struct Directory* const source_directory,
+	const char* const source,
+	const struct Directory* const destination_directory,
+	const char* const destination
+);
+void directory_close(struct Directory* const obj);
 char to_hex(const char ch);
 char from_hex(const char ch);
 size_t intlen(const int value);
@@ -40,5 +97,9 @@ int isnumeric(const char* const s);
 void normalize_filename(char* filename);
 int expand_filename(const char* filename, char** fullpath);
 int execute_shell_command(const char* const command);
+int process_spawn(struct Process* const obj, const char* const argv[]);
+int process_wait(struct Process* const obj);
+size_t get_cpu_count(void);
+void lower_thread_priority(void);
 const char* get_file_extension(const char* const filename);
 char* get_configuration_directory(void);
\ No newline at end of file
@@ -0,0 +1,13 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+/* Reports the check that failed and where, then ends the test */
+#define TEST_ASSERT(expression) \
+	do { \
+		if (!(expression)) { \
+			fprintf(stderr, "- %s:%d: a verificação '%s' falhou\r\n", __FILE__, __LINE__, #expression); \
+			exit(EXIT_FAILURE); \
+		} \
+	} while (0)
+
+#pragma once
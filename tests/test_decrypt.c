@@ -0,0 +1,73 @@
+/*
+AES-128-CBC known-answer tests for decrypt_segment(), using the vectors of NIST SP 800-38A,
+F.2.2, followed by a block of PKCS#7 padding.
+*/
+
+#include <string.h>
+
+#include "test.h"
+#include "decrypt.h"
+#include "errors.h"
+
+static const unsigned char KEY[AES_BLOCK_SIZE] = {
+	0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c
+};
+
+static const unsigned char IV[AES_BLOCK_SIZE] = {
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+};
+
+static const unsigned char PLAINTEXT[AES_BLOCK_SIZE * 4] = {
+	0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+	0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+	0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+	0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10
+};
+
+static const unsigned char CIPHERTEXT[AES_BLOCK_SIZE * 5] = {
+	0x76, 0x49, 0xab, 0xac, 0x81, 0x19, 0xb2, 0x46, 0xce, 0xe9, 0x8e, 0x9b, 0x12, 0xe9, 0x19, 0x7d,
+	0x50, 0x86, 0xcb, 0x9b, 0x50, 0x72, 0x19, 0xee, 0x95, 0xdb, 0x11, 0x3a, 0x91, 0x76, 0x78, 0xb2,
+	0x73, 0xbe, 0xd6, 0xb8, 0xe3, 0xc1, 0x74, 0x3b, 0x71, 0x16, 0xe6, 0x9e, 0x22, 0x22, 0x95, 0x16,
+	0x3f, 0xf1, 0xca, 0xa1, 0x68, 0x1f, 0xac, 0x09, 0x12, 0x0e, 0xca, 0x30, 0x75, 0x86, 0xe1, 0xa7,
+	0x8c, 0xb8, 0x28, 0x07, 0x23, 0x0e, 0x13, 0x21, 0xd3, 0xfa, 0xe0, 0x0d, 0x18, 0xcc, 0x20, 0x12
+};
+
+int main(void) {
+	
+	unsigned char data[sizeof(CIPHERTEXT)];
+	size_t size = sizeof(data);
+	
+	memcpy(data, CIPHERTEXT, sizeof(data));
+	
+	TEST_ASSERT(decrypt_segment(KEY, IV, data, &size) == UERR_SUCCESS);
+	TEST_ASSERT(size == sizeof(PLAINTEXT));
+	TEST_ASSERT(memcmp(data, PLAINTEXT, size) == 0);
+	
+	/* Without the padding block, the last plaintext byte (0x10) does not make valid padding */
+	memcpy(data, CIPHERTEXT, sizeof(data));
+	size = sizeof(PLAINTEXT);
+	
+	TEST_ASSERT(decrypt_segment(KEY, IV, data, &size) == UERR_AES_INVALID_PADDING);
+	
+	size = sizeof(PLAINTEXT) - 1;
+	TEST_ASSERT(decrypt_segment(KEY, IV, data, &size) == UERR_AES_INVALID_LENGTH);
+	
+	size = 0;
+	TEST_ASSERT(decrypt_segment(KEY, IV, data, &size) == UERR_AES_INVALID_LENGTH);
+	
+	unsigned char iv[AES_BLOCK_SIZE];
+	
+	TEST_ASSERT(decrypt_iv_parse("0x000102030405060708090A0B0C0D0E0F", iv));
+	TEST_ASSERT(memcmp(iv, IV, sizeof(iv)) == 0);
+	
+	/* Shorter values are right-aligned */
+	TEST_ASSERT(decrypt_iv_parse("0x2a", iv));
+	TEST_ASSERT(iv[AES_BLOCK_SIZE - 1] == 0x2a && iv[0] == 0x00);
+	
+	TEST_ASSERT(!decrypt_iv_parse("0x", iv));
+	TEST_ASSERT(!decrypt_iv_parse("0xZZ", iv));
+	TEST_ASSERT(!decrypt_iv_parse("0x000102030405060708090A0B0C0D0E0F00", iv));
+	
+	return EXIT_SUCCESS;
+	
+}
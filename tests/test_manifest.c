@@ -0,0 +1,99 @@
+/*
+Checks that records written to the manifest are found again once it is reopened, that only
+the latest record per output is kept on disk, and that a read-only manifest is never created.
+*/
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "test.h"
+#include "manifest.h"
+#include "errors.h"
+#include "memory.h"
+
+static const char SHA256_FIRST[] = "5891b5b522d5df086d0ff0b110fbd9d21bb4fc7163af34d08286a2e846f6be03";
+static const char SHA256_SECOND[] = "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855";
+
+static size_t count_lines(const char* const filename) {
+	
+	FILE* const stream = fopen(filename, "rb");
+	
+	TEST_ASSERT(stream != NULL);
+	
+	size_t lines = 0;
+	int ch = 0;
+	
+	while ((ch = fgetc(stream)) != EOF) {
+		lines += ch == '\n';
+	}
+	
+	fclose(stream);
+	
+	return lines;
+	
+}
+
+int main(void) {
+	
+	char directory[64];
+	snprintf(directory, sizeof(directory), "/tmp/sparklec-test-manifest-%ld", (long) getpid());
+	
+	char filename[128];
+	snprintf(filename, sizeof(filename), "%s/.sparklec-manifest", directory);
+	
+	char output[128];
+	snprintf(output, sizeof(output), "%s/Módulo 01/Aula.mp4", directory);
+	
+	TEST_ASSERT(mkdir(directory, 0700) == 0);
+	
+	struct Manifest manifest = {0};
+	uint64_t size = 0;
+	char sha256[SHA256_HEX_SIZE];
+	
+	/* Lookups still work under --plan, but nothing is written */
+	TEST_ASSERT(manifest_open(&manifest, directory, 1) == UERR_SUCCESS);
+	TEST_ASSERT(!manifest_lookup(&manifest, output, &size, sha256));
+	TEST_ASSERT(manifest_record(&manifest, output, 6, SHA256_FIRST, NULL) == UERR_FILE_WRITE_FAILURE);
+	manifest_close(&manifest);
+	
+	TEST_ASSERT(access(filename, F_OK) != 0);
+	
+	TEST_ASSERT(manifest_open(&manifest, directory, 0) == UERR_SUCCESS);
+	TEST_ASSERT(manifest_record(&manifest, output, 6, SHA256_FIRST, "https://example.com/a.m3u8") == UERR_SUCCESS);
+	TEST_ASSERT(manifest_record(&manifest, output, 0, SHA256_SECOND, "https://example.com/b.m3u8") == UERR_SUCCESS);
+	manifest_close(&manifest);
+	
+	TEST_ASSERT(count_lines(filename) == 2);
+	
+	/* A line cut short by a crash */
+	FILE* const stream = fopen(filename, "ab");
+	TEST_ASSERT(stream != NULL);
+	TEST_ASSERT(fputs("{\"path\":\"Módulo 01/Au", stream) >= 0);
+	TEST_ASSERT(fclose(stream) == 0);
+	
+	TEST_ASSERT(manifest_open(&manifest, directory, 0) == UERR_SUCCESS);
+	TEST_ASSERT(count_lines(filename) == 1);
+	
+	TEST_ASSERT(manifest_lookup(&manifest, output, &size, sha256));
+	TEST_ASSERT(size == 0);
+	TEST_ASSERT(strcmp(sha256, SHA256_SECOND) == 0);
+	
+	/* Records are kept relative to the manifest's directory */
+	TEST_ASSERT(manifest_lookup(&manifest, "Módulo 01/Aula.mp4", &size, sha256));
+	
+	char* const source = manifest_find_source(&manifest, "https://example.com/b.m3u8");
+	TEST_ASSERT(source != NULL && strcmp(source, output) == 0);
+	memory_free(source);
+	
+	/* The output no longer holds what was downloaded from there */
+	TEST_ASSERT(manifest_find_source(&manifest, "https://example.com/a.m3u8") == NULL);
+	
+	manifest_close(&manifest);
+	
+	TEST_ASSERT(remove(filename) == 0);
+	TEST_ASSERT(rmdir(directory) == 0);
+	
+	return EXIT_SUCCESS;
+	
+}
@@ -0,0 +1,99 @@
+/*
+Checks lookups in a PathSet, including across the table growing, and that pathset_scan()
+lists only the regular files found at the requested depth.
+*/
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "test.h"
+#include "pathset.h"
+#include "utils.h"
+
+static void touch(const char* const filename) {
+	
+	FILE* const stream = fopen(filename, "wb");
+	
+	TEST_ASSERT(stream != NULL);
+	TEST_ASSERT(fclose(stream) == 0);
+	
+}
+
+int main(void) {
+	
+	struct PathSet set = {0};
+	
+	TEST_ASSERT(!pathset_contains(&set, "Módulo 01/Aula 01/Aula.mp4"));
+	
+	char path[64];
+	
+	/* Several times the initial capacity */
+	for (int index = 0; index < 2000; index++) {
+		snprintf(path, sizeof(path), "Módulo %02d/Aula %04d/Aula.mp4", index % 10, index);
+		TEST_ASSERT(pathset_add(&set, path));
+	}
+	
+	TEST_ASSERT(pathset_add(&set, "Módulo 00/Aula 0000/Aula.mp4"));
+	TEST_ASSERT(set.offset == 2000);
+	
+	for (int index = 0; index < 2000; index++) {
+		snprintf(path, sizeof(path), "Módulo %02d/Aula %04d/Aula.mp4", index % 10, index);
+		TEST_ASSERT(pathset_contains(&set, path));
+	}
+	
+	TEST_ASSERT(!pathset_contains(&set, "Módulo 01/Aula 0000/Aula.mp4"));
+	TEST_ASSERT(!pathset_contains(&set, "Módulo 00/Aula 0000"));
+	
+	pathset_free(&set);
+	
+	char root[64];
+	snprintf(root, sizeof(root), "/tmp/sparklec-test-pathset-%ld", (long) getpid());
+	
+	/* Glob metacharacters in the directory itself are matched literally */
+	char directory[128];
+	snprintf(directory, sizeof(directory), "%s/[Produto] *", root);
+	
+	char lecture[192];
+	snprintf(lecture, sizeof(lecture), "%s/Módulo 01/Aula 01", directory);
+	
+	char filename[256];
+	snprintf(filename, sizeof(filename), "%s/Aula.mp4", lecture);
+	
+	char shallow[256];
+	snprintf(shallow, sizeof(shallow), "%s/Módulo 01/Notas.txt", directory);
+	
+	char deep[256];
+	snprintf(deep, sizeof(deep), "%s/Anexos", lecture);
+	
+	TEST_ASSERT(create_directory(directory));
+	
+	TEST_ASSERT(pathset_scan(&set, directory, 3));
+	TEST_ASSERT(set.offset == 0);
+	
+	TEST_ASSERT(create_directory(deep));
+	touch(filename);
+	touch(shallow);
+	
+	TEST_ASSERT(pathset_scan(&set, directory, 3));
+	TEST_ASSERT(set.offset == 1);
+	TEST_ASSERT(pathset_contains(&set, "Módulo 01/Aula 01/Aula.mp4"));
+	TEST_ASSERT(!pathset_contains(&set, "Módulo 01/Aula 01/Anexos"));
+	TEST_ASSERT(!pathset_contains(&set, "Módulo 01/Notas.txt"));
+	
+	pathset_free(&set);
+	
+	remove(filename);
+	remove(shallow);
+	rmdir(deep);
+	rmdir(lecture);
+	
+	*strrchr(lecture, '/') = '\0';
+	
+	rmdir(lecture);
+	rmdir(directory);
+	rmdir(root);
+	
+	return EXIT_SUCCESS;
+	
+}
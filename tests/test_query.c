@@ -0,0 +1,48 @@
+/*
+Checks that query_stringify() joins the parameters in order and keeps their text as given;
+escaping is left to the callers.
+*/
+
+#include <string.h>
+
+#include "test.h"
+#include "query.h"
+#include "errors.h"
+#include "memory.h"
+
+int main(void) {
+	
+	struct Query query = {0};
+	char* s = NULL;
+	
+	TEST_ASSERT(query_stringify(query, &s) == UERR_SUCCESS);
+	TEST_ASSERT(strcmp(s, "") == 0);
+	memory_free(s);
+	
+	TEST_ASSERT(add_parameter(&query, "grant_type", "refresh_token") == UERR_SUCCESS);
+	TEST_ASSERT(add_parameter(&query, "token", "a%2Bb%3D%26c") == UERR_SUCCESS);
+	TEST_ASSERT(add_parameter(&query, "empty", "") == UERR_SUCCESS);
+	TEST_ASSERT(add_parameter(&query, "", "orphan") == UERR_SUCCESS);
+	
+	TEST_ASSERT(query_stringify(query, &s) == UERR_SUCCESS);
+	TEST_ASSERT(strcmp(s, "grant_type=refresh_token&token=a%2Bb%3D%26c&empty=&=orphan") == 0);
+	TEST_ASSERT(strlen(s) == query.slength);
+	memory_free(s);
+	
+	query_free(&query);
+	
+	/* Enough parameters to grow the array several times */
+	for (int index = 0; index < 100; index++) {
+		TEST_ASSERT(add_parameter(&query, "k", "v") == UERR_SUCCESS);
+	}
+	
+	TEST_ASSERT(query_stringify(query, &s) == UERR_SUCCESS);
+	TEST_ASSERT(strlen(s) == 100 * strlen("k=v") + 99 * strlen("&"));
+	TEST_ASSERT(strncmp(s, "k=v&k=v&", 8) == 0);
+	memory_free(s);
+	
+	query_free(&query);
+	
+	return EXIT_SUCCESS;
+	
+}
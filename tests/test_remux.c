@@ -0,0 +1,129 @@
+/*
+Remuxes a small transport stream (one H.264 access unit and one ADTS frame, as served by
+sparklec_mockserver) and checks the layout of the resulting MP4. The output must not depend
+on how the input is split across calls to remuxer_feed().
+	
+	test_remux <segment.ts>
+*/
+
+#include <string.h>
+
+#include "test.h"
+#include "remux.h"
+#include "errors.h"
+
+#define SEGMENT_MAX_SIZE (1024 * 64)
+
+/* Room is reserved up front for the moov box */
+#define OUTPUT_MAX_SIZE (1024 * 1024)
+
+static size_t remux(
+	const unsigned char* const segment,
+	const size_t size,
+	const size_t chunk_size,
+	unsigned char* const output,
+	const size_t output_size
+) {
+	
+	FILE* const stream = tmpfile();
+	TEST_ASSERT(stream != NULL);
+	
+	struct Remuxer remuxer = {0};
+	TEST_ASSERT(remuxer_init(&remuxer, stream, 6) == UERR_SUCCESS);
+	
+	for (size_t offset = 0; offset < size; offset += chunk_size) {
+		const size_t length = size - offset < chunk_size ? size - offset : chunk_size;
+		TEST_ASSERT(remuxer_feed(&remuxer, segment + offset, length) == UERR_SUCCESS);
+	}
+	
+	TEST_ASSERT(remuxer_finish(&remuxer) == UERR_SUCCESS);
+	
+	TEST_ASSERT(remuxer.video.samples.offset == 1);
+	TEST_ASSERT(remuxer.audio.samples.offset == 1);
+	TEST_ASSERT(remuxer.video.samples.items[0].keyframe);
+	
+	remuxer_free(&remuxer);
+	
+	rewind(stream);
+	
+	const size_t written = fread(output, 1, output_size, stream);
+	
+	TEST_ASSERT(feof(stream));
+	fclose(stream);
+	
+	return written;
+	
+}
+
+static uint32_t read_box_size(const unsigned char* const data) {
+	
+	return ((uint32_t) data[0] << 24) | ((uint32_t) data[1] << 16) | ((uint32_t) data[2] << 8) | (uint32_t) data[3];
+	
+}
+
+static int has_box(const unsigned char* const data, const size_t size, const char* const type) {
+	
+	for (size_t offset = 0; offset + 8 <= size; ) {
+		const uint32_t box_size = read_box_size(data + offset);
+		
+		if (memcmp(data + offset + 4, type, 4) == 0) {
+			return 1;
+		}
+		
+		if (box_size < 8) {
+			return 0;
+		}
+		
+		offset += box_size;
+	}
+	
+	return 0;
+	
+}
+
+int main(int argc, char* argv[]) {
+	
+	TEST_ASSERT(argc == 2);
+	
+	FILE* const stream = fopen(argv[1], "rb");
+	TEST_ASSERT(stream != NULL);
+	
+	static unsigned char segment[SEGMENT_MAX_SIZE];
+	const size_t size = fread(segment, 1, sizeof(segment), stream);
+	
+	fclose(stream);
+	
+	TEST_ASSERT(size > 0 && size % 188 == 0);
+	
+	static unsigned char whole[OUTPUT_MAX_SIZE];
+	static unsigned char split[OUTPUT_MAX_SIZE];
+	
+	const size_t whole_size = remux(segment, size, size, whole, sizeof(whole));
+	
+	TEST_ASSERT(whole_size > 8);
+	TEST_ASSERT(memcmp(whole + 4, "ftyp", 4) == 0);
+	TEST_ASSERT(has_box(whole, whole_size, "moov"));
+	TEST_ASSERT(has_box(whole, whole_size, "mdat"));
+	
+	/* Packets and PES headers cut at odd places */
+	const size_t split_size = remux(segment, size, 7, split, sizeof(split));
+	
+	TEST_ASSERT(split_size == whole_size);
+	TEST_ASSERT(memcmp(split, whole, whole_size) == 0);
+	
+	/* Garbage in place of a sync byte */
+	segment[188] = 0x00;
+	
+	FILE* const output = tmpfile();
+	TEST_ASSERT(output != NULL);
+	
+	struct Remuxer remuxer = {0};
+	TEST_ASSERT(remuxer_init(&remuxer, output, 6) == UERR_SUCCESS);
+	TEST_ASSERT(remuxer_feed(&remuxer, segment, size) == UERR_REMUX_INVALID_STREAM);
+	
+	remuxer_free(&remuxer);
+	fclose(output);
+	
+	return EXIT_SUCCESS;
+	
+}